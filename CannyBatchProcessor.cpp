@@ -0,0 +1,161 @@
+/**
+ * \file      CannyBatchProcessor.cpp
+ * \brief     Edge detection in batches of small images.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <limits.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "CannyBatchProcessor.h"
+
+CannyBatchProcessor::CannyBatchProcessor()
+{
+	fixed_point = false;
+	gradient = CANNY_GRADIENT_EXACT;
+	recursive_sigma = CannyEdgeDetector().GetRecursiveSigma();
+	border = CANNY_BORDER_REPLICATE;
+	border_value = 0;
+	detectors.push_back(this->NewDetector());
+}
+
+CannyBatchProcessor::~CannyBatchProcessor()
+{
+	for (size_t i = 0; i < detectors.size(); i++) {
+		delete detectors[i];
+	}
+}
+
+CannyEdgeDetector *CannyBatchProcessor::NewDetector() const
+{
+	CannyEdgeDetector *detector = new CannyEdgeDetector();
+	detector->SetFixedPoint(fixed_point);
+	detector->SetGradient(gradient);
+	detector->SetRecursiveSigma(recursive_sigma);
+	detector->SetBorder(border, border_value);
+	return detector;
+}
+
+void CannyBatchProcessor::SetThreadCount(unsigned int count)
+{
+	thread_pool.SetThreadCount(count);
+
+	while (detectors.size() < thread_pool.GetThreadCount()) {
+		detectors.push_back(this->NewDetector());
+	}
+	while (detectors.size() > thread_pool.GetThreadCount()) {
+		delete detectors.back();
+		detectors.pop_back();
+	}
+}
+
+unsigned int CannyBatchProcessor::GetThreadCount() const
+{
+	return thread_pool.GetThreadCount();
+}
+
+void CannyBatchProcessor::SetFixedPoint(bool fixed_point)
+{
+	this->fixed_point = fixed_point;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetFixedPoint(fixed_point);
+	}
+}
+
+void CannyBatchProcessor::SetGradient(CannyGradient gradient)
+{
+	this->gradient = gradient;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetGradient(gradient);
+	}
+}
+
+void CannyBatchProcessor::SetRecursiveSigma(float min_sigma)
+{
+	this->recursive_sigma = min_sigma;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetRecursiveSigma(min_sigma);
+	}
+}
+
+void CannyBatchProcessor::SetBorder(CannyBorder border, uint8_t value)
+{
+	this->border = border;
+	this->border_value = value;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetBorder(border, value);
+	}
+}
+
+bool CannyBatchProcessor::Run(const CannyImageView *images, const CannyMaskView *masks,
+                              unsigned int count, float sigma, uint8_t lowThreshold,
+                              uint8_t highThreshold)
+{
+	if (!(sigma > 0.0f)) {
+		return false;
+	}
+
+	/*
+	 * All images are checked first, so that batch is processed whole or
+	 * not at all. Image needing biggest buffers is found on the way.
+	 */
+	unsigned int mask_size = CannyEdgeDetector::MaskSize(sigma);
+	unsigned long margin = mask_size - 1;
+	unsigned int biggest = 0;
+	unsigned long biggest_size = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		if (!CannyEdgeDetector::IsValid(images[i], masks[i]) ||
+		    (unsigned long) (images[i].width + margin) * (images[i].height + margin) > UINT_MAX) {
+			return false;
+		}
+
+		unsigned long size = detectors[0]->ArenaSize(images[i].width, images[i].height, mask_size);
+		if (size > biggest_size) {
+			biggest = i;
+			biggest_size = size;
+		}
+	}
+	if (count == 0) {
+		return true;
+	}
+
+	/*
+	 * Biggest images go first, so that small ones fill gaps at the end.
+	 */
+	order.resize(count);
+	for (unsigned int i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [images](unsigned int a, unsigned int b) {
+		return (unsigned long) images[a].width * images[a].height >
+		       (unsigned long) images[b].width * images[b].height;
+	});
+
+	/*
+	 * Each thread reserves buffers of its detector for the biggest image
+	 * (nothing is allocated if previous batches were as big), then takes
+	 * next image not taken yet.
+	 */
+	std::atomic<unsigned int> next_image(0);
+	unsigned int threads = std::min((unsigned int) detectors.size(), count);
+	thread_pool.ParallelFor(0, threads, [&](unsigned long first, unsigned long last) {
+		for (unsigned long thread = first; thread < last; thread++) {
+			CannyEdgeDetector &detector = *detectors[thread];
+			detector.Reserve(images[biggest].width, images[biggest].height, sigma);
+
+			unsigned int i;
+			while ((i = next_image++) < count) {
+				detector.ProcessImage(images[order[i]], masks[order[i]], sigma,
+				                      lowThreshold, highThreshold);
+			}
+		}
+	});
+
+	return true;
+}
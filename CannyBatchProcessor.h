@@ -0,0 +1,126 @@
+/**
+ * \file      CannyBatchProcessor.h
+ * \brief     Edge detection in batches of small images, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYBATCHPROCESSOR_H_
+#define _CANNYBATCHPROCESSOR_H_
+
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+
+/**
+ * \brief Detects edges in many small images (thumbnails) at once.
+ *
+ * Splitting rows of small image between threads costs more than it saves,
+ * so images are spread between threads instead, each processing whole
+ * images one after another with its own single-threaded detector. Buffers
+ * of each detector are reserved once for the biggest image of batch, and
+ * Gauss mask is looked up once per thread, so images after the first do
+ * not pay for allocation or kernel construction. Threads take next image
+ * not taken yet, biggest images first, so they finish at similar time.
+ *
+ * Masks are same as those of CannyEdgeDetector::ProcessImage().
+ */
+class CannyBatchProcessor
+{
+	public:
+		/**
+		 * \brief Constructor, batch runs on one thread.
+		 */
+		CannyBatchProcessor();
+
+		/**
+		 * \brief Destructor, frees detectors.
+		 */
+		~CannyBatchProcessor();
+
+		/**
+		 * \brief Sets number of images processed at once.
+		 *
+		 * \param count Number of threads, 0 means one per hardware thread.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief Returns number of images processed at once.
+		 */
+		unsigned int GetThreadCount() const;
+
+		/**
+		 * \brief See CannyEdgeDetector::SetFixedPoint().
+		 */
+		void SetFixedPoint(bool fixed_point);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetGradient().
+		 */
+		void SetGradient(CannyGradient gradient);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetBorder().
+		 */
+		void SetBorder(CannyBorder border, uint8_t value = 0);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetRecursiveSigma().
+		 */
+		void SetRecursiveSigma(float min_sigma);
+
+		/**
+		 * \brief Processes all images with the same parameters.
+		 *
+		 * \param images Source images, of any sizes and layouts.
+		 * \param masks Destination masks, one per image, of its size.
+		 * \param count Number of images.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if any image, mask or sigma is invalid, nothing is
+		 * processed then.
+		 */
+		bool Run(const CannyImageView *images, const CannyMaskView *masks,
+		         unsigned int count, float sigma = 1.0f, uint8_t lowThreshold = 30,
+		         uint8_t highThreshold = 80);
+
+	private:
+		CannyBatchProcessor(const CannyBatchProcessor &);
+		CannyBatchProcessor &operator=(const CannyBatchProcessor &);
+
+		/**
+		 * \brief Creates detector with current settings.
+		 */
+		CannyEdgeDetector *NewDetector() const;
+
+		/**
+		 * \var One detector per thread.
+		 */
+		std::vector<CannyEdgeDetector *> detectors;
+
+		/**
+		 * \var Threads processing images.
+		 */
+		CannyThreadPool thread_pool;
+
+		/**
+		 * \var Indices of images, biggest first.
+		 */
+		std::vector<unsigned int> order;
+
+		/**
+		 * \var Settings passed to detectors.
+		 */
+		bool fixed_point;
+		CannyGradient gradient;
+		float recursive_sigma;
+		CannyBorder border;
+		uint8_t border_value;
+};
+
+#endif // #ifndef _CANNYBATCHPROCESSOR_H_
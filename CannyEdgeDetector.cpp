@@ -8,7 +8,15 @@
  * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
  */
 
+#include <limits.h>
 #include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
 
 #include "CannyEdgeDetector.h"
 
@@ -16,419 +24,2323 @@ CannyEdgeDetector::CannyEdgeDetector()
 {
 	width = (unsigned int) 0;
 	height = (unsigned int) 0;
-	x = (unsigned int) 0;
-	y = (unsigned int) 0;
+	source_bitmap = NULL;
+	source_stride = 0;
+	source_format = CANNY_PIXEL_BGR24;
+	mask_bitmap = NULL;
+	mask_stride = 0;
+	mask_format = CANNY_MASK_BGR24;
 	mask_halfsize = (unsigned int) 0;
+	mask_size = (unsigned int) 1;
+	arena = NULL;
+	arena_size = 0;
+	allocation_count = 0;
+	gaussian_kernel = NULL;
+	gaussian_kernel_fixed = NULL;
+	recursive_filter = NULL;
+	gaussian_kernel_size = (unsigned int) 0;
+	gaussian_sigma = 0.0f;
+	edge_max = 0.0f;
+	streaming = false;
+	task_scheduling = false;
+	keep_suppressed = false;
+	task_strips = task_strip_rows = task_halfsize = 0;
+	fixed_point = false;
+	gradient = CANNY_GRADIENT_EXACT;
+	recursive_sigma = 8.0f;
+	border = CANNY_BORDER_REPLICATE;
+	border_value = 0;
+	stream_bands = 1;
+	stats = NULL;
+	trace = NULL;
+	stage = CANNY_STAGE_LUMINANCE;
+	kernels = CannySelectKernels(CANNY_KERNELS_AUTO);
+	this->Release();
+}
+
+CannyEdgeDetector::~CannyEdgeDetector()
+{
+	this->Release();
+}
+
+void CannyEdgeDetector::Reserve(unsigned int width, unsigned int height,
+                                float max_sigma)
+{
+	this->GrowArena(this->ArenaSize(width, height, MaskSize(max_sigma)));
+}
+
+void CannyEdgeDetector::Release()
+{
+	delete[] arena;
+	arena = NULL;
+	arena_size = 0;
+
+	gray_bitmap = NULL;
+	workspace_bitmap = NULL;
+	edge_magnitude = NULL;
+	edge_direction = NULL;
+	blur_buffer = NULL;
+	edge_stack = NULL;
+	suppressed_bitmap = NULL;
+	suppressed_valid = false;
+	stream_rings = NULL;
+}
+
+unsigned long CannyEdgeDetector::GetAllocationCount() const
+{
+	return allocation_count;
+}
+
+unsigned long CannyEdgeDetector::GetReservedBytes() const
+{
+	return arena_size;
+}
+
+bool CannyEdgeDetector::SetKernelSet(CannyKernelSet set)
+{
+	const CannyKernels *selected = CannySelectKernels(set);
+
+	if (selected == NULL) {
+		return false;
+	}
+	kernels = selected;
+	return true;
+}
+
+CannyKernelSet CannyEdgeDetector::GetKernelSet() const
+{
+	return kernels->set;
+}
+
+void CannyEdgeDetector::SetThreadCount(unsigned int count)
+{
+	thread_pool.SetThreadCount(count);
+}
+
+unsigned int CannyEdgeDetector::GetThreadCount() const
+{
+	return thread_pool.GetThreadCount();
+}
+
+void CannyEdgeDetector::SetStreaming(bool streaming)
+{
+	this->streaming = streaming;
+}
+
+bool CannyEdgeDetector::GetStreaming() const
+{
+	return streaming;
+}
+
+void CannyEdgeDetector::SetTaskScheduling(bool tasks)
+{
+	this->task_scheduling = tasks;
+}
+
+bool CannyEdgeDetector::GetTaskScheduling() const
+{
+	return task_scheduling;
+}
+
+void CannyEdgeDetector::SetFixedPoint(bool fixed_point)
+{
+	this->fixed_point = fixed_point;
+}
+
+bool CannyEdgeDetector::GetFixedPoint() const
+{
+	return fixed_point;
+}
+
+void CannyEdgeDetector::SetKeepSuppressed(bool keep)
+{
+	keep_suppressed = keep;
+	// Buffer is only carved out of arena by next image.
+	suppressed_valid = false;
+}
+
+bool CannyEdgeDetector::GetKeepSuppressed() const
+{
+	return keep_suppressed;
+}
+
+void CannyEdgeDetector::SetGradient(CannyGradient gradient)
+{
+	this->gradient = gradient;
+}
+
+CannyGradient CannyEdgeDetector::GetGradient() const
+{
+	return gradient;
+}
+
+void CannyEdgeDetector::SetRecursiveSigma(float min_sigma)
+{
+	this->recursive_sigma = min_sigma;
+}
+
+float CannyEdgeDetector::GetRecursiveSigma() const
+{
+	return recursive_sigma;
+}
+
+void CannyEdgeDetector::SetBorder(CannyBorder border, uint8_t value)
+{
+	this->border = border;
+	this->border_value = value;
+}
+
+CannyBorder CannyEdgeDetector::GetBorder() const
+{
+	return border;
+}
+
+uint8_t CannyEdgeDetector::GetBorderValue() const
+{
+	return border_value;
+}
+
+bool CannyEdgeDetector::SetStats(CannyStats *stats)
+{
+#ifdef CANNY_INSTRUMENTATION
+	this->stats = stats;
+	return true;
+#else
+	return stats == NULL;
+#endif
+}
+
+bool CannyEdgeDetector::SetTrace(CannyTrace *trace)
+{
+#ifdef CANNY_INSTRUMENTATION
+	this->trace = trace;
+	return true;
+#else
+	return trace == NULL;
+#endif
+}
+
+uint8_t* CannyEdgeDetector::ProcessImage(uint8_t* source_bitmap, unsigned int width,
+                                         unsigned int height, float sigma,
+                                         uint8_t lowThreshold, uint8_t highThreshold)
+{
+	/*
+	 * We store image in array of bytes (chars) in BGR(BGRBGRBGR...) order.
+	 * Size of the table is width * height * 3 bytes. Edges are written
+	 * back into the same array.
+	 */
+	CannyImageView image = {source_bitmap, width, height, (size_t) width * 3, CANNY_PIXEL_BGR24};
+	CannyMaskView mask = {source_bitmap, (size_t) width * 3, CANNY_MASK_BGR24};
+
+	this->ProcessImage(image, mask, sigma, lowThreshold, highThreshold);
+
+	return source_bitmap;
+}
+
+size_t CannyEdgeDetector::MaskRowSize(unsigned int width, CannyMaskFormat format)
+{
+	if (format == CANNY_MASK_BIT1) {
+		return ((size_t) width + 7) / 8;
+	} else if (format == CANNY_MASK_BGR24) {
+		return (size_t) width * 3;
+	}
+	return width;
+}
+
+bool CannyEdgeDetector::IsValid(const CannyImageView &image, const CannyMaskView &mask)
+{
+	return image.data != NULL && mask.data != NULL && image.width > 0 &&
+	       image.height > 0 && image.format < CANNY_PIXEL_FORMATS &&
+	       image.stride >= (size_t) image.width * CannyPixelSize(image.format) &&
+	       mask.stride >= MaskRowSize(image.width, mask.format);
+}
+
+bool CannyEdgeDetector::BeginImage(const CannyImageView &image, const CannyMaskView &mask,
+                                   float sigma)
+{
+	if (!IsValid(image, mask) || !(sigma > 0.0f)) {
+		return false;
+	}
+
+	// Worklist of edge tracing holds 32-bit indices of enlarged image.
+	// Bigger images have to be processed by CannyTiledProcessor.
+	unsigned long margin = MaskSize(sigma) - 1;
+	if ((unsigned long) (image.width + margin) * (image.height + margin) > UINT_MAX) {
+		return false;
+	}
+
+	// Buffers are about to be overwritten.
+	suppressed_valid = false;
+
+	/*
+	 * Setting up image width and height in pixels.
+	 */
+	this->width = image.width;
+	this->height = image.height;
+
+	/*
+	 * Source image is only read, edges go to separate mask.
+	 */
+	this->source_bitmap = image.data;
+	this->source_stride = image.stride;
+	this->source_format = image.format;
+	this->mask_bitmap = mask.data;
+	this->mask_stride = mask.stride;
+	this->mask_format = mask.format;
+
+	/*
+	 * Taking working buffers out of arena. At this step we already need to
+	 * know the size of gaussian mask. Memory is allocated only if image is
+	 * bigger than any processed (or reserved) before.
+	 */
+	this->AllocateBuffers(sigma);
+
+	/*
+	 * Gauss mask, needed by both frame and streaming modes.
+	 */
+	this->BuildGaussianKernel(sigma);
+
+	return true;
+}
+
+inline void CannyEdgeDetector::BeginStage(CannyStage stage)
+{
+#ifdef CANNY_INSTRUMENTATION
+	if (stats != NULL || trace != NULL) {
+		this->stage = stage;
+		thread_pool.SetTrace(trace, stage);
+		stage_begin = std::chrono::steady_clock::now();
+	}
+#else
+	(void) stage;
+#endif
+}
+
+inline void CannyEdgeDetector::EndStage()
+{
+#ifdef CANNY_INSTRUMENTATION
+	if (stats != NULL || trace != NULL) {
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		if (stats != NULL) {
+			stats->stage_seconds[stage] += std::chrono::duration<double>(end - stage_begin).count();
+		}
+		if (trace != NULL) {
+			trace->AddSpan(stage, false, stage_begin, end);
+		}
+		thread_pool.SetTrace(NULL, stage);
+	}
+#endif
+}
+
+bool CannyEdgeDetector::ProcessImage(const CannyImageView &image, const CannyMaskView &mask,
+                                     float sigma, uint8_t lowThreshold,
+                                     uint8_t highThreshold)
+{
+	CANNY_INSTRUMENT(if (stats != NULL) memset(stats, 0, sizeof(CannyStats)));
+
+	/*
+	 * Steps up to suppression of non maximum pixels.
+	 */
+	if (!this->KeepSuppressed(image, mask, sigma)) {
+		return false;
+	}
+
+	/*
+	 * Tracing of edges, result goes to mask.
+	 */
+	this->TraceImage(lowThreshold, highThreshold);
+
+	return true;
+}
+
+bool CannyEdgeDetector::KeepSuppressed(const CannyImageView &image, const CannyMaskView &mask,
+                                       float sigma)
+{
+	/*
+	 * Checking arguments and preparing buffers.
+	 */
+	if (!this->BeginImage(image, mask, sigma)) {
+		return false;
+	}
+
+	this->SuppressImage();
+
+	/*
+	 * Suppressed image is kept for Rethreshold(), if asked for.
+	 */
+	if (keep_suppressed) {
+		memcpy(suppressed_bitmap, workspace_bitmap, (size_t) width * height);
+		suppressed_valid = true;
+	}
+
+	return true;
+}
+
+bool CannyEdgeDetector::Rethreshold(uint8_t lowThreshold, uint8_t highThreshold)
+{
+	if (!suppressed_valid || mask_bitmap == NULL) {
+		return false;
+	}
+
+	CANNY_INSTRUMENT(if (stats != NULL) memset(stats, 0, sizeof(CannyStats)));
+
+	// Workspace is enlarged again, as SuppressImage() left it.
+	height += mask_halfsize * 2;
+	width += mask_halfsize * 2;
+	memcpy(workspace_bitmap, suppressed_bitmap, (size_t) width * height);
+
+	this->TraceImage(lowThreshold, highThreshold);
+
+	return true;
+}
+
+bool CannyEdgeDetector::Rethreshold(uint8_t lowThreshold, uint8_t highThreshold,
+                                    const CannyMaskView &mask)
+{
+	if (!suppressed_valid || mask.data == NULL ||
+	    mask.stride < MaskRowSize(width, mask.format)) {
+		return false;
+	}
+
+	mask_bitmap = mask.data;
+	mask_stride = mask.stride;
+	mask_format = mask.format;
+
+	return this->Rethreshold(lowThreshold, highThreshold);
+}
+
+bool CannyEdgeDetector::ProcessPoints(const CannyImageView &image,
+                                      std::vector<CannyEdgePoint> &points, float sigma,
+                                      uint8_t lowThreshold, uint8_t highThreshold,
+                                      bool withGradient)
+{
+	if (!this->TracePoints(image, sigma, lowThreshold, highThreshold, withGradient)) {
+		return false;
+	}
+
+	this->BeginStage(CANNY_STAGE_POSTPROCESS);
+	this->CollectPoints(points, withGradient);
+	this->EndStage();
+
+	return true;
+}
+
+bool CannyEdgeDetector::ProcessContours(const CannyImageView &image,
+                                        std::vector<CannyEdgePoint> &points,
+                                        std::vector<unsigned int> &contours, float sigma,
+                                        uint8_t lowThreshold, uint8_t highThreshold,
+                                        bool withGradient)
+{
+	if (!this->TracePoints(image, sigma, lowThreshold, highThreshold, withGradient)) {
+		return false;
+	}
+
+	this->BeginStage(CANNY_STAGE_POSTPROCESS);
+	this->CollectContours(points, contours, withGradient);
+	this->EndStage();
+
+	return true;
+}
+
+bool CannyEdgeDetector::TracePoints(const CannyImageView &image, float sigma,
+                                    uint8_t lowThreshold, uint8_t highThreshold,
+                                    bool withGradient)
+{
+	static uint8_t unused_mask;
+
+	// Streaming mode keeps rows of gradient in rings only.
+	if (withGradient && streaming) {
+		return false;
+	}
+
+	CANNY_INSTRUMENT(if (stats != NULL) memset(stats, 0, sizeof(CannyStats)));
+
+	CannyMaskView mask = {&unused_mask, image.width, CANNY_MASK_GRAY8};
+	if (!this->KeepSuppressed(image, mask, sigma)) {
+		return false;
+	}
+	// There is no mask Rethreshold() could write to, until one is given.
+	mask_bitmap = NULL;
+
+	this->TraceEdges(lowThreshold, highThreshold);
+
+	return true;
+}
+
+bool CannyEdgeDetector::ProcessRegions(const CannyImageView &image, const CannyMaskView &mask,
+                                       const CannyRegion *regions, unsigned int count,
+                                       float sigma, uint8_t lowThreshold,
+                                       uint8_t highThreshold)
+{
+	static uint8_t unused_mask;
+
+	/*
+	 * Checking all regions before any of them is written. Region enlarged
+	 * by its halo and Gauss margins must fit 32-bit indices, as in
+	 * BeginImage().
+	 */
+	CannyMaskView image_mask = {&unused_mask, image.width, CANNY_MASK_GRAY8};
+	if (!IsValid(image, image_mask) || !(sigma > 0.0f) || (count > 0 && regions == NULL)) {
+		return false;
+	}
+
+	unsigned long margin = MaskSize(sigma) - 1;
+	unsigned long halo = margin / 2 + 2;
+	for (unsigned int i = 0; i < count; i++) {
+		const CannyRegion &region = regions[i];
+		bool own_mask = region.mask.data != NULL;
+		const CannyMaskView &target = own_mask ? region.mask : mask;
+
+		if (region.width == 0 || region.height == 0 ||
+		    region.width > image.width || region.left > image.width - region.width ||
+		    region.height > image.height || region.top > image.height - region.height ||
+		    target.data == NULL ||
+		    target.stride < MaskRowSize(own_mask ? region.width : image.width, target.format) ||
+		    (region.width + 2 * halo + margin) * (region.height + 2 * halo + margin) > UINT_MAX) {
+			return false;
+		}
+	}
+
+	CANNY_INSTRUMENT(if (stats != NULL) memset(stats, 0, sizeof(CannyStats)));
+
+	for (unsigned int i = 0; i < count; i++) {
+		const CannyRegion &region = regions[i];
+		bool own_mask = region.mask.data != NULL;
+
+		/*
+		 * Part of image region depends on. Rows and columns near edges of
+		 * the part differ from those of whole image, but they are outside
+		 * of region.
+		 */
+		unsigned long top = region.top > halo ? region.top - halo : 0;
+		unsigned long left = region.left > halo ? region.left - halo : 0;
+		unsigned long bottom = std::min((unsigned long) image.height,
+		                                (unsigned long) region.top + region.height + halo);
+		unsigned long right = std::min((unsigned long) image.width,
+		                               (unsigned long) region.left + region.width + halo);
+
+		CannyImageView part = {image.data + top * image.stride + left * CannyPixelSize(image.format),
+		                       (unsigned int) (right - left), (unsigned int) (bottom - top),
+		                       image.stride, image.format};
+		// Mask is never written by PostProcessImage(), WriteRegion() is.
+		CannyMaskView part_mask = {&unused_mask, part.width, CANNY_MASK_GRAY8};
+
+		this->BeginImage(part, part_mask, sigma);
+		this->SuppressImage();
+
+		/*
+		 * Pixels outside of region are cleared, so edges are traced inside
+		 * it only. Margins next to borders of image are kept, as
+		 * ProcessImage() keeps them.
+		 */
+		unsigned long first_row = mask_halfsize + region.top - top;
+		unsigned long first_column = mask_halfsize + region.left - left;
+		unsigned long keep_top = region.top > 0 ? first_row : 0;
+		unsigned long keep_left = region.left > 0 ? first_column : 0;
+		unsigned long keep_bottom = region.top + region.height < image.height ?
+			first_row + region.height : height;
+		unsigned long keep_right = region.left + region.width < image.width ?
+			first_column + region.width : width;
+
+		thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+			for (unsigned long x = first; x < last; x++) {
+				uint8_t *row = workspace_bitmap + x * width;
+				if (x < keep_top || x >= keep_bottom) {
+					memset(row, 0, width);
+				} else {
+					memset(row, 0, keep_left);
+					memset(row + keep_right, 0, width - keep_right);
+				}
+			}
+		});
+
+		/*
+		 * Tracing of edges, as in TraceImage(), but only region goes to
+		 * mask.
+		 */
+		this->TraceEdges(lowThreshold, highThreshold);
+
+		this->BeginStage(CANNY_STAGE_POSTPROCESS);
+		if (own_mask) {
+			this->WriteRegion(region, workspace_bitmap + first_row * width + first_column,
+			                  width, region.mask, region.width, 0, 0);
+		} else {
+			this->WriteRegion(region, workspace_bitmap + first_row * width + first_column,
+			                  width, mask, image.width, region.top, region.left);
+		}
+		this->EndStage();
+	}
+
+	return true;
+}
+
+void CannyEdgeDetector::SuppressImage()
+{
+	if (streaming) {
+		/*
+		 * All steps up to suppression of non maximum pixels fused, row by
+		 * row.
+		 */
+		this->BeginStage(CANNY_STAGE_STREAM);
+		this->StreamImage();
+		this->EndStage();
+	} else if (task_scheduling && !this->UsesRecursiveBlur()) {
+		/*
+		 * Same steps, strip by strip, each started when its input is
+		 * ready.
+		 */
+		this->BeginStage(CANNY_STAGE_TASKS);
+		this->TaskImage();
+		this->EndStage();
+	} else {
+		/*
+		 * Conversion to grayscale. Only luminance information remains.
+		 */
+		if (source_format != CANNY_PIXEL_GRAY8) {
+			this->BeginStage(CANNY_STAGE_LUMINANCE);
+			this->Luminance();
+			this->EndStage();
+		}
+
+		/*
+		 * "Widening" image.
+		 */
+		this->BeginStage(CANNY_STAGE_PREPROCESS);
+		this->PreProcessImage();
+		this->EndStage();
+
+		/*
+		 * Noise reduction - Gaussian filter.
+		 */
+		this->BeginStage(CANNY_STAGE_BLUR);
+		this->BlurImage();
+		this->EndStage();
+
+		/*
+		 * Edge detection - Sobel filter.
+		 */
+		this->BeginStage(CANNY_STAGE_EDGE_DETECTION);
+		this->EdgeDetection();
+		this->EndStage();
+
+		/*
+		 * Suppression of non maximum pixels.
+		 */
+		this->BeginStage(CANNY_STAGE_NON_MAX_SUPPRESSION);
+		this->NonMaxSuppression();
+		this->EndStage();
+	}
+}
+
+void CannyEdgeDetector::TraceImage(uint8_t lowThreshold, uint8_t highThreshold)
+{
+	this->TraceEdges(lowThreshold, highThreshold);
+
+	/*
+	 * "Shrinking" image.
+	 */
+	this->BeginStage(CANNY_STAGE_POSTPROCESS);
+	this->PostProcessImage();
+	this->EndStage();
+}
+
+void CannyEdgeDetector::TraceEdges(uint8_t lowThreshold, uint8_t highThreshold)
+{
+	/*
+	 * Promotion of pixels connected with strongest ones.
+	 */
+	this->BeginStage(CANNY_STAGE_PROPAGATION);
+	this->PropagateEdges();
+	this->EndStage();
+
+	/*
+	 * Hysteresis thresholding.
+	 */
+	this->BeginStage(CANNY_STAGE_HYSTERESIS);
+	this->Hysteresis(lowThreshold, highThreshold);
+	this->EndStage();
+}
+
+inline uint8_t CannyEdgeDetector::GetPixelValue(unsigned int x, unsigned int y)
+{
+	return (uint8_t) *(workspace_bitmap + (unsigned long) x * width + y);
+}
+
+inline void CannyEdgeDetector::SetPixelValue(unsigned int x, unsigned int y,
+                                             uint8_t value)
+{
+	workspace_bitmap[(unsigned long) x * width + y] = value;
+}
+
+unsigned int CannyEdgeDetector::MaskSize(float sigma)
+{
+	// Finding mask size with given sigma.
+	return 2 * round(sqrt(-log(0.3) * 2 * sigma * sigma)) + 1;
+}
+
+/**
+ * \brief Rounds size of arena chunk up to cache line.
+ */
+static inline unsigned long AlignChunk(unsigned long size)
+{
+	return (size + 63) & ~63UL;
+}
+
+unsigned long CannyEdgeDetector::ArenaSize(unsigned int width,
+                                           unsigned int height,
+                                           unsigned int mask_size) const
+{
+	unsigned long image = (unsigned long) width * height;
+	unsigned long enlarged = (unsigned long) (width + mask_size - 1) * (height + mask_size - 1);
+
+	// One spare cache line, so that arena can be aligned.
+	unsigned long size = 64 + AlignChunk(enlarged)                           // workspace_bitmap
+	                        + AlignChunk(enlarged * sizeof(unsigned int));   // edge_stack
+
+	if (keep_suppressed) {
+		size += AlignChunk(enlarged);                  // suppressed_bitmap
+	}
+
+	if (streaming) {
+		// Suppressed magnitudes share edge_stack, see AllocateBuffers().
+		size += thread_pool.GetThreadCount() * RingSize(width + mask_size - 1, mask_size);
+	} else {
+		size += AlignChunk(enlarged * sizeof(float))   // edge_magnitude
+		      + AlignChunk(image)                      // gray_bitmap
+		      + AlignChunk(enlarged)                   // edge_direction
+		      + AlignChunk(enlarged * sizeof(float));  // blur_buffer
+	}
+
+	return size;
+}
+
+unsigned long CannyEdgeDetector::RingSize(unsigned int width,
+                                          unsigned int mask_size)
+{
+	return AlignChunk((unsigned long) mask_size * width)                     // gray rows
+	     + AlignChunk((unsigned long) 2 * mask_size * width * sizeof(float)) // blurred rows
+	     + AlignChunk((unsigned long) 6 * width)                             // smoothed rows
+	     + AlignChunk((unsigned long) 3 * width * sizeof(float))             // magnitude rows
+	     + AlignChunk((unsigned long) 3 * width);                            // direction rows
+}
+
+void CannyEdgeDetector::GrowArena(unsigned long size)
+{
+	if (size <= arena_size) {
+		return;
+	}
+
+	this->Release();
+	arena = new uint8_t[size];
+	arena_size = size;
+	allocation_count++;
+	CANNY_INSTRUMENT(if (stats != NULL) stats->bytes_allocated += size);
+}
+
+void CannyEdgeDetector::AllocateBuffers(float sigma)
+{
+	mask_size = MaskSize(sigma);
+	mask_halfsize = mask_size / 2;
+
+	this->GrowArena(this->ArenaSize(width, height, mask_size));
+
+	unsigned long image = (unsigned long) width * height;
+	unsigned long enlarged = (unsigned long) (width + 2 * mask_halfsize) * (height + 2 * mask_halfsize);
+	uint8_t *chunk = (uint8_t *) AlignChunk((unsigned long) arena);
+
+	workspace_bitmap = chunk;
+	chunk += AlignChunk(enlarged);
+	edge_stack = (unsigned int *) chunk;
+	chunk += AlignChunk(enlarged * sizeof(unsigned int));
+	if (keep_suppressed) {
+		suppressed_bitmap = chunk;
+		chunk += AlignChunk(enlarged);
+	} else {
+		suppressed_bitmap = NULL;
+	}
+
+	if (streaming) {
+		// Full size intermediates are replaced with ring buffers, one set
+		// per band. Suppressed magnitudes cannot be quantized before
+		// maximum of whole image is known, so they are kept at full size,
+		// in worklist of edge tracing, which is not used until then.
+		edge_magnitude = (float *) edge_stack;
+		gray_bitmap = NULL;
+		edge_direction = NULL;
+		blur_buffer = NULL;
+		stream_rings = chunk;
+		stream_bands = thread_pool.GetThreadCount();
+	} else {
+		edge_magnitude = (float *) chunk;
+		chunk += AlignChunk(enlarged * sizeof(float));
+		gray_bitmap = chunk;
+		chunk += AlignChunk(image);
+		edge_direction = chunk;
+		chunk += AlignChunk(enlarged);
+		blur_buffer = (float *) chunk;
+		stream_rings = NULL;
+	}
+}
+
+/**
+ * \brief Finds pixel of image that pixel outside of it repeats.
+ *
+ * \param i Index of pixel, may be negative or past the end.
+ * \param count Number of pixels of image row or column.
+ * \param border Border mode.
+ * \return Index of pixel of image, or -1 for constant border.
+ */
+static inline long BorderIndex(long i, long count, CannyBorder border)
+{
+	if (i >= 0 && i < count) {
+		return i;
+	}
+	if (border == CANNY_BORDER_CONSTANT) {
+		return -1;
+	}
+	if (border == CANNY_BORDER_REFLECT && count > 1) {
+		// Mirrored image repeats with period of two widths less two
+		// outermost pixels, which are not repeated.
+		long period = 2 * (count - 1);
+		i = (i < 0 ? -i : i) % period;
+		return i < count ? i : period - i;
+	}
+	return i < 0 ? 0 : count - 1;
+}
+
+const uint8_t *CannyEdgeDetector::GrayImage(size_t &stride) const
+{
+	// Gray image is read straight from source.
+	if (source_format == CANNY_PIXEL_GRAY8) {
+		stride = source_stride;
+		return source_bitmap;
+	}
+	stride = width - 2 * mask_halfsize;
+	return gray_bitmap;
+}
+
+void CannyEdgeDetector::ExtendRow(const uint8_t *row, uint8_t *target,
+                                  unsigned int length) const
+{
+	for (long k = 1; k <= (long) mask_halfsize; k++) {
+		long before = BorderIndex(-k, length, border);
+		long after = BorderIndex(length - 1 + k, length, border);
+		target[-k] = before < 0 ? border_value : row[before];
+		target[length - 1 + k] = after < 0 ? border_value : row[after];
+	}
+}
+
+void CannyEdgeDetector::PreProcessImage()
+{
+	unsigned int image_width = width;
+	unsigned int image_height = height;
+
+	// Enlarging workspace bitmap width and height.
+	height += mask_halfsize * 2;
+	width += mask_halfsize * 2;
+
+	size_t gray_stride;
+	const uint8_t *gray = this->GrayImage(gray_stride);
+
+	// Filling margins of work area, band by band. Margin rows are copies
+	// of image rows (or constant), margin columns extend each row. Inside
+	// margins image is not copied, blur reads it in place.
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			uint8_t *target = workspace_bitmap + x * width + mask_halfsize;
+			long source_row = BorderIndex((long) x - (long) mask_halfsize, image_height, border);
+
+			if (source_row < 0) {
+				memset(target - mask_halfsize, border_value, width);
+			} else if (x < mask_halfsize || x >= height - mask_halfsize) {
+				memcpy(target, gray + source_row * gray_stride, image_width);
+				this->ExtendRow(target, target, image_width);
+			} else {
+				this->ExtendRow(gray + source_row * gray_stride, target, image_width);
+			}
+		}
+	});
+}
+
+void CannyEdgeDetector::CopyImage()
+{
+	unsigned int image_width = width - 2 * mask_halfsize;
+	size_t gray_stride;
+	const uint8_t *gray = this->GrayImage(gray_stride);
+
+	thread_pool.ParallelFor(mask_halfsize, height - mask_halfsize, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			memcpy(workspace_bitmap + x * width + mask_halfsize,
+			       gray + (x - mask_halfsize) * gray_stride, image_width);
+		}
+	});
+}
+
+void CannyEdgeDetector::PostProcessImage()
+{
+	// Decreasing width and height.
+	height -= 2 * mask_halfsize;
+	width -= 2 * mask_halfsize;
+
+	// Shrinking image.
+	thread_pool.ParallelFor(0, height, [this](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			const uint8_t *row = workspace_bitmap + (x + mask_halfsize) * (width + 2 * mask_halfsize) + mask_halfsize;
+			uint8_t *target = mask_bitmap + x * mask_stride;
+
+			if (mask_format == CANNY_MASK_GRAY8) {
+				memcpy(target, row, width);
+			} else if (mask_format == CANNY_MASK_BIT1) {
+				memset(target, 0, (width + 7) / 8);
+				for (unsigned int y = 0; y < width; y++) {
+					target[y / 8] |= (row[y] & 0x80) >> (y % 8);
+				}
+			} else {
+				for (unsigned int y = 0; y < width; y++) {
+					target[3 * y] = target[3 * y + 1] = target[3 * y + 2] = row[y];
+				}
+			}
+		}
+	});
+}
+
+void CannyEdgeDetector::CollectPoints(std::vector<CannyEdgePoint> &points, bool withGradient)
+{
+	// Decreasing width and height, as PostProcessImage() does.
+	height -= 2 * mask_halfsize;
+	width -= 2 * mask_halfsize;
+	unsigned long stride = width + 2 * mask_halfsize;
+
+	// Edge pixels are counted row by row first, so that bands fill their
+	// part of list at once. Worklist of tracing is free by now and holds
+	// first point of each row.
+	unsigned int *first_point = edge_stack;
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			const uint8_t *row = workspace_bitmap + (x + mask_halfsize) * stride + mask_halfsize;
+			unsigned int count = 0;
+			for (unsigned int y = 0; y < width; y++) {
+				count += row[y] == 255;
+			}
+			first_point[x] = count;
+		}
+	});
+
+	unsigned int total = 0;
+	for (unsigned int x = 0; x < height; x++) {
+		unsigned int count = first_point[x];
+		first_point[x] = total;
+		total += count;
+	}
+	points.resize(total);
+
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			unsigned long i = (x + mask_halfsize) * stride + mask_halfsize;
+			unsigned int k = first_point[x];
+			for (unsigned int y = 0; y < width; y++) {
+				if (workspace_bitmap[i + y] == 255) {
+					points[k++] = this->EdgePoint(i + y, withGradient);
+				}
+			}
+		}
+	});
+}
+
+void CannyEdgeDetector::CollectContours(std::vector<CannyEdgePoint> &points,
+                                        std::vector<unsigned int> &contours,
+                                        bool withGradient)
+{
+	// Decreasing width and height, as PostProcessImage() does.
+	height -= 2 * mask_halfsize;
+	width -= 2 * mask_halfsize;
+	unsigned long stride = width + 2 * mask_halfsize;
+
+	points.clear();
+	contours.clear();
+
+	// Contour grows from first pixel found both ways. Pixels found going
+	// backward are kept on worklist of tracing and listed reversed.
+	for (unsigned long x = 0; x < height; x++) {
+		for (unsigned long y = 0; y < width; y++) {
+			unsigned long i = (x + mask_halfsize) * stride + y + mask_halfsize;
+			if (workspace_bitmap[i] != 255) {
+				continue;
+			}
+
+			contours.push_back(points.size());
+			workspace_bitmap[i] = 0;
+
+			unsigned long top = 0;
+			unsigned long j = i;
+			while (this->NextContourPixel(j)) {
+				edge_stack[top++] = j;
+			}
+			while (top > 0) {
+				points.push_back(this->EdgePoint(edge_stack[--top], withGradient));
+			}
+
+			points.push_back(this->EdgePoint(i, withGradient));
+			j = i;
+			while (this->NextContourPixel(j)) {
+				points.push_back(this->EdgePoint(j, withGradient));
+			}
+		}
+	}
+
+	contours.push_back(points.size());
+}
+
+bool CannyEdgeDetector::NextContourPixel(unsigned long &i)
+{
+	// Side neighbours first, then diagonal ones.
+	static const int row_offsets[8] = {0, 1, 0, -1, 1, 1, -1, -1};
+	static const int column_offsets[8] = {1, 0, -1, 0, 1, -1, -1, 1};
+
+	unsigned long stride = width + 2 * mask_halfsize;
+	long x = i / stride - mask_halfsize;
+	long y = i % stride - mask_halfsize;
+
+	for (int k = 0; k < 8; k++) {
+		long x1 = x + row_offsets[k];
+		long y1 = y + column_offsets[k];
+		// Edges in margins are not part of image.
+		if (x1 < 0 || y1 < 0 || x1 >= (long) height || y1 >= (long) width) {
+			continue;
+		}
+
+		unsigned long j = (x1 + mask_halfsize) * stride + y1 + mask_halfsize;
+		if (workspace_bitmap[j] == 255) {
+			workspace_bitmap[j] = 0;
+			i = j;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+CannyEdgePoint CannyEdgeDetector::EdgePoint(unsigned long i, bool withGradient) const
+{
+	unsigned long stride = width + 2 * mask_halfsize;
+	CannyEdgePoint point;
+
+	point.column = i % stride - mask_halfsize;
+	point.row = i / stride - mask_halfsize;
+	point.magnitude = 0.0f;
+	point.direction = 0;
+	if (withGradient) {
+		// Scaled the same way as suppressed pixels, but not truncated.
+		float magnitude = edge_magnitude[i];
+		if (gradient == CANNY_GRADIENT_SQUARED) {
+			magnitude = sqrtf(magnitude);
+		}
+		point.magnitude = 255.0f * magnitude / edge_max;
+		point.direction = edge_direction[i];
+	}
+
+	return point;
+}
+
+void CannyEdgeDetector::WriteRegion(const CannyRegion &region, const uint8_t *pixels,
+                                    size_t stride, const CannyMaskView &mask,
+                                    unsigned int mask_width, unsigned int mask_row,
+                                    unsigned int mask_column)
+{
+	// Bits of 1-bit mask are written one by one, as region may start and
+	// end in the middle of byte. Last byte of row is filled up with zeros
+	// if region reaches end of row.
+	unsigned long bits = region.width;
+	if (mask_column + region.width == mask_width) {
+		bits = (mask_column + region.width + 7) / 8 * 8 - mask_column;
+	}
+
+	thread_pool.ParallelFor(0, region.height, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			const uint8_t *row = pixels + x * stride;
+			uint8_t *target = mask.data + (mask_row + x) * mask.stride;
+
+			if (mask.format == CANNY_MASK_GRAY8) {
+				memcpy(target + mask_column, row, region.width);
+			} else if (mask.format == CANNY_MASK_BIT1) {
+				for (unsigned long y = 0; y < bits; y++) {
+					unsigned long bit = mask_column + y;
+					uint8_t value = y < region.width ? row[y] & 0x80 : 0;
+					target[bit / 8] = (target[bit / 8] & ~(0x80 >> (bit % 8))) | (value >> (bit % 8));
+				}
+			} else {
+				target += 3 * mask_column;
+				for (unsigned int y = 0; y < region.width; y++) {
+					target[3 * y] = target[3 * y + 1] = target[3 * y + 2] = row[y];
+				}
+			}
+		}
+	});
+}
+
+void CannyEdgeDetector::Luminance()
+{
+	// Source rows hold pixels of `source_format`, gray rows have one byte
+	// per pixel.
+	thread_pool.ParallelFor(0, height, [this](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			if (fixed_point) {
+				kernels->luminance_fixed[source_format](source_bitmap + x * source_stride,
+				                                        gray_bitmap + x * width, width);
+			} else {
+				kernels->luminance[source_format](source_bitmap + x * source_stride,
+				                                  gray_bitmap + x * width, width);
+			}
+		}
+	});
+}
+
+/**
+ * \brief Rounds normalized kernel to integer weights summing up to `one`.
+ *
+ * Weights are rounded down, then units missing from the sum are given to
+ * weights with largest remainders, symmetric pairs first. This keeps kernel
+ * symmetric, preserves brightness exactly and minimizes rounding error.
+ */
+static void QuantizeKernel(const float *kernel, unsigned int size,
+                           unsigned int one, uint16_t *fixed)
+{
+	unsigned int halfsize = size / 2;
+	long missing = one;
+
+	for (unsigned int i = 0; i < size; i++) {
+		fixed[i] = (uint16_t) (kernel[i] * one);
+		missing -= fixed[i];
+	}
+
+	// Distributing what is left, one unit at a time. Kernel is tiny, so
+	// plain search for largest remainder is fast enough.
+	while (missing > 0) {
+		unsigned int best = halfsize;
+		float best_remainder = -1.0f;
+
+		for (unsigned int i = 0; i <= halfsize; i++) {
+			float remainder = kernel[i] * one - fixed[i];
+			// Pair needs two units, central weight only one.
+			if ((i < halfsize && missing >= 2 && remainder > best_remainder) ||
+			    (i == halfsize && remainder > best_remainder)) {
+				best = i;
+				best_remainder = remainder;
+			}
+		}
+		fixed[best]++;
+		missing--;
+		if (best != halfsize) {
+			fixed[size - 1 - best]++;
+			missing--;
+		}
+	}
+}
+
+/**
+ * \brief Gauss kernel of one sigma, shared by all detectors.
+ */
+struct CannyGaussianKernel
+{
+	/**
+	 * \var Normalized weights.
+	 */
+	std::vector<float> weights;
+
+	/**
+	 * \var Quantized weights, 8 fractional bits followed by 15 fractional
+	 * bits.
+	 */
+	std::vector<uint16_t> fixed;
+
+	/**
+	 * \var Recursive filter of the same variance as `weights`.
+	 */
+	CannyRecursiveFilter recursive;
+};
+
+/**
+ * \brief Computes coefficients of recursive filter approximating Gauss
+ * function with given standard deviation.
+ *
+ * Coefficients come from I. T. Young, L. J. van Vliet, "Recursive
+ * implementation of the Gaussian filter", Signal Processing 44 (1995),
+ * boundary matrix from B. Triggs, M. Sdika, "Boundary conditions for
+ * Young-van Vliet recursive filtering", IEEE Trans. Signal Processing 54
+ * (2006). Matrix is found numerically, by running both passes over
+ * deviations of border state decaying to zero.
+ */
+static void BuildRecursiveFilter(double sigma, CannyRecursiveFilter *filter)
+{
+	// Formulas hold from sigma 0.5 on. Smaller sigmas are never filtered
+	// recursively, their margin is too narrow.
+	sigma = sigma < 0.5 ? 0.5 : sigma;
+
+	double q;
+	if (sigma >= 2.5) {
+		q = 0.98711 * sigma - 0.96330;
+	} else {
+		q = 3.97156 - 4.14554 * sqrt(1.0 - 0.26891 * sigma);
+	}
+
+	double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+	double a[3];
+	a[0] = (2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q) / b0;
+	a[1] = -(1.4281 * q * q + 1.26661 * q * q * q) / b0;
+	a[2] = 0.422205 * q * q * q / b0;
+
+	filter->b = (float) (1.0 - a[0] - a[1] - a[2]);
+	for (int k = 0; k < 3; k++) {
+		filter->a[k] = (float) a[k];
+	}
+
+	// Poles lie within about 1 - 1 / q of origin, this is long enough for
+	// responses to vanish.
+	size_t length = (size_t) (40.0 * q) + 100;
+	std::vector<double> forward(length + 3), backward(length + 6);
+	for (int j = 0; j < 3; j++) {
+		// Values 0, 1, 2 are w[N - 3], w[N - 2], w[N - 1], then follow
+		// values past the end, where input equals last value.
+		std::fill(forward.begin(), forward.end(), 0.0);
+		std::fill(backward.begin(), backward.end(), 0.0);
+		forward[2 - j] = 1.0;
+		for (size_t n = 3; n < length + 3; n++) {
+			forward[n] = a[0] * forward[n - 1] + a[1] * forward[n - 2] + a[2] * forward[n - 3];
+		}
+		for (size_t n = length + 3; n-- > 3;) {
+			backward[n] = (1.0 - a[0] - a[1] - a[2]) * forward[n] + a[0] * backward[n + 1] +
+			              a[1] * backward[n + 2] + a[2] * backward[n + 3];
+		}
+		for (int k = 0; k < 3; k++) {
+			filter->m[3 * k + j] = (float) backward[3 + k];
+		}
+	}
+}
+
+/**
+ * \brief Returns kernel for given sigma, building it on first use.
+ *
+ * Kernels are kept for the whole life of the process and never change, so
+ * returned pointer stays valid and can be read without locking. Programs
+ * use few distinct sigmas, so the cache stays tiny.
+ */
+static const CannyGaussianKernel *FindGaussianKernel(float sigma, unsigned int mask_size)
+{
+	static std::mutex cache_mutex;
+	static std::map<float, CannyGaussianKernel> cache;
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	std::map<float, CannyGaussianKernel>::iterator found = cache.find(sigma);
+	if (found != cache.end()) {
+		return &found->second;
+	}
+
+	CannyGaussianKernel &kernel = cache[sigma];
+	kernel.weights.resize(mask_size);
+	kernel.fixed.resize(2 * mask_size);
+
+	long signed_mask_halfsize = mask_size / 2;
+	float kernel_sum = 0.0f;
+	for (long i = -signed_mask_halfsize; i <= signed_mask_halfsize; i++) {
+		kernel.weights[i + signed_mask_halfsize] = exp(-(i * i) / (2 * sigma * sigma));
+		kernel_sum += kernel.weights[i + signed_mask_halfsize];
+	}
+	// Normalization, so blur does not change overall image brightness.
+	for (unsigned int i = 0; i < mask_size; i++) {
+		kernel.weights[i] /= kernel_sum;
+	}
+
+	QuantizeKernel(kernel.weights.data(), mask_size, 1 << 8, kernel.fixed.data());
+	QuantizeKernel(kernel.weights.data(), mask_size, 1 << 15, kernel.fixed.data() + mask_size);
+
+	double variance = 0.0;
+	for (long i = -signed_mask_halfsize; i <= signed_mask_halfsize; i++) {
+		variance += (double) (i * i) * kernel.weights[i + signed_mask_halfsize];
+	}
+	BuildRecursiveFilter(sqrt(variance), &kernel.recursive);
+
+	return &kernel;
+}
+
+void CannyEdgeDetector::BuildGaussianKernel(float sigma)
+{
+	// Gauss function is separable, so one-dimensional kernel is enough. It
+	// is looked up only when sigma changes; exp() runs once per sigma in
+	// the whole process. Mask size was already calculated in
+	// AllocateBuffers.
+	if (gaussian_sigma != sigma || gaussian_kernel_size != mask_size) {
+		const CannyGaussianKernel *kernel = FindGaussianKernel(sigma, mask_size);
+		gaussian_kernel = kernel->weights.data();
+		gaussian_kernel_fixed = kernel->fixed.data();
+		recursive_filter = &kernel->recursive;
+		gaussian_kernel_size = mask_size;
+		gaussian_sigma = sigma;
+	}
+}
+
+void CannyEdgeDetector::BlurRow(const uint8_t *row, unsigned long x)
+{
+	unsigned int length = width - 2 * mask_halfsize;
+	unsigned long i = x * width + mask_halfsize;
+	uint8_t *padded = workspace_bitmap + i;
+
+	auto blur = [&](const uint8_t *source, unsigned long offset, size_t count) {
+		if (fixed_point) {
+			kernels->blur_horizontal_fixed(source, (uint16_t *) blur_buffer + i + offset, count,
+			                               gaussian_kernel_fixed, mask_halfsize);
+		} else {
+			kernels->blur_horizontal(source, blur_buffer + i + offset, count,
+			                         gaussian_kernel, mask_halfsize);
+		}
+	};
+
+	// Mask reaches `mask_halfsize` pixels past both ends of row only for
+	// first and last `mask_halfsize` pixels. These are blurred next to
+	// margins, the rest of row in place.
+	unsigned int edge = 2 * mask_halfsize;
+	if (length > 2 * edge) {
+		memcpy(padded, row, edge);
+		memcpy(padded + length - edge, row + length - edge, edge);
+		blur(padded, 0, mask_halfsize);
+		blur(row + mask_halfsize, mask_halfsize, length - edge);
+		blur(padded + length - mask_halfsize, length - mask_halfsize, mask_halfsize);
+	} else {
+		memcpy(padded, row, length);
+		blur(padded, 0, length);
+	}
+}
+
+void CannyEdgeDetector::GaussianBlur()
+{
+	unsigned int row_length = width - 2 * mask_halfsize;
+
+	// In fixed-point mode horizontal pass gives 16-bit sums, stored in
+	// (first half of) the same buffer.
+	uint16_t *blur_buffer_fixed = (uint16_t *) blur_buffer;
+	const uint16_t *horizontal_fixed = gaussian_kernel_fixed;
+	const uint16_t *vertical_fixed = gaussian_kernel_fixed + mask_size;
+
+	size_t gray_stride;
+	const uint8_t *gray = this->GrayImage(gray_stride);
+
+	// Horizontal pass. Margin rows are needed by vertical pass as well,
+	// they are whole in work area. Image rows are read in place.
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			if (x >= mask_halfsize && x < height - mask_halfsize) {
+				this->BlurRow(gray + (x - mask_halfsize) * gray_stride, x);
+				continue;
+			}
+
+			unsigned long i = x * width + mask_halfsize;
+			if (fixed_point) {
+				kernels->blur_horizontal_fixed(workspace_bitmap + i, blur_buffer_fixed + i,
+				                               row_length, horizontal_fixed, mask_halfsize);
+			} else {
+				kernels->blur_horizontal(workspace_bitmap + i, blur_buffer + i,
+				                         row_length, gaussian_kernel, mask_halfsize);
+			}
+		}
+	});
+
+	// Vertical pass. Each band reads `mask_halfsize` halo rows of its
+	// neighbours, which are complete after the horizontal pass returns.
+	thread_pool.ParallelFor(mask_halfsize, height - mask_halfsize, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			unsigned long i = x * width + mask_halfsize;
+			if (fixed_point) {
+				kernels->blur_vertical_fixed(blur_buffer_fixed + i, width, workspace_bitmap + i,
+				                             row_length, vertical_fixed, mask_halfsize);
+			} else {
+				kernels->blur_vertical(blur_buffer + i, width, workspace_bitmap + i,
+				                       row_length, gaussian_kernel, mask_halfsize);
+			}
+		}
+	});
+}
+
+CannySobelKernel CannyEdgeDetector::SobelKernel() const
+{
+	switch (gradient) {
+		case CANNY_GRADIENT_SQUARED:
+			return kernels->sobel_squared;
+		case CANNY_GRADIENT_L1:
+			return kernels->sobel_l1;
+		default:
+			return kernels->sobel;
+	}
+}
+
+void CannyEdgeDetector::BlurImage()
+{
+	if (this->UsesRecursiveBlur()) {
+		this->RecursiveBlur();
+	} else {
+		this->GaussianBlur();
+	}
+}
+
+bool CannyEdgeDetector::UsesRecursiveBlur() const
+{
+	// Recursive filter keeps its states in margin.
+	return recursive_sigma > 0.0f && gaussian_sigma >= recursive_sigma && mask_halfsize >= 3;
+}
+
+/**
+ * \brief Filters signals running across rows with recursive Gauss filter,
+ * in place.
+ *
+ * Three rows before and three rows after the signals are overwritten, they
+ * hold states of filter at both ends.
+ *
+ * \param kernels Row kernels.
+ * \param filter Filter coefficients.
+ * \param data First row.
+ * \param stride Distance between rows, in elements.
+ * \param length Number of rows, that is of values of each signal.
+ * \param count Number of signals, that is of values in each row.
+ * \param destination If not NULL, rows of rounded outputs.
+ * \param destination_stride Distance between rows of `destination`.
+ */
+static void FilterRecursive(const CannyKernels *kernels, const CannyRecursiveFilter *filter,
+                            float *data, size_t stride, size_t length, size_t count,
+                            uint8_t *destination, size_t destination_stride)
+{
+	float *last = data + (length - 1) * stride;
+	float *after = data + length * stride;
+	const float *m = filter->m;
+
+	// Forward pass starts in steady state of first value. Last value waits
+	// for backward pass in third row after signals.
+	for (size_t k = 1; k <= 3; k++) {
+		memcpy(data - k * stride, data, count * sizeof(float));
+	}
+	memcpy(after + 2 * stride, last, count * sizeof(float));
+	for (size_t n = 0; n < length; n++) {
+		kernels->blur_recursive(data + n * stride, -(ptrdiff_t) stride, NULL, count, filter);
+	}
+
+	// Backward pass starts in state of Triggs and Sdika.
+	for (size_t j = 0; j < count; j++) {
+		float value = after[2 * stride + j];
+		float d1 = last[j] - value;
+		float d2 = last[j - stride] - value;
+		float d3 = last[j - 2 * stride] - value;
+		after[j] = value + (m[0] * d1 + m[1] * d2 + m[2] * d3);
+		after[stride + j] = value + (m[3] * d1 + m[4] * d2 + m[5] * d3);
+		after[2 * stride + j] = value + (m[6] * d1 + m[7] * d2 + m[8] * d3);
+	}
+	for (size_t n = length; n-- > 0;) {
+		kernels->blur_recursive(data + n * stride, stride,
+		                        destination != NULL ? destination + n * destination_stride : NULL,
+		                        count, filter);
+	}
+}
+
+void CannyEdgeDetector::RecursiveBlur()
+{
+	unsigned int row_length = width - 2 * mask_halfsize;
+	unsigned int rows = height - 2 * mask_halfsize;
+	unsigned long origin = (unsigned long) mask_halfsize * width + mask_halfsize;
+	size_t gray_stride;
+	const uint8_t *gray = this->GrayImage(gray_stride);
+
+	// Horizontal pass, straight from gray image. Strip of rows is
+	// transposed, so that rows lie side by side. With three state rows on
+	// both ends it takes less than `strip` rows of workspace, as margin is
+	// at least three pixels wide.
+	const unsigned int strip = 16;
+	thread_pool.ParallelFor(0, (rows + strip - 1) / strip, [&](unsigned long first, unsigned long last) {
+		for (unsigned long j = first; j < last; j++) {
+			unsigned int count = std::min(strip, rows - (unsigned int) j * strip);
+			unsigned long i = origin + j * strip * width;
+			float *transposed = edge_magnitude + (i - mask_halfsize) + 3 * count;
+
+			kernels->transpose_gray(gray + j * strip * gray_stride, gray_stride, transposed, count,
+			                        row_length);
+			FilterRecursive(kernels, recursive_filter, transposed, count, row_length, count,
+			                NULL, 0);
+			kernels->transpose_float(transposed, blur_buffer + i, width, count, row_length);
+		}
+	});
+
+	// Vertical pass, each thread takes range of columns. State rows lie in
+	// margin. Last step rounds pixels into workspace.
+	thread_pool.ParallelFor(0, row_length, [&](unsigned long first, unsigned long last) {
+		FilterRecursive(kernels, recursive_filter, blur_buffer + origin + first, width,
+		                rows, last - first, workspace_bitmap + origin + first, width);
+	});
+}
+
+void CannyEdgeDetector::EdgeDetection()
+{
+	CannySobelKernel sobel = this->SobelKernel();
+	float max = 0.0f;
+	std::mutex max_mutex;
+
+	// Sobel mask does not fit on outermost pixels, they get no gradient.
+	memset(edge_magnitude, 0, (size_t) width * height * sizeof(float));
+	memset(edge_direction, 0, (size_t) width * height);
+
+	// Convolution with Sobel masks, centered on (x, y). Bands read one halo
+	// row above and below.
+	if (width > 2 && height > 2) {
+		thread_pool.ParallelFor(1, height - 1, [&](unsigned long first, unsigned long last) {
+			float band_max = 0.0f;
+			float row_max;
+
+			for (unsigned long x = first; x < last; x++) {
+				row_max = sobel(workspace_bitmap + x * width + 1,
+				                width, edge_magnitude + x * width + 1,
+				                edge_direction + x * width + 1, width - 2);
+				band_max = row_max > band_max ? row_max : band_max;
+			}
+
+			// Maximum magnitude. Order of bands does not matter for maximum.
+			std::lock_guard<std::mutex> lock(max_mutex);
+			max = band_max > max ? band_max : max;
+		});
+	}
+
+	// Flat image has no edges at all.
+	edge_max = max > 0.0f ? max : 1.0f;
+	if (gradient == CANNY_GRADIENT_SQUARED) {
+		edge_max = sqrtf(edge_max);
+	}
+}
+
+/**
+ * \brief Scales gradient magnitude to range of 0-255.
+ *
+ * Squared magnitude is turned into Euclidean one first. This is done only
+ * for local maxima, suppressed pixels are 0 and skip square root.
+ */
+static inline uint8_t QuantizeMagnitude(float magnitude, float max, bool squared)
+{
+	if (squared && magnitude > 0.0f) {
+		magnitude = sqrtf(magnitude);
+	}
+	return (uint8_t) (255.0f * magnitude / max);
 }
 
-CannyEdgeDetector::~CannyEdgeDetector()
+/**
+ * \brief Suppresses non maximum pixels of one row.
+ *
+ * Calls `output(y, value)` for every pixel but first and last one, with
+ * magnitude of local maxima (along gradient direction) and 0 for the rest.
+ */
+template <typename Output>
+static inline void SuppressRow(const float *above, const float *row,
+                               const float *below, const uint8_t *direction,
+                               unsigned int width, const Output &output)
 {
-	delete[] edge_magnitude;
-	delete[] edge_direction;
-	delete[] workspace_bitmap;
+	float pixel_1 = 0;
+	float pixel_2 = 0;
+	float pixel;
+
+	for (unsigned int y = 1; y < width - 1; y++) {
+		if (direction[y] == CANNY_DIRECTION_0) {
+			pixel_1 = below[y];
+			pixel_2 = above[y];
+		} else if (direction[y] == CANNY_DIRECTION_45) {
+			pixel_1 = below[y - 1];
+			pixel_2 = above[y + 1];
+		} else if (direction[y] == CANNY_DIRECTION_90) {
+			pixel_1 = row[y - 1];
+			pixel_2 = row[y + 1];
+		} else if (direction[y] == CANNY_DIRECTION_135) {
+			pixel_1 = below[y + 1];
+			pixel_2 = above[y - 1];
+		}
+		pixel = row[y];
+		if ((pixel >= pixel_1) && (pixel >= pixel_2)) {
+			output(y, pixel);
+		} else {
+			output(y, 0.0f);
+		}
+	}
 }
 
-uint8_t* CannyEdgeDetector::ProcessImage(uint8_t* source_bitmap, unsigned int width,
-                                         unsigned int height, float sigma,
-                                         uint8_t lowThreshold, uint8_t highThreshold)
+void CannyEdgeDetector::NonMaxSuppression()
 {
-	/*
-	 * Setting up image width and height in pixels.
-	 */
-	this->width = width;
-	this->height = height;
+	// Magnitudes are compared before scaling them to 0-255 range. Scaling
+	// does not change their order, and streaming mode, which does not know
+	// maximum magnitude yet at this point, gets the same result.
+	bool squared = gradient == CANNY_GRADIENT_SQUARED;
 
-	/*
-	 * We store image in array of bytes (chars) in BGR(BGRBGRBGR...) order.
-	 * Size of the table is width * height * 3 bytes.
-	 */
-	this->source_bitmap = source_bitmap;
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		for (unsigned int x = first; x < last; x++) {
+			// Outermost pixels have no gradient.
+			if (x == 0 || x == height - 1) {
+				memset(workspace_bitmap + (unsigned long) x * width, 0, width);
+				continue;
+			}
+			SetPixelValue(x, 0, 0);
+			SetPixelValue(x, width - 1, 0);
 
-	/*
-	 * Conversion to grayscale. Only luminance information remains.
-	 */
-	this->Luminance();
+			// Magnitude is only read here, so bands need nothing but one
+			// halo row above and below.
+			const float *row = edge_magnitude + (unsigned long) x * width;
+			SuppressRow(row - width, row, row + width,
+			            edge_direction + (unsigned long) x * width, width,
+			            [&](unsigned int y, float value) {
+				SetPixelValue(x, y, QuantizeMagnitude(value, edge_max, squared));
+			});
+		}
+	});
+}
 
-	/*
-	 * "Widening" image. At this step we already need to know the size of
-	 * gaussian mask.
-	 */
-	this->PreProcessImage(sigma);
+void CannyEdgeDetector::SuppressRect(unsigned long first_row, unsigned long last_row,
+                                     unsigned long first_column, unsigned long last_column)
+{
+	bool squared = gradient == CANNY_GRADIENT_SQUARED;
 
-	/*
-	 * Noise reduction - Gaussian filter.
-	 */
-	this->GaussianBlur(sigma);
+	// Row given to SuppressRow() starts one pixel to the left, as its
+	// first and last pixels are never suppressed.
+	for (unsigned long x = first_row; x < last_row; x++) {
+		unsigned long i = x * width + first_column - 1;
+		const float *row = edge_magnitude + i;
+		SuppressRow(row - width, row, row + width, edge_direction + i,
+		            last_column - first_column + 2, [&](unsigned int y, float value) {
+			workspace_bitmap[i + y] = QuantizeMagnitude(value, edge_max, squared);
+		});
+	}
+}
 
-	/*
-	 * Edge detection - Sobel filter.
-	 */
-	this->EdgeDetection();
+/**
+ * \brief Steps of TaskImage(), each run on every strip.
+ *
+ * Task of step `s` on strip `k` has number `s * strips + k`. Single task
+ * finding maximum magnitude follows them.
+ */
+enum CannyTaskStep
+{
+	CANNY_TASK_ROWS,     ///< Luminance, widening, horizontal pass of blur.
+	CANNY_TASK_COLUMNS,  ///< Vertical pass of blur.
+	CANNY_TASK_SOBEL,    ///< Sobel masks, maximum magnitude of strip.
+	CANNY_TASK_SUPPRESS, ///< Suppression of non maximum pixels.
+	CANNY_TASK_STEPS     ///< Number of steps.
+};
 
-	/*
-	 * Suppression of non maximum pixels.
-	 */
-	this->NonMaxSuppression();
+void CannyEdgeDetector::TaskImage()
+{
+	// Strips are tall enough for vertical pass of blur to read no more than
+	// one strip above and below.
+	unsigned int strip_rows = mask_halfsize > 32 ? mask_halfsize : 32;
 
-	/*
-	 * Hysteresis thresholding.
-	 */
-	this->Hysteresis(lowThreshold, highThreshold);
+	// Enlarging workspace bitmap width and height, as PreProcessImage()
+	// does.
+	height += mask_halfsize * 2;
+	width += mask_halfsize * 2;
 
-	/*
-	 * "Shrinking" image.
-	 */
-	this->PostProcessImage();
+	unsigned int strips = (height + strip_rows - 1) / strip_rows;
+	if (strips != task_strips || strip_rows != task_strip_rows ||
+	    mask_halfsize != task_halfsize) {
+		this->BuildTaskGraph(strips, strip_rows, mask_halfsize);
+	}
+	strip_max.assign(strips, 0.0f);
 
-	return source_bitmap;
+	task_graph.Run(thread_pool, [this](unsigned int task) {
+		this->RunTask(task);
+	});
 }
 
-inline uint8_t CannyEdgeDetector::GetPixelValue(unsigned int x, unsigned int y)
+void CannyEdgeDetector::BuildTaskGraph(unsigned int strips, unsigned int strip_rows,
+                                       unsigned int halfsize)
 {
-	return (uint8_t) *(workspace_bitmap + (unsigned long) (x * width + y));
-}
+	task_graph.Clear();
+	for (unsigned int i = 0; i < CANNY_TASK_STEPS * strips + 1; i++) {
+		task_graph.AddTask();
+	}
 
-inline void CannyEdgeDetector::SetPixelValue(unsigned int x, unsigned int y,
-                                             uint8_t value)
-{
-	workspace_bitmap[(unsigned long) (x * width + y)] = value;
-}
+	unsigned int max_task = CANNY_TASK_STEPS * strips;
+	for (unsigned int k = 0; k < strips; k++) {
+		unsigned int above = k > 0 ? k - 1 : 0;
+		unsigned int below = k + 1 < strips ? k + 1 : k;
 
-void CannyEdgeDetector::PreProcessImage(float sigma)
-{
-	// Finding mask size with given sigma.
-	mask_size = 2 * round(sqrt(-log(0.3) * 2 * sigma * sigma)) + 1;
-	mask_halfsize = mask_size / 2;
+		// Vertical pass reads `halfsize` rows above and below strip.
+		unsigned long first = (unsigned long) k * strip_rows;
+		unsigned long last = first + strip_rows;
+		unsigned long top = first > halfsize ? (first - halfsize) / strip_rows : 0;
+		unsigned long bottom = (last + halfsize - 1) / strip_rows;
+		bottom = bottom < strips ? bottom : strips - 1;
+		for (unsigned long j = top; j <= bottom; j++) {
+			task_graph.AddDependency(CANNY_TASK_ROWS * strips + j, CANNY_TASK_COLUMNS * strips + k);
+		}
 
-	// Enlarging workspace bitmap width and height.
-	height += mask_halfsize * 2;
-	width += mask_halfsize * 2;
-	// Working area.
-	workspace_bitmap = new uint8_t[height * width];
+		// Sobel reads one row above and below. Suppression reads their
+		// magnitudes and overwrites rows Sobel of neighbours reads.
+		for (unsigned int j = above; j <= below; j++) {
+			task_graph.AddDependency(CANNY_TASK_COLUMNS * strips + j, CANNY_TASK_SOBEL * strips + k);
+			task_graph.AddDependency(CANNY_TASK_SOBEL * strips + j, CANNY_TASK_SUPPRESS * strips + k);
+		}
+
+		// Suppressed magnitudes are scaled with maximum of whole image.
+		// Marking maxima first and scaling them in another pass lets
+		// suppression start earlier, but the extra pass costs more than
+		// threads wait for last strip of Sobel.
+		task_graph.AddDependency(CANNY_TASK_SOBEL * strips + k, max_task);
+		task_graph.AddDependency(max_task, CANNY_TASK_SUPPRESS * strips + k);
+	}
 
-	// Edge information arrays.
-	edge_magnitude = new float[width * height];
-	edge_direction = new uint8_t[width * height];
+	task_strips = strips;
+	task_strip_rows = strip_rows;
+	task_halfsize = halfsize;
+}
 
-	// Zeroing direction array.
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			edge_direction[x * width + y] = 0;
+void CannyEdgeDetector::RunTask(unsigned int task)
+{
+	unsigned int step = task / task_strips;
+	unsigned int strip = task % task_strips;
+	bool squared = gradient == CANNY_GRADIENT_SQUARED;
+
+	// Maximum magnitude, as in EdgeDetection().
+	if (step == CANNY_TASK_STEPS) {
+		float max = 0.0f;
+		for (unsigned int k = 0; k < task_strips; k++) {
+			max = strip_max[k] > max ? strip_max[k] : max;
 		}
+		edge_max = max > 0.0f ? max : 1.0f;
+		if (squared) {
+			edge_max = sqrtf(edge_max);
+		}
+		return;
 	}
 
-	// Copying image data into work area.
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			// Upper left corner.
-			if (x < mask_halfsize &&  y < mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap));
+	unsigned long first = (unsigned long) strip * task_strip_rows;
+	unsigned long last = first + task_strip_rows;
+	last = last < height ? last : height;
+	unsigned int image_width = width - 2 * mask_halfsize;
+	unsigned int image_height = height - 2 * mask_halfsize;
+	uint16_t *blur_buffer_fixed = (uint16_t *) blur_buffer;
+
+	if (step == CANNY_TASK_ROWS) {
+		for (unsigned long x = first; x < last; x++) {
+			uint8_t *target = workspace_bitmap + x * width + mask_halfsize;
+			long source_row = BorderIndex((long) x - (long) mask_halfsize, image_height, border);
+
+			// Image rows are converted into gray image and blurred from
+			// there, only margins of workspace are filled, as in
+			// PreProcessImage() and GaussianBlur().
+			if (x >= mask_halfsize && x < height - mask_halfsize) {
+				const uint8_t *row = source_bitmap + source_row * source_stride;
+				if (source_format != CANNY_PIXEL_GRAY8) {
+					uint8_t *gray = gray_bitmap + source_row * image_width;
+					if (fixed_point) {
+						kernels->luminance_fixed[source_format](row, gray, image_width);
+					} else {
+						kernels->luminance[source_format](row, gray, image_width);
+					}
+					row = gray;
+				}
+				this->ExtendRow(row, target, image_width);
+				this->BlurRow(row, x);
+				continue;
 			}
-			// Bottom left corner.
-			else if (x >= height - mask_halfsize && y < mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap + (height - 2 * mask_halfsize - 1) * 3 * (width - 2 * mask_halfsize)));
+
+			// Margin rows go straight into workspace, as rows of gray
+			// image they repeat may belong to other strips.
+			if (source_row < 0) {
+				memset(target - mask_halfsize, border_value, width);
+			} else {
+				const uint8_t *row = source_bitmap + source_row * source_stride;
+				if (source_format == CANNY_PIXEL_GRAY8) {
+					memcpy(target, row, image_width);
+				} else if (fixed_point) {
+					kernels->luminance_fixed[source_format](row, target, image_width);
+				} else {
+					kernels->luminance[source_format](row, target, image_width);
+				}
+				this->ExtendRow(target, target, image_width);
 			}
-			// Upper right corner.
-			else if (x < mask_halfsize && y >= width - mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap + 3 * (width - 2 * mask_halfsize - 1)));
+
+			unsigned long i = x * width + mask_halfsize;
+			if (fixed_point) {
+				kernels->blur_horizontal_fixed(workspace_bitmap + i, blur_buffer_fixed + i,
+				                               image_width, gaussian_kernel_fixed,
+				                               mask_halfsize);
+			} else {
+				kernels->blur_horizontal(workspace_bitmap + i, blur_buffer + i,
+				                         image_width, gaussian_kernel, mask_halfsize);
 			}
-			// Bottom right corner.
-			else if (x >= height - mask_halfsize && y >= width - mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap +
-					(height - 2 * mask_halfsize - 1) * 3 * (width - 2 * mask_halfsize) + 3 * (width - 2 * mask_halfsize - 1)));
+		}
+	} else if (step == CANNY_TASK_COLUMNS) {
+		unsigned long top = first > mask_halfsize ? first : mask_halfsize;
+		unsigned long bottom = last < height - mask_halfsize ? last : height - mask_halfsize;
+		for (unsigned long x = top; x < bottom; x++) {
+			unsigned long i = x * width + mask_halfsize;
+			if (fixed_point) {
+				kernels->blur_vertical_fixed(blur_buffer_fixed + i, width, workspace_bitmap + i,
+				                             image_width, gaussian_kernel_fixed + mask_size,
+				                             mask_halfsize);
+			} else {
+				kernels->blur_vertical(blur_buffer + i, width, workspace_bitmap + i,
+				                       image_width, gaussian_kernel, mask_halfsize);
 			}
-			// Upper beam.
-			else if (x < mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap + 3 * (y - mask_halfsize)));
+		}
+	} else if (step == CANNY_TASK_SOBEL) {
+		CannySobelKernel sobel = this->SobelKernel();
+		float max = 0.0f;
+		for (unsigned long x = first; x < last; x++) {
+			float *magnitude = edge_magnitude + x * width;
+			uint8_t *direction = edge_direction + x * width;
+
+			// Sobel mask does not fit on outermost pixels.
+			if (x == 0 || x == height - 1 || width <= 2) {
+				memset(magnitude, 0, width * sizeof(float));
+				memset(direction, 0, width);
+				continue;
 			}
-			// Bottom beam.
-			else if (x >= height -  mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap +
-					(height - 2 * mask_halfsize - 1) * 3 * (width - 2 * mask_halfsize) + 3 * (y - mask_halfsize)));
+			magnitude[0] = magnitude[width - 1] = 0.0f;
+			direction[0] = direction[width - 1] = 0;
+
+			float row_max = sobel(workspace_bitmap + x * width + 1, width, magnitude + 1,
+			                      direction + 1, width - 2);
+			max = row_max > max ? row_max : max;
+		}
+		strip_max[strip] = max;
+	} else if (step == CANNY_TASK_SUPPRESS) {
+		for (unsigned long x = first; x < last; x++) {
+			uint8_t *target = workspace_bitmap + x * width;
+			if (x == 0 || x == height - 1) {
+				memset(target, 0, width);
+				continue;
 			}
-			// Left beam.
-			else if (y < mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap +
-					(x - mask_halfsize) * 3 * (width - 2 * mask_halfsize)));
+			target[0] = target[width - 1] = 0;
+
+			const float *row = edge_magnitude + x * width;
+			SuppressRow(row - width, row, row + width, edge_direction + x * width, width,
+			            [&](unsigned int y, float value) {
+				target[y] = QuantizeMagnitude(value, edge_max, squared);
+			});
+		}
+	}
+}
+
+void CannyEdgeDetector::StreamImage()
+{
+	float max = 0.0f;
+	std::mutex max_mutex;
+
+	// Enlarging workspace width and height, as PreProcessImage() would do.
+	height += mask_halfsize * 2;
+	width += mask_halfsize * 2;
+
+	// Bands are numbered, so each one can use its own set of rings.
+	unsigned int bands = stream_bands;
+	if (height > 2) {
+		bands = bands < height - 2 ? bands : height - 2;
+		thread_pool.ParallelFor(0, bands, [&](unsigned long first, unsigned long last) {
+			for (unsigned long band = first; band < last; band++) {
+				float band_max = this->StreamBand(band,
+					1 + (height - 2) * band / bands,
+					1 + (height - 2) * (band + 1) / bands);
+
+				std::lock_guard<std::mutex> lock(max_mutex);
+				max = band_max > max ? band_max : max;
 			}
-			// Right beam.
-			else if (y >= width - mask_halfsize) {
-				SetPixelValue(x, y, *(source_bitmap +
-					(x - mask_halfsize) * 3 * (width - 2 * mask_halfsize) + 3 * (width - 2 * mask_halfsize - 1)));
+		});
+	}
+	edge_max = max > 0.0f ? max : 1.0f;
+	if (gradient == CANNY_GRADIENT_SQUARED) {
+		edge_max = sqrtf(edge_max);
+	}
+
+	// Only now maximum magnitude is known and suppressed magnitudes can be
+	// turned into 0-255 values.
+	bool squared = gradient == CANNY_GRADIENT_SQUARED;
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		for (unsigned long x = first; x < last; x++) {
+			uint8_t *row = workspace_bitmap + x * width;
+			const float *magnitude = edge_magnitude + x * width;
+
+			if (x == 0 || x == height - 1) {
+				memset(row, 0, width);
+				continue;
 			}
-			// The rest of the image.
-			else {
-				SetPixelValue(x, y, *(source_bitmap +
-				              (x - mask_halfsize) * 3 * (width - 2 * mask_halfsize) + 3 * (y - mask_halfsize)));
+			for (unsigned int y = 0; y < width; y++) {
+				row[y] = QuantizeMagnitude(magnitude[y], edge_max, squared);
 			}
 		}
-	}
+	});
 }
 
-void CannyEdgeDetector::PostProcessImage()
+float CannyEdgeDetector::StreamBand(unsigned int band, unsigned int first,
+                                    unsigned int last)
 {
-	// Decreasing width and height.
-	unsigned long i;
-	height -= 2 * mask_halfsize;
-	width -= 2 * mask_halfsize;
+	const unsigned int image_width = width - 2 * mask_halfsize;
+	const unsigned int image_height = height - 2 * mask_halfsize;
+	const unsigned int halfsize = mask_halfsize;
+	const unsigned int rows = mask_size;
+	CannySobelKernel sobel = this->SobelKernel();
 
-	// Shrinking image.
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			i = (unsigned long) (x * 3 * width + 3 * y);
-			*(source_bitmap + i) =
-			*(source_bitmap + i + 1) =
-			*(source_bitmap + i + 2) = workspace_bitmap[(x + mask_halfsize) * (width + 2 * mask_halfsize) + (y + mask_halfsize)];
+	// Rings of this band. Blurred and smoothed rows are stored twice, at
+	// slot and slot + ring size, so any window of consecutive rows is
+	// contiguous in memory and kernels can address it with stride.
+	uint8_t *chunk = stream_rings + band * RingSize(width, mask_size);
+	uint8_t *gray_ring = chunk;
+	chunk += AlignChunk((unsigned long) rows * width);
+	float *blur_ring = (float *) chunk;
+	uint16_t *blur_ring_fixed = (uint16_t *) chunk;
+	chunk += AlignChunk((unsigned long) 2 * rows * width * sizeof(float));
+	uint8_t *smooth_ring = chunk;
+	chunk += AlignChunk((unsigned long) 6 * width);
+	float *magnitude_ring = (float *) chunk;
+	chunk += AlignChunk((unsigned long) 3 * width * sizeof(float));
+	uint8_t *direction_ring = chunk;
+
+	// Next row to be produced at each stage. Band starts early enough to
+	// fill its halo: one row for suppression, one for Sobel and Gauss
+	// margin for blur.
+	long next_gray = (long) first - 2 - halfsize;
+	long next_smooth = (long) first - 2;
+	long next_sobel = (long) first - 1;
+	next_gray = next_gray > 0 ? next_gray : 0;
+	next_smooth = next_smooth > 0 ? next_smooth : 0;
+
+	float band_max = 0.0f;
+
+	for (unsigned int x = first; x < last; x++) {
+		// Suppression of row x needs gradient of rows x - 1 to x + 1.
+		while (next_sobel <= (long) x + 1) {
+			long q = next_sobel++;
+			float *magnitude = magnitude_ring + (q % 3) * width;
+			uint8_t *direction = direction_ring + (q % 3) * width;
+
+			memset(magnitude, 0, width * sizeof(float));
+			memset(direction, 0, width);
+			if (q == 0 || q == (long) height - 1 || width < 3) {
+				continue;
+			}
+
+			// Sobel needs smoothed rows q - 1 to q + 1.
+			while (next_smooth <= q + 1) {
+				long s = next_smooth++;
+				bool blurred = s >= (long) halfsize && s < (long) (height - halfsize);
+
+				// Vertical blur needs rows s - halfsize to s + halfsize
+				// blurred horizontally, margins need gray row s.
+				long needed = blurred ? s + halfsize : s;
+				while (next_gray <= needed) {
+					long g = next_gray++;
+					uint8_t *gray = gray_ring + (g % rows) * width;
+					long source_row = BorderIndex(g - (long) halfsize, image_height, border);
+
+					// Gray row with margins, as in PreProcessImage().
+					if (source_row < 0) {
+						memset(gray, border_value, width);
+					} else {
+						const uint8_t *source = source_bitmap + source_row * source_stride;
+						if (fixed_point) {
+							kernels->luminance_fixed[source_format](source, gray + halfsize, image_width);
+						} else {
+							kernels->luminance[source_format](source, gray + halfsize, image_width);
+						}
+						this->ExtendRow(gray + halfsize, gray + halfsize, image_width);
+					}
+
+					if (fixed_point) {
+						uint16_t *blur = blur_ring_fixed + (g % rows) * width;
+						kernels->blur_horizontal_fixed(gray + halfsize, blur + halfsize, image_width,
+						                               gaussian_kernel_fixed, halfsize);
+						memcpy(blur + rows * width + halfsize, blur + halfsize,
+						       image_width * sizeof(uint16_t));
+					} else {
+						float *blur = blur_ring + (g % rows) * width;
+						kernels->blur_horizontal(gray + halfsize, blur + halfsize,
+						                         image_width, gaussian_kernel, halfsize);
+						memcpy(blur + rows * width + halfsize, blur + halfsize,
+						       image_width * sizeof(float));
+					}
+				}
+
+				uint8_t *smooth = smooth_ring + (s % 3) * width;
+				const uint8_t *gray = gray_ring + (s % rows) * width;
+				if (blurred) {
+					unsigned long center = ((s - halfsize) % rows + halfsize) * width + halfsize;
+					memcpy(smooth, gray, halfsize);
+					memcpy(smooth + width - halfsize, gray + width - halfsize, halfsize);
+					if (fixed_point) {
+						kernels->blur_vertical_fixed(blur_ring_fixed + center, width, smooth + halfsize,
+						                             image_width, gaussian_kernel_fixed + rows, halfsize);
+					} else {
+						kernels->blur_vertical(blur_ring + center, width, smooth + halfsize,
+						                       image_width, gaussian_kernel, halfsize);
+					}
+				} else {
+					memcpy(smooth, gray, width);
+				}
+				memcpy(smooth + 3 * width, smooth, width);
+			}
+
+			const uint8_t *smooth = smooth_ring + ((q - 1) % 3 + 1) * width;
+			float row_max = sobel(smooth + 1, width, magnitude + 1,
+			                      direction + 1, width - 2);
+			band_max = row_max > band_max ? row_max : band_max;
+		}
+
+		// Only suppressed magnitudes are kept at full size.
+		float *destination = edge_magnitude + (unsigned long) x * width;
+		destination[0] = destination[width - 1] = 0.0f;
+		if (width > 2) {
+			SuppressRow(magnitude_ring + ((x + 2) % 3) * width,
+			            magnitude_ring + (x % 3) * width,
+			            magnitude_ring + ((x + 1) % 3) * width,
+			            direction_ring + (x % 3) * width, width,
+			            [&](unsigned int y, float value) {
+				destination[y] = value;
+			});
 		}
 	}
+
+	return band_max;
 }
 
-void CannyEdgeDetector::Luminance()
+/**
+ * \brief Finds root of pixel in union-find forest, halving path on the way.
+ *
+ * Only for pixels no other thread joins at the same time.
+ */
+static inline unsigned int FindRoot(unsigned int *parent, unsigned int i)
 {
-	unsigned long i;
-	float gray_value, blue_value, green_value, red_value;
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
 
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
+/**
+ * \brief Joins components of two pixels, later root under earlier one.
+ *
+ * Only for pixels no other thread joins at the same time.
+ */
+static inline void JoinRoots(unsigned int *parent, unsigned int a, unsigned int b)
+{
+	a = FindRoot(parent, a);
+	b = FindRoot(parent, b);
+	if (a != b) {
+		parent[a > b ? a : b] = a > b ? b : a;
+	}
+}
 
-			// Current "B" pixel position in bitmap table (calculated with x and y values).
-			i = (unsigned long) (x * 3 * width + 3 * y);
+/**
+ * \brief Joins component of neighbour with root of new pixel.
+ *
+ * Only for pixels no other thread joins at the same time.
+ *
+ * \param root Root found for new pixel so far, the pixel itself if none.
+ * \param pixel New pixel, not in forest yet.
+ * \param neighbour Neighbour of new pixel.
+ * \return Root of joined component.
+ */
+static inline unsigned int JoinRoot(unsigned int *parent, unsigned int root,
+                                    unsigned int pixel, unsigned int neighbour)
+{
+	neighbour = FindRoot(parent, neighbour);
+	if (root == pixel || root == neighbour) {
+		return neighbour;
+	}
+	if (root > neighbour) {
+		parent[root] = neighbour;
+		return neighbour;
+	}
+	parent[neighbour] = root;
+	return root;
+}
 
-			// The order of bytes is BGR.
-			blue_value  = *(source_bitmap + i);
-			green_value = *(source_bitmap + i + 1);
-			red_value   = *(source_bitmap + i + 2);
+/**
+ * \brief Finds root of pixel while other threads may join components.
+ */
+static inline unsigned int FindRootShared(unsigned int *parent, unsigned int i)
+{
+	unsigned int next;
+	while ((next = __atomic_load_n(&parent[i], __ATOMIC_ACQUIRE)) != i) {
+		i = next;
+	}
+	return i;
+}
 
-			// Standard equation from RGB to grayscale.
-			gray_value = (uint8_t) (0.299 * red_value + 0.587 * green_value + 0.114 * blue_value);
+/**
+ * \brief Finds root of pixel once no thread joins components any more.
+ */
+static inline unsigned int FindRootJoined(const unsigned int *parent, unsigned int i)
+{
+	while (parent[i] != i) {
+		i = parent[i];
+	}
+	return i;
+}
 
-			// Ultimately making picture grayscale.
-			*(source_bitmap + i) =
-				*(source_bitmap + i + 1) =
-				*(source_bitmap + i + 2) = gray_value;
+/**
+ * \brief Joins components of two pixels while other threads may join
+ * components too.
+ *
+ * Later root is linked under earlier one only if it is still a root, else
+ * roots are looked up again. Roots only ever move towards start of image,
+ * so threads cannot link roots into a cycle.
+ */
+static inline void JoinRootsShared(unsigned int *parent, unsigned int a, unsigned int b)
+{
+	for (;;) {
+		a = FindRootShared(parent, a);
+		b = FindRootShared(parent, b);
+		if (a == b) {
+			return;
+		}
+		if (a < b) {
+			unsigned int swap = a;
+			a = b;
+			b = swap;
+		}
+		unsigned int expected = a;
+		if (__atomic_compare_exchange_n(&parent[a], &expected, b, false,
+		                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return;
 		}
 	}
 }
 
-void CannyEdgeDetector::GaussianBlur(float sigma)
+template <typename Candidate, typename Strong>
+unsigned int CannyEdgeDetector::JoinComponents(unsigned long first_row, unsigned long last_row,
+                                               unsigned int first_column, unsigned int last_column,
+                                               bool diagonal, const Candidate &candidate,
+                                               const Strong &strong)
 {
-	// We already calculated mask size in PreProcessImage.
-	long signed_mask_halfsize;
-	signed_mask_halfsize = this->mask_halfsize;
+	unsigned int *parent = edge_stack;
+	unsigned int bands = thread_pool.GetThreadCount();
+	band_seeds.assign(bands, UINT_MAX);
+
+	// Each band joins its own pixels with neighbours before them, so rows
+	// are split explicitly and borders are known to the second pass.
+	thread_pool.ParallelFor(0, bands, [&](unsigned long first_band, unsigned long last_band) {
+		for (unsigned long band = first_band; band < last_band; band++) {
+			unsigned long first = first_row + (last_row - first_row) * band / bands;
+			unsigned long last = first_row + (last_row - first_row) * (band + 1) / bands;
+			unsigned int seed = UINT_MAX;
+
+			for (unsigned long x = first; x < last; x++) {
+				for (unsigned int y = first_column; y < last_column; y++) {
+					unsigned int i = x * width + y;
+					uint8_t value = workspace_bitmap[i];
+					if (!candidate(value)) {
+						continue;
+					}
+
+					// New pixel goes straight under root of first neighbour
+					// found, further neighbours are joined with it.
+					unsigned int root = i;
+					if (!diagonal && y > first_column && candidate(workspace_bitmap[i - 1])) {
+						root = FindRoot(parent, i - 1);
+					}
+					if (x > first) {
+						if (y > first_column && candidate(workspace_bitmap[i - width - 1])) {
+							root = JoinRoot(parent, root, i, i - width - 1);
+						}
+						if (!diagonal && candidate(workspace_bitmap[i - width])) {
+							root = JoinRoot(parent, root, i, i - width);
+						}
+						if (y + 1 < last_column && candidate(workspace_bitmap[i - width + 1])) {
+							root = JoinRoot(parent, root, i, i - width + 1);
+						}
+					}
+					parent[i] = root;
 
-	float *gaussianMask;
-	gaussianMask = new float[mask_size * mask_size];
+					if (strong(value)) {
+						if (seed == UINT_MAX) {
+							seed = i;
+						} else {
+							JoinRoots(parent, i, seed);
+						}
+					}
+				}
+			}
 
-	for (int i = -signed_mask_halfsize; i <= signed_mask_halfsize; i++) {
-		for (int j = -signed_mask_halfsize; j <= signed_mask_halfsize; j++) {
-			gaussianMask[(i + signed_mask_halfsize) * mask_size + j + signed_mask_halfsize]
-				= (1 / (2 * PI * sigma * sigma)) * exp(-(i * i + j * j ) / (2 * sigma * sigma));
+			band_seeds[band] = seed;
 		}
+	});
+
+	unsigned int anchor = UINT_MAX;
+	for (unsigned int band = 0; band < bands && anchor == UINT_MAX; band++) {
+		anchor = band_seeds[band];
 	}
 
-	unsigned long i;
-	unsigned long i_offset;
-	int row_offset;
-	int col_offset;
-	float new_pixel;
+	// First row of each band is joined with last row of band above, and
+	// strong pixels of each band with those of first one.
+	thread_pool.ParallelFor(0, bands, [&](unsigned long first_band, unsigned long last_band) {
+		for (unsigned long band = first_band; band < last_band; band++) {
+			unsigned long x = first_row + (last_row - first_row) * band / bands;
+			unsigned long last = first_row + (last_row - first_row) * (band + 1) / bands;
+
+			if (band_seeds[band] != UINT_MAX) {
+				JoinRootsShared(parent, band_seeds[band], anchor);
+			}
+			if (x == first_row || x == last) {
+				continue;
+			}
 
-	for (x = signed_mask_halfsize; x < height - signed_mask_halfsize; x++) {
-		for (y = signed_mask_halfsize; y < width - signed_mask_halfsize; y++) {
-			new_pixel = 0;
-			for (row_offset = -signed_mask_halfsize; row_offset <= signed_mask_halfsize; row_offset++) {
-				for (col_offset = -signed_mask_halfsize; col_offset <= signed_mask_halfsize; col_offset++) {
-					i_offset = (unsigned long) ((x + row_offset) * width + (y + col_offset));
-					new_pixel += (float) ((workspace_bitmap[i_offset])) * gaussianMask[(signed_mask_halfsize + row_offset) * mask_size + signed_mask_halfsize + col_offset];
+			for (unsigned int y = first_column; y < last_column; y++) {
+				unsigned int i = x * width + y;
+				if (!candidate(workspace_bitmap[i])) {
+					continue;
+				}
+				if (y > first_column && candidate(workspace_bitmap[i - width - 1])) {
+					JoinRootsShared(parent, i, i - width - 1);
+				}
+				if (!diagonal && candidate(workspace_bitmap[i - width])) {
+					JoinRootsShared(parent, i, i - width);
+				}
+				if (y + 1 < last_column && candidate(workspace_bitmap[i - width + 1])) {
+					JoinRootsShared(parent, i, i - width + 1);
 				}
 			}
-			i = (unsigned long) (x * width + y);
-			workspace_bitmap[i] = new_pixel;
 		}
-	}
+	});
 
-	delete[] gaussianMask;
+	return anchor == UINT_MAX ? UINT_MAX : FindRootShared(parent, anchor);
 }
 
-void CannyEdgeDetector::EdgeDetection()
+void CannyEdgeDetector::ParallelPropagation()
 {
-	// Sobel masks.
-	float Gx[9];
-	Gx[0] = 1.0; Gx[1] = 0.0; Gx[2] = -1.0;
-	Gx[3] = 2.0; Gx[4] = 0.0; Gx[5] = -2.0;
-	Gx[6] = 1.0; Gx[7] = 0.0; Gx[8] = -1.0;
-	float Gy[9];
-	Gy[0] = -1.0; Gy[1] = -2.0; Gy[2] = -1.0;
-	Gy[3] =  0.0; Gy[4] =  0.0; Gy[5] =  0.0;
-	Gy[6] =  1.0; Gy[7] =  2.0; Gy[8] =  1.0;
-
-	float value_gx, value_gy;
+	unsigned int *parent = edge_stack;
+	unsigned int root = UINT_MAX;
+	CANNY_INSTRUMENT(std::mutex stats_mutex);
 
-	float max = 0.0;
-	float angle = 0.0;
+	// Pixels of outermost frame are not followed, so only inside of it is
+	// joined.
+	if (width > 2 && height > 2) {
+		root = this->JoinComponents(1, height - 1, 1, width - 1, false,
+		                            [](uint8_t value) { return value == 128 || value == 255; },
+		                            [](uint8_t value) { return value == 255; });
 
-	// Convolution.
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			value_gx = 0.0;
-			value_gy = 0.0;
-
-			for (int k = 0; k < 3; k++) {
-				for (int l = 0; l < 3; l++) {
-					value_gx += Gx[l * 3 + k] * GetPixelValue((x + 1) + (1 - k),
-					                                          (y + 1) + (1 - l));
-					value_gy += Gy[l * 3 + k] * GetPixelValue((x + 1) + (1 - k),
-					                                          (y + 1) + (1 - l));
+		thread_pool.ParallelFor(1, height - 1, [&](unsigned long first, unsigned long last) {
+			CANNY_INSTRUMENT(unsigned long seeds = 0, promoted = 0);
+			for (unsigned long x = first; x < last; x++) {
+				for (unsigned int y = 1; y + 1 < width; y++) {
+					unsigned int i = x * width + y;
+					if (workspace_bitmap[i] == 128) {
+						bool edge = root != UINT_MAX && FindRootJoined(parent, i) == root;
+						workspace_bitmap[i] = edge ? 255 : 0;
+						CANNY_INSTRUMENT(promoted += edge);
+					} else {
+						CANNY_INSTRUMENT(seeds += workspace_bitmap[i] == 255);
+					}
 				}
 			}
+#ifdef CANNY_INSTRUMENTATION
+			if (stats != NULL) {
+				std::lock_guard<std::mutex> lock(stats_mutex);
+				stats->propagation_seeds += seeds;
+				stats->propagated_pixels += promoted;
+			}
+#endif
+		});
+	}
 
-			edge_magnitude[x * width + y] = sqrt(value_gx * value_gx + value_gy * value_gy) / 4.0;
-
-			// Maximum magnitude.
-			max = edge_magnitude[x * width + y] > max ? edge_magnitude[x * width + y] : max;
-
-			// Angle calculation.
-			if ((value_gx != 0.0) || (value_gy != 0.0)) {
-				angle = atan2(value_gy, value_gx) * 180.0 / PI;
-			} else {
-				angle = 0.0;
+	// Pixels of the frame are promoted by 255 valued neighbours inside it.
+	CANNY_INSTRUMENT(unsigned long promoted = 0);
+	for (unsigned int x = 0; x < height; x++) {
+		unsigned int step = (x == 0 || x + 1 == height) ? 1 : (width > 1 ? width - 1 : 1);
+		for (unsigned int y = 0; y < width; y += step) {
+			if (GetPixelValue(x, y) != 128) {
+				continue;
 			}
-			if (((angle > -22.5) && (angle <= 22.5)) ||
-			    ((angle > 157.5) && (angle <= -157.5))) {
-				edge_direction[x * width + y] = 0;
-			} else if (((angle > 22.5) && (angle <= 67.5)) ||
-			           ((angle > -157.5) && (angle <= -112.5))) {
-				edge_direction[x * width + y] = 45;
-			} else if (((angle > 67.5) && (angle <= 112.5)) ||
-			           ((angle > -112.5) && (angle <= -67.5))) {
-				edge_direction[x * width + y] = 90;
-			} else if (((angle > 112.5) && (angle <= 157.5)) ||
-			           ((angle > -67.5) && (angle <= -22.5))) {
-				edge_direction[x * width + y] = 135;
+
+			uint8_t value = 0;
+			for (unsigned int x1 = x > 1 ? x - 1 : 1; x1 <= x + 1 && x1 + 1 < height; x1++) {
+				for (unsigned int y1 = y > 1 ? y - 1 : 1; y1 <= y + 1 && y1 + 1 < width; y1++) {
+					value |= GetPixelValue(x1, y1) == 255 ? 255 : 0;
+				}
 			}
+			SetPixelValue(x, y, value);
+			CANNY_INSTRUMENT(promoted += value == 255);
 		}
 	}
+	CANNY_INSTRUMENT(if (stats != NULL) stats->propagated_pixels += promoted);
+}
 
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			edge_magnitude[x * width + y] =
-			    255.0f * edge_magnitude[x * width + y] / max;
-			SetPixelValue(x, y, edge_magnitude[x * width + y]);
+void CannyEdgeDetector::ParallelHysteresis(uint8_t lowThreshold, uint8_t highThreshold)
+{
+	unsigned int *parent = edge_stack;
+	unsigned int root = this->JoinComponents(0, height, 0, width, true,
+	                                         [lowThreshold](uint8_t value) { return value >= lowThreshold; },
+	                                         [highThreshold](uint8_t value) { return value >= highThreshold; });
+	CANNY_INSTRUMENT(std::mutex stats_mutex);
+
+	thread_pool.ParallelFor(0, height, [&](unsigned long first, unsigned long last) {
+		CANNY_INSTRUMENT(unsigned long promoted = 0);
+		for (unsigned long x = first; x < last; x++) {
+			for (unsigned int y = 0; y < width; y++) {
+				unsigned int i = x * width + y;
+				uint8_t value = workspace_bitmap[i];
+				bool edge = value >= lowThreshold && root != UINT_MAX &&
+				            FindRootJoined(parent, i) == root;
+				workspace_bitmap[i] = edge ? 255 : 0;
+				CANNY_INSTRUMENT(promoted += edge && value < highThreshold);
+			}
 		}
-	}
+#ifdef CANNY_INSTRUMENTATION
+		if (stats != NULL) {
+			std::lock_guard<std::mutex> lock(stats_mutex);
+			stats->hysteresis_promoted += promoted;
+		}
+#endif
+	});
 }
 
-void CannyEdgeDetector::NonMaxSuppression()
+void CannyEdgeDetector::PropagateEdges()
 {
-	float pixel_1 = 0;
-	float pixel_2 = 0;
-	float pixel;
+	if (thread_pool.GetThreadCount() > 1) {
+		this->ParallelPropagation();
+		return;
+	}
 
-	for (x = 1; x < height - 1; x++) {
-		for (y = 1; y < width - 1; y++) {
-			if (edge_direction[x * width + y] == 0) {
-				pixel_1 = edge_magnitude[(x + 1) * width + y];
-				pixel_2 = edge_magnitude[(x - 1) * width + y];
-			} else if (edge_direction[x * width + y] == 45) {
-				pixel_1 = edge_magnitude[(x + 1) * width + y - 1];
-				pixel_2 = edge_magnitude[(x - 1) * width + y + 1];
-			} else if (edge_direction[x * width + y] == 90) {
-				pixel_1 = edge_magnitude[x * width + y - 1];
-				pixel_2 = edge_magnitude[x * width + y + 1];
-			} else if (edge_direction[x * width + y] == 135) {
-				pixel_1 = edge_magnitude[(x + 1) * width + y + 1];
-				pixel_2 = edge_magnitude[(x - 1) * width + y - 1];
-			}
-			pixel = edge_magnitude[x * width + y];
-			if ((pixel >= pixel_1) && (pixel >= pixel_2)) {
-				SetPixelValue(x, y, pixel);
-			} else {
-				SetPixelValue(x, y, 0);
+	// Pixels equal to 128 which are connected with 255 ones become 255 as
+	// well, the rest of them is suppressed. Only 255 pixels lying inside
+	// the outermost frame propagate. Instead of sweeping whole image until
+	// nothing changes, every 255 pixel is put on stack once and each
+	// promoted pixel is pushed once more, so this is one linear pass.
+	unsigned int *stack = edge_stack;
+	unsigned long top = 0;
+	unsigned int x, y;
+
+	for (x = 1; x + 1 < height; x++) {
+		for (y = 1; y + 1 < width; y++) {
+			if (GetPixelValue(x, y) == 255) {
+				stack[top++] = x * width + y;
 			}
 		}
 	}
 
-	bool change = true;
-	while (change) {
-		change = false;
-		for (x = 1; x < height - 1; x++) {
-			for (y = 1; y < width - 1; y++) {
-				if (GetPixelValue(x, y) == 255) {
-					if (GetPixelValue(x + 1, y) == 128) {
-						change = true;
-						SetPixelValue(x + 1, y, 255);
-					}
-					if (GetPixelValue(x - 1, y) == 128) {
-						change = true;
-						SetPixelValue(x - 1, y, 255);
-					}
-					if (GetPixelValue(x, y + 1) == 128) {
-						change = true;
-						SetPixelValue(x, y + 1, 255);
-					}
-					if (GetPixelValue(x, y - 1) == 128) {
-						change = true;
-						SetPixelValue(x, y - 1, 255);
-					}
-					if (GetPixelValue(x + 1, y + 1) == 128) {
-						change = true;
-						SetPixelValue(x + 1, y + 1, 255);
-					}
-					if (GetPixelValue(x - 1, y - 1) == 128) {
-						change = true;
-						SetPixelValue(x - 1, y - 1, 255);
-					}
-					if (GetPixelValue(x - 1, y + 1) == 128) {
-						change = true;
-						SetPixelValue(x - 1, y + 1, 255);
-					}
-					if (GetPixelValue(x + 1, y - 1) == 128) {
-						change = true;
-						SetPixelValue(x + 1, y - 1, 255);
+	CANNY_INSTRUMENT(unsigned long seeds = top, promoted = 0, depth = top);
+	while (top > 0) {
+		unsigned long i = stack[--top];
+		x = i / width;
+		y = i % width;
+
+		for (unsigned int x1 = x - 1; x1 <= x + 1; x1++) {
+			for (unsigned int y1 = y - 1; y1 <= y + 1; y1++) {
+				if (GetPixelValue(x1, y1) == 128) {
+					SetPixelValue(x1, y1, 255);
+					CANNY_INSTRUMENT(promoted++);
+					if (x1 > 0 && x1 + 1 < height && y1 > 0 && y1 + 1 < width) {
+						stack[top++] = x1 * width + y1;
+						CANNY_INSTRUMENT(depth = top > depth ? top : depth);
 					}
 				}
 			}
 		}
-		if (change) {
-			for (x = height - 2; x > 0; x--) {
-				for (y = width - 2; y > 0; y--) {
-					if (GetPixelValue(x, y) == 255) {
-						if (GetPixelValue(x + 1, y) == 128) {
-							change = true;
-							SetPixelValue(x + 1, y, 255);
-						}
-						if (GetPixelValue(x - 1, y) == 128) {
-							change = true;
-							SetPixelValue(x - 1, y, 255);
-						}
-						if (GetPixelValue(x, y + 1) == 128) {
-							change = true;
-							SetPixelValue(x, y + 1, 255);
-						}
-						if (GetPixelValue(x, y - 1) == 128) {
-							change = true;
-							SetPixelValue(x, y - 1, 255);
-						}
-						if (GetPixelValue(x + 1, y + 1) == 128) {
-							change = true;
-							SetPixelValue(x + 1, y + 1, 255);
-						}
-						if (GetPixelValue(x - 1, y - 1) == 128) {
-							change = true;
-							SetPixelValue(x - 1, y - 1, 255);
-						}
-						if (GetPixelValue(x - 1, y + 1) == 128) {
-							change = true;
-							SetPixelValue(x - 1, y + 1, 255);
-						}
-						if (GetPixelValue(x + 1, y - 1) == 128) {
-							change = true;
-							SetPixelValue(x + 1, y - 1, 255);
-						}
-					}
-				}
-			}
+	}
+
+#ifdef CANNY_INSTRUMENTATION
+	if (stats != NULL) {
+		stats->propagation_seeds += seeds;
+		stats->propagated_pixels += promoted;
+		if (depth > stats->max_worklist_depth) {
+			stats->max_worklist_depth = depth;
 		}
 	}
+#endif
 
 	// Suppression
 	for (x = 0; x < height; x++) {
@@ -442,44 +2354,92 @@ void CannyEdgeDetector::NonMaxSuppression()
 
 void CannyEdgeDetector::Hysteresis(uint8_t lowThreshold, uint8_t highThreshold)
 {
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			if (GetPixelValue(x, y) >= highThreshold) {
-				SetPixelValue(x, y, 255);
-				this->HysteresisRecursion(x, y, lowThreshold);
+	unsigned int x, y;
+
+	// With lower threshold above upper one, pixels between them are seeds
+	// only if no trace reached them before, so result depends on order of
+	// seeds and is left to serial scan.
+	if (thread_pool.GetThreadCount() > 1 && lowThreshold <= highThreshold) {
+		this->ParallelHysteresis(lowThreshold, highThreshold);
+	} else {
+		for (x = 0; x < height; x++) {
+			for (y = 0; y < width; y++) {
+				if (GetPixelValue(x, y) >= highThreshold) {
+					SetPixelValue(x, y, 255);
+					this->HysteresisTrace(x * width + y, lowThreshold, highThreshold);
+				}
+			}
+		}
+
+		for (x = 0; x < height; x++) {
+			for (y = 0; y < width; y++) {
+				if (GetPixelValue(x, y) != 255) {
+					SetPixelValue(x, y, 0);
+				}
 			}
 		}
 	}
 
-	for (x = 0; x < height; x++) {
-		for (y = 0; y < width; y++) {
-			if (GetPixelValue(x, y) != 255) {
-				SetPixelValue(x, y, 0);
+#ifdef CANNY_INSTRUMENTATION
+	// Margins are cut off later, only edges of image itself are counted.
+	if (stats != NULL) {
+		for (x = mask_halfsize; x + mask_halfsize < height; x++) {
+			for (y = mask_halfsize; y + mask_halfsize < width; y++) {
+				stats->edge_pixels += GetPixelValue(x, y) == 255;
 			}
 		}
 	}
+#endif
 }
 
-void CannyEdgeDetector::HysteresisRecursion(long x, long y, uint8_t lowThreshold)
+void CannyEdgeDetector::HysteresisTrace(unsigned int seed, uint8_t lowThreshold,
+                                        uint8_t highThreshold)
 {
+	// Pixel is pushed only when it turns into 255, so stack never holds
+	// more than width * height entries.
+	unsigned int *stack = edge_stack;
+	unsigned long top = 0;
 	uint8_t value = 0;
 
-	for (long x1 = x - 1; x1 <= x + 1; x1++) {
-		for (long y1 = y - 1; y1 <= y + 1; y1++) {
-			if ((x1 < height) & (y1 < width) & (x1 >= 0) & (y1 >= 0)
-			    & (x1 != x) & (y1 != y)) {
+	stack[top++] = seed;
+	CANNY_INSTRUMENT(unsigned long promoted = 0, depth = top);
+	while (top > 0) {
+		unsigned int i = stack[--top];
+		long x = i / width;
+		long y = i % width;
 
-				value = GetPixelValue(x1, y1);
-				if (value != 255) {
-					if (value >= lowThreshold) {
-						SetPixelValue(x1, y1, 255);
-						this->HysteresisRecursion(x1, y1, lowThreshold);
-					}
-					else {
-						SetPixelValue(x1, y1, 0);
+		// Only diagonal neighbours are followed, same as in former
+		// recursive implementation.
+		for (long x1 = x - 1; x1 <= x + 1; x1 += 2) {
+			for (long y1 = y - 1; y1 <= y + 1; y1 += 2) {
+				if ((x1 < height) & (y1 < width) & (x1 >= 0) & (y1 >= 0)) {
+					value = GetPixelValue(x1, y1);
+					if (value != 255) {
+						if (value >= lowThreshold) {
+							SetPixelValue(x1, y1, 255);
+							stack[top++] = x1 * width + y1;
+							// Strong pixels are edges anyway, only weak
+							// ones are counted, as in ParallelHysteresis().
+							CANNY_INSTRUMENT(promoted += value < highThreshold);
+							CANNY_INSTRUMENT(depth = top > depth ? top : depth);
+						}
+						else {
+							SetPixelValue(x1, y1, 0);
+						}
 					}
 				}
 			}
 		}
 	}
+
+#ifdef CANNY_INSTRUMENTATION
+	if (stats != NULL) {
+		stats->hysteresis_promoted += promoted;
+		if (depth > stats->max_worklist_depth) {
+			stats->max_worklist_depth = depth;
+		}
+	}
+#else
+	(void) highThreshold;
+#endif
 }
@@ -11,13 +11,135 @@
 #ifndef _CANNYEDGEDETECTOR_H_
 #define _CANNYEDGEDETECTOR_H_
 
-typedef unsigned char uint8_t;
+#include <chrono>
+#include <vector>
+
+#include "CannyKernels.h"
+#include "CannyStats.h"
+#include "CannyTaskGraph.h"
+#include "CannyThreadPool.h"
+
+/**
+ * \brief Layouts of edge mask written by detector.
+ */
+enum CannyMaskFormat
+{
+	CANNY_MASK_GRAY8, ///< One byte per pixel, 255 for edges and 0 elsewhere.
+	CANNY_MASK_BIT1,  ///< Eight pixels per byte, most significant bit first,
+	                  ///< set for edges. Unused bits of last byte are 0.
+	CANNY_MASK_BGR24  ///< Three equal bytes per pixel, as in 24-bit bitmap.
+};
+
+/**
+ * \brief Values blur and Sobel masks see outside of image.
+ */
+enum CannyBorder
+{
+	CANNY_BORDER_REPLICATE, ///< Outermost pixel repeated, `aaa|abcd`.
+	CANNY_BORDER_REFLECT,   ///< Image mirrored around outermost pixel, `dcb|abcd`.
+	CANNY_BORDER_CONSTANT   ///< One gray level, `vvv|abcd`.
+};
+
+/**
+ * \brief Input image, not owned by detector.
+ */
+struct CannyImageView
+{
+	/**
+	 * \var First pixel of first row.
+	 */
+	const uint8_t *data;
+
+	/**
+	 * \var Size of image, in pixels.
+	 */
+	unsigned int width, height;
+
+	/**
+	 * \var Distance between rows, in bytes. Rows may be padded.
+	 */
+	size_t stride;
+
+	/**
+	 * \var Layout of pixels.
+	 */
+	CannyPixelFormat format;
+};
+
+/**
+ * \brief Output edge mask of same size as input image, owned by caller.
+ */
+struct CannyMaskView
+{
+	/**
+	 * \var First byte of first row.
+	 */
+	uint8_t *data;
+
+	/**
+	 * \var Distance between rows, in bytes. Rows may be padded.
+	 */
+	size_t stride;
+
+	/**
+	 * \var Layout of mask.
+	 */
+	CannyMaskFormat format;
+};
+
+/**
+ * \brief Rectangle of input image edges are wanted in, see
+ * CannyEdgeDetector::ProcessRegions().
+ */
+struct CannyRegion
+{
+	/**
+	 * \var Column and row of top left pixel of region.
+	 */
+	unsigned int left, top;
+
+	/**
+	 * \var Size of region, in pixels.
+	 */
+	unsigned int width, height;
+
+	/**
+	 * \var Own mask of region, of `width` * `height` pixels. If `data` is
+	 * NULL, edges go into mask of whole image, at place of region.
+	 */
+	CannyMaskView mask;
+};
+
+/**
+ * \brief Edge pixel, as returned by CannyEdgeDetector::ProcessPoints() and
+ * CannyEdgeDetector::ProcessContours().
+ */
+struct CannyEdgePoint
+{
+	/**
+	 * \var Column and row of pixel in image.
+	 */
+	unsigned int column, row;
+
+	/**
+	 * \var Gradient magnitude, scaled to range of thresholds (0-255), or 0
+	 * if gradient was not asked for.
+	 */
+	float magnitude;
+
+	/**
+	 * \var Gradient direction, one of CannyDirection, or 0 if gradient was
+	 * not asked for.
+	 */
+	uint8_t direction;
+};
 
 /**
  * \brief Canny algorithm class.
  *
  * Algorithm executes each step of Canny algorithm in one method,
- * ProcessImage. It operates on 24-bit RGB (BGR) bitmap.
+ * ProcessImage. It operates on 24-bit RGB (BGR) bitmap, or on any image
+ * described by CannyImageView.
  */
 class CannyEdgeDetector
 {
@@ -37,6 +159,48 @@ class CannyEdgeDetector
 		 */
 		~CannyEdgeDetector();
 
+		/**
+		 * \brief Makes sure no allocation happens for images up to given size.
+		 *
+		 * All working buffers are taken out of one arena owned by detector.
+		 * It only grows: ProcessImage() enlarges it when image does not fit
+		 * and reuses it otherwise, so after first (or reserved) image of
+		 * maximum size, processing does no heap allocations at all.
+		 *
+		 * Frame mode takes 14 bytes per pixel of image enlarged by Gauss
+		 * margins, and one more per pixel of image. Streaming mode takes 5
+		 * bytes per pixel of enlarged image, workspace and worklist of edge
+		 * tracing that holds suppressed magnitudes until hysteresis (see
+		 * SetStreaming()), and ring buffers of (9 * mask size + 21) bytes
+		 * per column for each thread. SetKeepSuppressed() adds 1 byte per
+		 * pixel in both modes. For 4000 x 3000 image and sigma 2 that is 181 MB in frame
+		 * mode and 61 MB in streaming mode on one thread, as
+		 * GetReservedBytes() reports.
+		 *
+		 * \param width Maximum width of image.
+		 * \param height Maximum height of image.
+		 * \param max_sigma Maximum sigma that will be used.
+		 */
+		void Reserve(unsigned int width, unsigned int height, float max_sigma);
+
+		/**
+		 * \brief Frees arena. Next ProcessImage() allocates it again.
+		 */
+		void Release();
+
+		/**
+		 * \brief Returns number of arena allocations done so far.
+		 *
+		 * Does not change between calls of ProcessImage() once arena is big
+		 * enough, which proves steady-state processing does not allocate.
+		 */
+		unsigned long GetAllocationCount() const;
+
+		/**
+		 * \brief Returns current size of arena in bytes.
+		 */
+		unsigned long GetReservedBytes() const;
+
 		/**
 		 * \brief Main method processing image.
 		 *
@@ -63,8 +227,9 @@ class CannyEdgeDetector
 		 * the margins are calculated in `PreProcessImage()`. Original width and
 		 * height values used in addressing pixels are also enlarged.
 		 *
-		 * In many places there are used x and y variables which are used as
-		 * counters in addressing pixels in following manner:
+		 * In many places there are used x and y variables (local to each
+		 * step, so bands of image can be processed in parallel) which are
+		 * used as counters in addressing pixels in following manner:
 		 *        y->
 		 *        012345
 		 *     x 0......
@@ -84,11 +249,461 @@ class CannyEdgeDetector
 		                      unsigned int height, float sigma = 1.0f,
 		                      uint8_t lowThreshold = 30, uint8_t highThreshold = 80);
 
+		/**
+		 * \brief Processes image view and writes edges into caller's mask.
+		 *
+		 * Same as above, but input may be gray or color image of any
+		 * supported layout, with padded rows, and is never modified. Gray
+		 * image is read in place, with no conversion.
+		 * Mask may share memory with input (to process image in place), as
+		 * input is completely read before mask is written.
+		 *
+		 * \param image Source image.
+		 * \param mask Destination mask, of `image.width` * `image.height`
+		 * pixels.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if image or mask is empty or its stride is too small
+		 * for its width, if sigma is not positive, or if image enlarged by Gauss margins has 2^32
+		 * pixels or more (CannyTiledProcessor handles such images), true
+		 * otherwise.
+		 */
+		bool ProcessImage(const CannyImageView &image, const CannyMaskView &mask,
+		                  float sigma = 1.0f, uint8_t lowThreshold = 30,
+		                  uint8_t highThreshold = 80);
+
+		/**
+		 * \brief Thresholds last processed image again.
+		 *
+		 * With SetKeepSuppressed() on, ProcessImage() keeps image of
+		 * suppressed gradient magnitudes, so only propagation of edges and
+		 * hysteresis are repeated, which is many times faster than
+		 * processing whole image. Result is written into mask given to last
+		 * ProcessImage() call, which must still be valid, and is same as
+		 * ProcessImage() with new thresholds would give.
+		 *
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if no image was processed with SetKeepSuppressed()
+		 * on since construction or Release(), or if last image went to
+		 * ProcessPoints() or ProcessContours() and no mask was given since.
+		 */
+		bool Rethreshold(uint8_t lowThreshold, uint8_t highThreshold);
+
+		/**
+		 * \brief Thresholds last processed image again, into another mask.
+		 *
+		 * Same as above, but result goes to given mask, which becomes the
+		 * one later calls write to.
+		 *
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \param mask Destination mask, of size of last processed image.
+		 * \return False if no image was processed or stride of mask is too
+		 * small.
+		 */
+		bool Rethreshold(uint8_t lowThreshold, uint8_t highThreshold,
+		                 const CannyMaskView &mask);
+
+		/**
+		 * \brief Makes processing keep suppressed image for Rethreshold().
+		 *
+		 * Keeping it costs copy of enlarged image per processed image and
+		 * one byte per pixel of arena, so it is off by default.
+		 *
+		 * \param keep True to keep suppressed image. Default is false.
+		 */
+		void SetKeepSuppressed(bool keep);
+
+		/**
+		 * \brief Returns true if suppressed image is kept.
+		 */
+		bool GetKeepSuppressed() const;
+
+		/**
+		 * \brief Detects edges inside given rectangles of image only.
+		 *
+		 * Each region is processed as image of its own, together with halo
+		 * of neighbouring pixels wide enough for Gauss mask, Sobel mask and
+		 * suppression of non maximum pixels, so work done is proportional
+		 * to area of regions, not of image. With Gauss mask (see
+		 * SetRecursiveSigma()) gradients inside region are exactly those
+		 * ProcessImage() computes. Magnitudes are scaled with maximum of
+		 * region and its halo instead of whole image, and edges are traced
+		 * inside region only, so pixels near its borders may differ from
+		 * ProcessImage(). Region covering whole image gives same mask as
+		 * ProcessImage().
+		 *
+		 * Pixels of mask outside of regions are left as they are, bits of
+		 * 1-bit mask included. Regions may overlap, later one wins. Mask
+		 * must not share memory with input, as halo of one region may be
+		 * read after another region is written.
+		 *
+		 * \param image Source image.
+		 * \param mask Mask of `image.width` * `image.height` pixels, for
+		 * regions with no mask of their own. Its `data` may be NULL if every
+		 * region has one.
+		 * \param regions Array of regions.
+		 * \param count Number of regions.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if image is invalid, if any region is empty, does not
+		 * lie inside image or has no valid mask to go to, or if sigma is not
+		 * positive. Nothing is written then.
+		 */
+		bool ProcessRegions(const CannyImageView &image, const CannyMaskView &mask,
+		                    const CannyRegion *regions, unsigned int count,
+		                    float sigma = 1.0f, uint8_t lowThreshold = 30,
+		                    uint8_t highThreshold = 80);
+
+		/**
+		 * \brief Processes image view and returns list of edge pixels.
+		 *
+		 * Same as ProcessImage(), but instead of writing mask, edge pixels
+		 * are listed row by row, left to right. No bitmap of image size
+		 * is filled for caller. With SetKeepSuppressed() on, Rethreshold()
+		 * with mask given can follow.
+		 *
+		 * \param image Source image.
+		 * \param points Edge pixels, replaced. Memory of vector is reused.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \param withGradient True to fill magnitude and direction of points.
+		 * Not supported in streaming mode, which keeps no gradient of whole
+		 * image.
+		 * \return False if image or sigma is invalid, see ProcessImage(), or
+		 * gradient is asked for in streaming mode.
+		 */
+		bool ProcessPoints(const CannyImageView &image, std::vector<CannyEdgePoint> &points,
+		                   float sigma = 1.0f, uint8_t lowThreshold = 30,
+		                   uint8_t highThreshold = 80, bool withGradient = false);
+
+		/**
+		 * \brief Processes image view and returns edges as chains of pixels.
+		 *
+		 * Same as ProcessPoints(), but edge pixels are linked into contours,
+		 * each one a chain of 8-connected pixels. Every edge pixel is in
+		 * exactly one contour. Branching edges are split into several
+		 * contours, closed ones start and end next to each other.
+		 *
+		 * \param image Source image.
+		 * \param points Edge pixels, replaced, contour by contour, in order
+		 * along each contour.
+		 * \param contours Index of first point of each contour, replaced. One
+		 * more index follows the last contour, equal to size of `points`.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \param withGradient True to fill magnitude and direction of points.
+		 * \return False if image or sigma is invalid, or gradient is asked
+		 * for in streaming mode.
+		 */
+		bool ProcessContours(const CannyImageView &image, std::vector<CannyEdgePoint> &points,
+		                     std::vector<unsigned int> &contours, float sigma = 1.0f,
+		                     uint8_t lowThreshold = 30, uint8_t highThreshold = 80,
+		                     bool withGradient = false);
+
+		/**
+		 * \brief Forces row kernels of given instruction set.
+		 *
+		 * By default the best set supported by processor is picked in
+		 * constructor. All sets give identical results, so this is meant for
+		 * testing and benchmarking.
+		 *
+		 * \param set Instruction set, CANNY_KERNELS_AUTO restores default.
+		 * \return False if processor does not support the set.
+		 */
+		bool SetKernelSet(CannyKernelSet set);
+
+		/**
+		 * \brief Returns instruction set of currently used kernels.
+		 */
+		CannyKernelSet GetKernelSet() const;
+
+		/**
+		 * \brief Sets number of threads ProcessImage() runs on.
+		 *
+		 * Every stage but propagation of edges and hysteresis splits image
+		 * into horizontal bands processed in parallel. Bands read halo rows
+		 * of their neighbours (Gauss margin for blur, one row for Sobel and
+		 * non maximum suppression), which previous stage has already
+		 * finished, so result is bit-identical with single-threaded run.
+		 *
+		 * \param count Number of threads, 0 means one per hardware thread.
+		 * Default is 1.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief Returns number of threads ProcessImage() runs on.
+		 */
+		unsigned int GetThreadCount() const;
+
+		/**
+		 * \brief Switches between frame and streaming modes.
+		 *
+		 * In frame mode (default) each step walks whole enlarged image and
+		 * keeps its result at full size: gray image, blurred image, gradient
+		 * magnitude and direction. In streaming mode luminance, blur, Sobel
+		 * and suppression of non maximum pixels are fused and run row by row
+		 * through small ring buffers (Gauss mask height for blur, three rows
+		 * for Sobel and suppression), so working set stays in cache. Only
+		 * suppressed magnitudes and input of hysteresis are kept at full
+		 * size: magnitudes are scaled with maximum of whole image, which is
+		 * not known until last row is done, so they cannot stay in rings.
+		 * They share memory with worklist of edge tracing, not used until
+		 * then, see Reserve() for sizes. Each band of image (see
+		 * SetThreadCount()) streams its own rows, starting few halo rows
+		 * earlier. Result is bit-identical with frame mode.
+		 *
+		 * \param streaming True for streaming mode.
+		 */
+		void SetStreaming(bool streaming);
+
+		/**
+		 * \brief Returns true if streaming mode is on.
+		 */
+		bool GetStreaming() const;
+
+		/**
+		 * \brief Switches frame mode between band and task scheduling.
+		 *
+		 * With bands (default) each step from luminance to suppression of
+		 * non maximum pixels is split into one band per thread, and next
+		 * step starts when the slowest band is done. With tasks, image is
+		 * cut into strips of rows and each step of each strip is a task of
+		 * CannyTaskGraph, started as soon as strips it reads are done by
+		 * previous step: blur of strip waits for rows of strips within Gauss
+		 * mask, Sobel for blur of strip and its neighbours. Suppression waits
+		 * for Sobel of whole image, as suppressed magnitudes are scaled with
+		 * its maximum. Threads run further steps of strips they started, and
+		 * steal strips of others when they run out of work. Strips are small,
+		 * so threads are never left waiting for more than one of them.
+		 *
+		 * Streaming mode and recursive blur (see SetRecursiveSigma()) are
+		 * not affected. Result is bit-identical with band scheduling.
+		 *
+		 * \param tasks True for task scheduling.
+		 */
+		void SetTaskScheduling(bool tasks);
+
+		/**
+		 * \brief Returns true if task scheduling is on.
+		 */
+		bool GetTaskScheduling() const;
+
+		/**
+		 * \brief Switches between floating-point and fixed-point arithmetic.
+		 *
+		 * In fixed-point mode conversion to grayscale uses 8.8 weights and
+		 * Gaussian blur uses quantized kernel, 8 fractional bits with 16-bit
+		 * sums in horizontal pass and 15 fractional bits with 32-bit sums in
+		 * vertical pass. Only integer operations are involved, so result
+		 * does not depend on compiler or processor, and vectorized kernels
+		 * process twice as many pixels per instruction. Gray pixels differ
+		 * from floating-point ones by at most one level; blurred pixels by
+		 * at most two (one being usual), due to quantization of weights.
+		 * Later steps are shared by both modes.
+		 *
+		 * \param fixed_point True for fixed-point mode. Default is false.
+		 */
+		void SetFixedPoint(bool fixed_point);
+
+		/**
+		 * \brief Returns true if fixed-point mode is on.
+		 */
+		bool GetFixedPoint() const;
+
+		/**
+		 * \brief Chooses how gradient magnitude and direction are computed.
+		 *
+		 * CANNY_GRADIENT_EXACT (default) takes Euclidean norm and atan2 for
+		 * every pixel. Fast modes pick direction by comparing |gy| with |gx|
+		 * scaled by tangents of sector boundaries and skip square root:
+		 * CANNY_GRADIENT_SQUARED compares squared norms in non maximum
+		 * suppression, which gives the same maxima as Euclidean norm, and
+		 * takes square root only of maxima left, so thresholds keep their
+		 * meaning. CANNY_GRADIENT_L1 uses |gx| + |gy|, which overestimates
+		 * diagonal gradients by up to 41%, so edges found differ slightly.
+		 * Directions differ from exact ones only on sector boundaries.
+		 *
+		 * \param gradient Gradient mode.
+		 */
+		void SetGradient(CannyGradient gradient);
+
+		/**
+		 * \brief Returns gradient mode.
+		 */
+		CannyGradient GetGradient() const;
+
+		/**
+		 * \brief Sets sigma from which Gaussian blur is recursive.
+		 *
+		 * Exact mask costs time proportional to its width, which grows with
+		 * sigma. From given sigma on, image is blurred with recursive filter
+		 * of Young and van Vliet instead, whose cost does not depend on
+		 * sigma, see RecursiveBlur(). Filter approximates Gauss function of
+		 * the same variance as (truncated) exact mask, so strength of blur
+		 * does not change at the switch. Blurred pixels differ from exact
+		 * ones by few gray levels, see README for measured accuracy.
+		 *
+		 * Recursive filter works in floating point, in fixed-point mode too.
+		 * Streaming mode and CannyTiledProcessor always use exact mask.
+		 *
+		 * \param min_sigma Smallest sigma blurred recursively, 0 turns
+		 * recursive filter off. Default is 8, where recursive filter catches
+		 * up with AVX2 kernels of exact mask; without AVX2 it pays off from
+		 * sigma 4.
+		 */
+		void SetRecursiveSigma(float min_sigma);
+
+		/**
+		 * \brief Returns sigma from which Gaussian blur is recursive.
+		 */
+		float GetRecursiveSigma() const;
+
+		/**
+		 * \brief Chooses how image is extended beyond its borders.
+		 *
+		 * Blur and Sobel masks centered near border reach outside of
+		 * image. CANNY_BORDER_REPLICATE (default) repeats outermost pixels,
+		 * CANNY_BORDER_REFLECT mirrors image around them, so gradient does
+		 * not vanish at border, and CANNY_BORDER_CONSTANT puts `value`
+		 * around image, so objects touching border get edges along it.
+		 *
+		 * Recursive blur (see SetRecursiveSigma()) always extends image
+		 * with replicated pixels, which its boundary conditions assume;
+		 * only Sobel masks see chosen border then.
+		 *
+		 * \param border Border mode.
+		 * \param value Gray level of CANNY_BORDER_CONSTANT.
+		 */
+		void SetBorder(CannyBorder border, uint8_t value = 0);
+
+		/**
+		 * \brief Returns border mode.
+		 */
+		CannyBorder GetBorder() const;
+
+		/**
+		 * \brief Returns gray level of CANNY_BORDER_CONSTANT.
+		 */
+		uint8_t GetBorderValue() const;
+
+		/**
+		 * \brief Makes ProcessImage() fill statistics.
+		 *
+		 * Works only if detector is compiled with CANNY_INSTRUMENTATION,
+		 * see CannyStats.h. Without it nothing is measured, so nothing is
+		 * paid for.
+		 *
+		 * \param stats Statistics filled by each call of ProcessImage(), NULL
+		 * turns gathering off.
+		 * \return False if instrumentation is compiled out.
+		 */
+		bool SetStats(CannyStats *stats);
+
+		/**
+		 * \brief Makes ProcessImage() record spans of stages.
+		 *
+		 * Each stage is recorded on calling thread, and each band of it on
+		 * thread that ran it. Works only with CANNY_INSTRUMENTATION.
+		 *
+		 * \param trace Trace spans are added to, NULL turns tracing off.
+		 * \return False if instrumentation is compiled out.
+		 */
+		bool SetTrace(CannyTrace *trace);
+
 	private:
+		/**
+		 * Benchmark runs steps of ProcessImage() one by one.
+		 */
+		friend class CannyBenchmark;
+
+		/**
+		 * Error bound test compares gray and blurred images of both modes.
+		 */
+		friend class CannyCheck;
+
+		/**
+		 * Video processor runs two halves of ProcessImage() on different
+		 * frames at once.
+		 */
+		friend class CannyVideoProcessor;
+
+		/**
+		 * Sweep shares steps up to suppression between thresholds.
+		 */
+		friend class CannySweep;
+
+		/**
+		 * Tiled processor runs steps up to suppression on tiles of image.
+		 */
+		friend class CannyTiledProcessor;
+
+		/**
+		 * Incremental processor runs steps up to suppression on changed
+		 * tiles of frame only.
+		 */
+		friend class CannyIncrementalProcessor;
+
+		/**
+		 * Batch processor checks all images before processing any.
+		 */
+		friend class CannyBatchProcessor;
+
+		/**
+		 * \var Memory all working buffers below are carved from.
+		 */
+		uint8_t *arena;
+
+		/**
+		 * \var Size of `arena` in bytes.
+		 */
+		unsigned long arena_size;
+
+		/**
+		 * \var Number of times `arena` was allocated.
+		 */
+		unsigned long allocation_count;
+
 		/**
 		 * \var Bitmap with source image.
 		 */
-		uint8_t *source_bitmap;
+		const uint8_t *source_bitmap;
+
+		/**
+		 * \var Distance between rows of `source_bitmap`, in bytes.
+		 */
+		size_t source_stride;
+
+		/**
+		 * \var Layout of pixels of `source_bitmap`.
+		 */
+		CannyPixelFormat source_format;
+
+		/**
+		 * \var Mask edges are written to.
+		 */
+		uint8_t *mask_bitmap;
+
+		/**
+		 * \var Distance between rows of `mask_bitmap`, in bytes.
+		 */
+		size_t mask_stride;
+
+		/**
+		 * \var Layout of `mask_bitmap`.
+		 */
+		CannyMaskFormat mask_format;
+
+		/**
+		 * \var Grayscale image of original size, one byte per pixel.
+		 */
+		uint8_t *gray_bitmap;
 
 		/**
 		 * \var Bitmap with image that algorithm is working on.
@@ -96,34 +711,120 @@ class CannyEdgeDetector
 		uint8_t *workspace_bitmap;
 
 		/**
-		 * \var Array storing gradient magnitude.
+		 * \var Array storing gradient magnitude (suppressed one in streaming
+		 * mode, sharing memory with `edge_stack`).
 		 */
 		float *edge_magnitude;
 
 		/**
-		 * \var Array storing edge direction (0, 45, 90 and 135 degrees).
+		 * \var Array storing edge direction (CannyDirectionCode values).
 		 */
 		uint8_t *edge_direction;
 
 		/**
-		 * \var Width of currently processed image, in pixels.
+		 * \var Worklist of edge tracing, `width` * `height` pixel indices.
 		 */
-		unsigned int width;
+		unsigned int *edge_stack;
 
 		/**
-		 * \var Height of currently processed image, in pixels.
+		 * \var Copy of `workspace_bitmap` after suppression of non maximum
+		 * pixels, input of Rethreshold(). NULL unless SetKeepSuppressed() is
+		 * on.
 		 */
-		unsigned int height;
+		uint8_t *suppressed_bitmap;
+
+		/**
+		 * \var True if suppressed image is kept, see SetKeepSuppressed().
+		 */
+		bool keep_suppressed;
+
+		/**
+		 * \var True if `suppressed_bitmap` holds last processed image.
+		 */
+		bool suppressed_valid;
+
+		/**
+		 * \var Result of horizontal pass of Gaussian blur.
+		 */
+		float *blur_buffer;
+
+		/**
+		 * \var Maximum gradient magnitude, used to scale it to 0-255 range
+		 * (its square root for CANNY_GRADIENT_SQUARED).
+		 */
+		float edge_max;
+
+		/**
+		 * \var True in streaming mode.
+		 */
+		bool streaming;
+
+		/**
+		 * \var True if frame mode runs as graph of tasks.
+		 */
+		bool task_scheduling;
+
+		/**
+		 * \var Tasks of frame mode, see TaskImage().
+		 */
+		CannyTaskGraph task_graph;
+
+		/**
+		 * \var Number of strips, rows per strip and half size of Gauss mask
+		 * `task_graph` was built for.
+		 */
+		unsigned int task_strips, task_strip_rows, task_halfsize;
+
+		/**
+		 * \var Maximum gradient magnitude of each strip.
+		 */
+		std::vector<float> strip_max;
+
+		/**
+		 * \var First strong pixel of each band of JoinComponents().
+		 */
+		std::vector<unsigned int> band_seeds;
+
+		/**
+		 * \var True in fixed-point mode.
+		 */
+		bool fixed_point;
+
+		/**
+		 * \var Way of computing gradient magnitude and direction.
+		 */
+		CannyGradient gradient;
 
 		/**
-		 * \var Pixel x coordinate.
+		 * \var Smallest sigma blurred with recursive filter, 0 if none.
 		 */
-		unsigned int x;
+		float recursive_sigma;
 
 		/**
-		 * \var Pixel y coordinate.
+		 * \var Border mode and gray level of constant border.
 		 */
-		unsigned int y;
+		CannyBorder border;
+		uint8_t border_value;
+
+		/**
+		 * \var Ring buffers of streaming mode, one set per band.
+		 */
+		uint8_t *stream_rings;
+
+		/**
+		 * \var Number of ring buffer sets in `stream_rings`.
+		 */
+		unsigned int stream_bands;
+
+		/**
+		 * \var Width of currently processed image, in pixels.
+		 */
+		unsigned int width;
+
+		/**
+		 * \var Height of currently processed image, in pixels.
+		 */
+		unsigned int height;
 
 		/**
 		 * \var Width of Gauss transform mask (kernel).
@@ -135,6 +836,61 @@ class CannyEdgeDetector
 		 */
 		unsigned int mask_halfsize;
 
+		/**
+		 * \var Normalized one-dimensional Gauss kernel of `mask_size` width,
+		 * owned by process-wide cache of kernels.
+		 */
+		const float *gaussian_kernel;
+
+		/**
+		 * \var `gaussian_kernel` quantized for fixed-point mode, with 8
+		 * fractional bits (horizontal pass) followed by same kernel with 15
+		 * fractional bits (vertical pass).
+		 */
+		const uint16_t *gaussian_kernel_fixed;
+
+		/**
+		 * \var Recursive approximation of `gaussian_kernel`, owned by the
+		 * same cache.
+		 */
+		const CannyRecursiveFilter *recursive_filter;
+
+		/**
+		 * \var Width of cached `gaussian_kernel`.
+		 */
+		unsigned int gaussian_kernel_size;
+
+		/**
+		 * \var Sigma value `gaussian_kernel` was calculated for.
+		 */
+		float gaussian_sigma;
+
+		/**
+		 * \var Row kernels for instruction set of current processor.
+		 */
+		const CannyKernels *kernels;
+
+		/**
+		 * \var Workers processing bands of image.
+		 */
+		CannyThreadPool thread_pool;
+
+		/**
+		 * \var Statistics of current call, or NULL.
+		 */
+		CannyStats *stats;
+
+		/**
+		 * \var Trace of stages, or NULL.
+		 */
+		CannyTrace *trace;
+
+		/**
+		 * \var Stage being measured and its start.
+		 */
+		CannyStage stage;
+		std::chrono::steady_clock::time_point stage_begin;
+
 		/**
 		 * \brief Gets value of (x, y) pixel.
 		 *
@@ -158,68 +914,469 @@ class CannyEdgeDetector
 		inline void SetPixelValue(unsigned int x, unsigned int y, uint8_t value);
 
 		/**
-		 * \brief Initializes arrays for use by the algorithm.
+		 * \brief Calculates width of Gauss mask for given sigma.
+		 */
+		static unsigned int MaskSize(float sigma);
+
+		/**
+		 * \brief Calculates arena size needed by image of given size.
+		 *
+		 * In streaming mode `edge_magnitude` takes no chunk of its own, it
+		 * is placed over `edge_stack`.
+		 *
+		 * \param width Width of image.
+		 * \param height Height of image.
+		 * \param mask_size Width of Gauss mask.
+		 */
+		unsigned long ArenaSize(unsigned int width, unsigned int height,
+		                        unsigned int mask_size) const;
+
+		/**
+		 * \brief Calculates size of one set of streaming ring buffers.
+		 *
+		 * \param width Width of enlarged image.
+		 * \param mask_size Width of Gauss mask.
+		 */
+		static unsigned long RingSize(unsigned int width, unsigned int mask_size);
+
+		/**
+		 * \brief Enlarges arena to at least `size` bytes.
+		 */
+		void GrowArena(unsigned long size);
+
+		/**
+		 * \brief Takes arrays used by the algorithm out of arena.
 		 *
 		 * \param sigma Parameter used for calculation of margin that the image
 		 * must be enlarged with.
 		 */
-		void PreProcessImage(float sigma);
+		void AllocateBuffers(float sigma);
+
+		/**
+		 * \brief Returns size of one row of mask, in bytes.
+		 */
+		static size_t MaskRowSize(unsigned int width, CannyMaskFormat format);
+
+		/**
+		 * \brief Tells if image and mask can be processed.
+		 *
+		 * \return False if image or mask is empty or its stride is too small
+		 * for its width.
+		 */
+		static bool IsValid(const CannyImageView &image, const CannyMaskView &mask);
+
+		/**
+		 * \brief Prepares detector for processing of image.
+		 *
+		 * Checks image and mask, remembers them, takes buffers out of arena
+		 * and builds Gauss mask. Steps of the algorithm may be run after.
+		 *
+		 * \param image Source image.
+		 * \param mask Destination mask.
+		 * \param sigma Gaussian function standard deviation.
+		 * \return False if image or mask is invalid, or enlarged image is
+		 * too big for 32-bit indices of `edge_stack`.
+		 */
+		bool BeginImage(const CannyImageView &image, const CannyMaskView &mask,
+		                float sigma);
+
+		/**
+		 * \brief Starts measuring of stage, with instrumentation only.
+		 */
+		inline void BeginStage(CannyStage stage);
+
+		/**
+		 * \brief Ends measuring of stage started last.
+		 */
+		inline void EndStage();
+
+		/**
+		 * \brief Runs all steps up to suppression of non maximum pixels.
+		 *
+		 * Must follow BeginImage(). Leaves suppressed and quantized
+		 * magnitudes in enlarged `workspace_bitmap`.
+		 */
+		void SuppressImage();
+
+		/**
+		 * \brief Runs BeginImage() and SuppressImage(), keeps their result.
+		 *
+		 * With SetKeepSuppressed() on, copy of suppressed image is input of
+		 * Rethreshold(). Workspace is left enlarged, ready for TraceImage().
+		 *
+		 * \return False if image, mask or sigma is invalid.
+		 */
+		bool KeepSuppressed(const CannyImageView &image, const CannyMaskView &mask,
+		                    float sigma);
+
+		/**
+		 * \brief Runs propagation, hysteresis and writes mask.
+		 *
+		 * Must follow SuppressImage().
+		 *
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 */
+		void TraceImage(uint8_t lowThreshold, uint8_t highThreshold);
+
+		/**
+		 * \brief Runs propagation and hysteresis only.
+		 *
+		 * Leaves 255 for edges and 0 elsewhere in enlarged workspace.
+		 *
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 */
+		void TraceEdges(uint8_t lowThreshold, uint8_t highThreshold);
+
+		/**
+		 * \brief Runs all steps but writing of mask, for point outputs.
+		 *
+		 * \return False if image or sigma is invalid, or gradient is asked
+		 * for in streaming mode.
+		 */
+		bool TracePoints(const CannyImageView &image, float sigma, uint8_t lowThreshold,
+		                 uint8_t highThreshold, bool withGradient);
+
+		/**
+		 * \brief Lists edge pixels of traced workspace, row by row.
+		 *
+		 * Replaces PostProcessImage(), cuts margins the same way.
+		 */
+		void CollectPoints(std::vector<CannyEdgePoint> &points, bool withGradient);
+
+		/**
+		 * \brief Links edge pixels of traced workspace into contours.
+		 *
+		 * Replaces PostProcessImage(), cuts margins the same way. Pixels are
+		 * cleared in workspace as they are taken.
+		 */
+		void CollectContours(std::vector<CannyEdgePoint> &points,
+		                     std::vector<unsigned int> &contours, bool withGradient);
+
+		/**
+		 * \brief Takes next pixel of contour, neighbour of given one.
+		 *
+		 * Side neighbours are preferred to diagonal ones, so that contours
+		 * do not cut corners.
+		 *
+		 * \param i Pixel of enlarged workspace, replaced with the neighbour.
+		 * \return False if pixel has no edge neighbour left.
+		 */
+		bool NextContourPixel(unsigned long &i);
+
+		/**
+		 * \brief Returns point of pixel of enlarged workspace.
+		 */
+		CannyEdgePoint EdgePoint(unsigned long i, bool withGradient) const;
+
+		/**
+		 * \brief Enlarges work area and fills its margins.
+		 *
+		 * Margins extend grayscale image as chosen by SetBorder(). Work area
+		 * keeps its enlarged size, but image itself is not copied into it:
+		 * blur reads it in place and writes its result inside margins.
+		 */
+		void PreProcessImage();
+
+		/**
+		 * \brief Copies grayscale image inside margins of work area.
+		 *
+		 * Only for CannyIncrementalProcessor, which compares whole enlarged
+		 * frames. Called after PreProcessImage().
+		 */
+		void CopyImage();
+
+		/**
+		 * \brief Returns first row of grayscale image, source image itself
+		 * if it is gray. Called once work area is enlarged.
+		 *
+		 * \param stride Distance between rows, in bytes.
+		 */
+		const uint8_t *GrayImage(size_t &stride) const;
 
 		/**
-		 * \brief Cuts margins and returns image of original size.
+		 * \brief Fills margins of one row of work area.
+		 *
+		 * \param row Row of grayscale image.
+		 * \param target First pixel inside margins; `mask_halfsize` pixels
+		 * before it and after `length` pixels are written.
+		 * \param length Width of image.
+		 */
+		void ExtendRow(const uint8_t *row, uint8_t *target, unsigned int length) const;
+
+		/**
+		 * \brief Horizontal pass of Gauss filter over one image row.
+		 *
+		 * Kernel reads row in place where mask fits into it. Only pixels
+		 * near ends of row are copied inside margins of work area row,
+		 * which must be filled already, and blurred there.
+		 *
+		 * \param row Row of grayscale image.
+		 * \param x Row of work area, and of `blur_buffer` result goes to.
+		 */
+		void BlurRow(const uint8_t *row, unsigned long x);
+
+		/**
+		 * \brief Cuts margins and writes image of original size into mask.
 		 */
 		void PostProcessImage();
 
+		/**
+		 * \brief Writes rectangle of traced image into mask.
+		 *
+		 * Used instead of PostProcessImage() by ProcessRegions() and
+		 * CannyIncrementalProcessor. Other
+		 * pixels of mask are kept, unused bits of 1-bit mask are cleared
+		 * when rectangle reaches last pixel of row.
+		 *
+		 * \param region Size of rectangle.
+		 * \param pixels First pixel of rectangle.
+		 * \param stride Distance between rows of `pixels`.
+		 * \param mask Destination mask.
+		 * \param mask_width Width of mask, in pixels.
+		 * \param mask_row Row of mask rectangle goes to.
+		 * \param mask_column Column of mask rectangle goes to.
+		 */
+		void WriteRegion(const CannyRegion &region, const uint8_t *pixels,
+		                 size_t stride, const CannyMaskView &mask,
+		                 unsigned int mask_width, unsigned int mask_row,
+		                 unsigned int mask_column);
+
 		/**
 		 * \brief Converts image to grayscale.
 		 *
 		 * Information of chrominance are useless, we only need grayscale image.
+		 * Result is stored in `gray_bitmap`, source image is left intact. Not
+		 * needed for gray images.
 		 */
 		void Luminance();
 
+		/**
+		 * \brief Finds normalized one-dimensional Gauss mask.
+		 *
+		 * Both floating-point and quantized kernels are built once per sigma
+		 * and shared by all detectors of the process.
+		 *
+		 * \param sigma Gaussian function standard deviation.
+		 */
+		void BuildGaussianKernel(float sigma);
+
 		/**
 		 * \brief Convolves image with Gauss filter - performs Gaussian blur.
 		 *
-		 * This step performs noise reduction algorithm.
+		 * This step performs noise reduction algorithm. Gauss function is
+		 * separable, so image is convolved with one-dimensional kernel twice,
+		 * horizontally and then vertically. Cost per pixel is linear in mask
+		 * size instead of quadratic. Kernel is normalized and reused as long
+		 * as sigma does not change, see BuildGaussianKernel().
 		 *
-		 * \param sigma Gaussian function standard deviation. The higher value,
-		 * the stronger blur.
+		 * Result is within one gray level (rounding) of exact two-dimensional
+		 * convolution with normalized mask. It is not comparable pixel by
+		 * pixel with former implementation, whose mask was not normalized
+		 * (at sigma 2 image got about 25% darker) and was applied in place,
+		 * so already blurred pixels leaked into their neighbours. Gradient
+		 * magnitude is normalized later on, so thresholds keep their meaning.
 		 */
-		void GaussianBlur(float sigma);
+		void GaussianBlur();
+
+		/**
+		 * \brief Blurs image with exact mask or recursive filter, depending
+		 * on sigma, see SetRecursiveSigma().
+		 */
+		void BlurImage();
+
+		/**
+		 * \brief Tells if BlurImage() uses recursive filter for current
+		 * image.
+		 */
+		bool UsesRecursiveBlur() const;
+
+		/**
+		 * \brief Performs Gaussian blur with recursive filter.
+		 *
+		 * Replaces GaussianBlur() for sigmas from `recursive_sigma` on, if
+		 * margin is at least three pixels wide. Horizontal pass filters
+		 * strips of rows of gray image transposed into `edge_magnitude`
+		 * (not used before Sobel), so that vectorized kernel filters several
+		 * rows at once, and transposes them back into `blur_buffer`. Vertical pass filters
+		 * `blur_buffer` in place, row by row, and rounds pixels into
+		 * workspace. Filter states at the ends are kept in margins. Image
+		 * borders are extended with replicated pixels to infinity, margin
+		 * of workspace is left untouched.
+		 */
+		void RecursiveBlur();
 
 		/**
 		 * \brief Calculates magnitude and direction of image gradient.
 		 *
 		 * Method saves results in two arrays, edge_magnitude and
-		 * edge_direction.
+		 * edge_direction, and maximum magnitude in edge_max. Sobel masks are
+		 * applied with 16-bit integer arithmetic, centered on each pixel.
+		 * Outermost pixels of workspace get no gradient.
 		 */
 		void EdgeDetection();
 
+		/**
+		 * \brief Returns Sobel kernel of current gradient mode.
+		 */
+		CannySobelKernel SobelKernel() const;
+
 		/**
 		 * \brief Deletes non-max pixels from gradient magnitude map.
 		 *
 		 * By using edge direction information this method looks for local
 		 * maxima of gradient magnitude. As a result we get map with edges
-		 * of 1 pixel width.
+		 * of 1 pixel width, scaled to range of 0-255.
 		 */
 		void NonMaxSuppression();
 
+		/**
+		 * \brief Suppresses non maximum pixels of rectangle of workspace.
+		 *
+		 * Same as NonMaxSuppression() for pixels inside rectangle, which
+		 * must not include outermost pixels. Runs on calling thread only.
+		 *
+		 * \param first_row First row of rectangle.
+		 * \param last_row One past last row.
+		 * \param first_column First column of rectangle.
+		 * \param last_column One past last column.
+		 */
+		void SuppressRect(unsigned long first_row, unsigned long last_row,
+		                  unsigned long first_column, unsigned long last_column);
+
+		/**
+		 * \brief Runs all steps up to suppression as graph of tasks.
+		 *
+		 * Leaves the same workspace as NonMaxSuppression() does, see
+		 * SetTaskScheduling().
+		 */
+		void TaskImage();
+
+		/**
+		 * \brief Builds graph of TaskImage() for given strips.
+		 *
+		 * \param strips Number of strips of enlarged image.
+		 * \param strip_rows Rows of each strip (last one may be shorter).
+		 * \param halfsize Half size of Gauss mask.
+		 */
+		void BuildTaskGraph(unsigned int strips, unsigned int strip_rows,
+		                    unsigned int halfsize);
+
+		/**
+		 * \brief Runs one task of TaskImage().
+		 *
+		 * \param task Number of task, see BuildTaskGraph().
+		 */
+		void RunTask(unsigned int task);
+
+		/**
+		 * \brief Runs all steps up to suppression in streaming mode.
+		 *
+		 * Leaves the same workspace as NonMaxSuppression() does in frame
+		 * mode.
+		 */
+		void StreamImage();
+
+		/**
+		 * \brief Streams one band of rows through ring buffers.
+		 *
+		 * \param band Number of band, selects set of ring buffers.
+		 * \param first First row of enlarged image to be suppressed.
+		 * \param last One past last row.
+		 * \return Maximum gradient magnitude seen by the band.
+		 */
+		float StreamBand(unsigned int band, unsigned int first, unsigned int last);
+
+		/**
+		 * \brief Promotes 128 valued pixels connected with 255 valued ones.
+		 *
+		 * Done in one pass over `edge_stack` worklist, remaining 128 valued
+		 * pixels are suppressed. With more than one thread components are
+		 * labeled in parallel instead, see ParallelPropagation().
+		 */
+		void PropagateEdges();
+
 		/**
 		 * \brief Performs hysteresis thresholding between two values.
 		 *
+		 * With more than one thread, and lower threshold not above upper
+		 * one, components are labeled in parallel, see
+		 * ParallelHysteresis().
+		 *
 		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
 		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
 		 */
 		void Hysteresis(uint8_t lowThreshold, uint8_t highThreshold);
 
+		/**
+		 * \brief Joins candidate pixels of rectangle into connected
+		 * components, and all components holding strong pixel into one.
+		 *
+		 * Union-find forest is kept in `edge_stack`, each candidate pixel
+		 * pointing towards root of its component, which is never after it.
+		 * Each thread joins pixels of its own band of rows without locking,
+		 * then components meeting at borders of bands are joined with
+		 * compare-and-swap on roots. Strong pixels of each band are joined
+		 * together first, then with strong pixel of first band holding any.
+		 * Entries of other pixels are left undefined.
+		 *
+		 * \param first_row First row of rectangle.
+		 * \param last_row One past last row.
+		 * \param first_column First column of rectangle.
+		 * \param last_column One past last column.
+		 * \param diagonal True to connect only diagonal neighbours (as
+		 * HysteresisTrace() does), false for all eight.
+		 * \param candidate Tells from value if pixel may be part of edge,
+		 * `candidate(value)`.
+		 * \param strong Tells from value if candidate pixel makes its
+		 * component an edge, `strong(value)`.
+		 * \return Root of strong components, UINT_MAX if there are none.
+		 */
+		template <typename Candidate, typename Strong>
+		unsigned int JoinComponents(unsigned long first_row, unsigned long last_row,
+		                            unsigned int first_column, unsigned int last_column,
+		                            bool diagonal, const Candidate &candidate,
+		                            const Strong &strong);
+
+		/**
+		 * \brief PropagateEdges() run on all threads.
+		 *
+		 * Inside outermost frame 128 and 255 valued pixels are joined with
+		 * JoinComponents(), 128 valued ones become 255 if their component
+		 * holds 255 valued pixel. Pixels of the frame become 255 if they
+		 * touch such component, as worklist of PropagateEdges() promotes
+		 * them but does not follow them. Result is the same.
+		 */
+		void ParallelPropagation();
+
+		/**
+		 * \brief Hysteresis() run on all threads.
+		 *
+		 * Pixels above lower threshold are joined with JoinComponents()
+		 * over diagonal neighbours, and those of components holding pixel
+		 * above upper threshold become edges. This is what HysteresisTrace()
+		 * gives whenever lower threshold is not above upper one, as order
+		 * of seeds does not matter then.
+		 *
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 */
+		void ParallelHysteresis(uint8_t lowThreshold, uint8_t highThreshold);
+
 		/**
 		 * \brief Support method in hysteresis thresholding operation.
 		 *
-		 * \param x Pixel x coordinate.
-		 * \param y Pixel y coordinate.
+		 * Follows weak pixels connected with `seed`. Uses explicit stack
+		 * (`edge_stack`) instead of recursion, so edges of any length do not
+		 * overflow call stack.
+		 *
+		 * \param seed Index of strong pixel in `workspace_bitmap`.
 		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis, only tells weak
+		 * pixels from strong ones in statistics.
 		 */
-		void HysteresisRecursion(long x, long y, uint8_t lowThreshold);
+		void HysteresisTrace(unsigned int seed, uint8_t lowThreshold, uint8_t highThreshold);
 };
 
 #endif // #ifndef _CANNYEDGEDETECTOR_H_
@@ -0,0 +1,277 @@
+/**
+ * \file      CannyImageIO.cpp
+ * \brief     Reading and writing of PGM/PPM/PBM images.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CannyImageIO.h"
+
+CannyImageView CannyImage::View() const
+{
+	CannyImageView view = {pixels.data(), width, height,
+	                       (size_t) width * CannyPixelSize(format), format};
+	return view;
+}
+
+/**
+ * \brief Reads one decimal number of PNM header, skipping comments.
+ */
+static bool ReadHeaderValue(FILE *file, unsigned long &value)
+{
+	int c = fgetc(file);
+
+	for (;;) {
+		if (c == '#') {
+			while (c != '\n' && c != EOF) {
+				c = fgetc(file);
+			}
+		} else if (isspace(c)) {
+			c = fgetc(file);
+		} else {
+			break;
+		}
+	}
+	if (!isdigit(c)) {
+		return false;
+	}
+
+	value = 0;
+	while (isdigit(c)) {
+		value = value * 10 + (c - '0');
+		if (value > 1000000) {
+			return false;
+		}
+		c = fgetc(file);
+	}
+
+	// Single whitespace ends the value, the last one separates header
+	// from pixels.
+	return isspace(c);
+}
+
+/**
+ * \brief Reads PNM header, leaves file at first pixel.
+ */
+static bool ReadHeader(FILE *file, unsigned int &width, unsigned int &height,
+                       CannyPixelFormat &format)
+{
+	unsigned long header_width, header_height, max_value;
+
+	if (fgetc(file) != 'P') {
+		return false;
+	}
+
+	int type = fgetc(file);
+	if ((type == '5' || type == '6') &&
+	    ReadHeaderValue(file, header_width) && ReadHeaderValue(file, header_height) &&
+	    ReadHeaderValue(file, max_value) &&
+	    header_width > 0 && header_height > 0 && max_value == 255) {
+		width = header_width;
+		height = header_height;
+		format = type == '5' ? CANNY_PIXEL_GRAY8 : CANNY_PIXEL_RGB24;
+		return true;
+	}
+
+	return false;
+}
+
+bool CannyReadPNMHeader(const std::string &path, unsigned int &width,
+                        unsigned int &height, CannyPixelFormat &format,
+                        size_t &offset)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	bool result;
+
+	if (file == NULL) {
+		return false;
+	}
+
+	result = ReadHeader(file, width, height, format);
+	if (result) {
+		long position = ftell(file);
+		result = position > 0;
+		offset = position;
+	}
+
+	fclose(file);
+	return result;
+}
+
+bool CannyReadPNM(const std::string &path, CannyImage &image)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	bool result = false;
+
+	if (file == NULL) {
+		return false;
+	}
+
+	if (ReadHeader(file, image.width, image.height, image.format)) {
+		image.pixels.resize((size_t) image.width * image.height * CannyPixelSize(image.format));
+		result = fread(image.pixels.data(), 1, image.pixels.size(), file) == image.pixels.size();
+	}
+
+	fclose(file);
+	return result;
+}
+
+std::string CannyPNMMaskHeader(unsigned int width, unsigned int height,
+                               CannyMaskFormat format)
+{
+	char header[64];
+
+	if (format == CANNY_MASK_BIT1) {
+		snprintf(header, sizeof(header), "P4\n%u %u\n", width, height);
+	} else {
+		snprintf(header, sizeof(header), "P5\n%u %u\n255\n", width, height);
+	}
+	return header;
+}
+
+bool CannyWritePNM(const std::string &path, const uint8_t *mask,
+                   unsigned int width, unsigned int height,
+                   CannyMaskFormat format)
+{
+	FILE *file = fopen(path.c_str(), "wb");
+	std::string header = CannyPNMMaskHeader(width, height, format);
+	size_t size;
+	bool result;
+
+	if (file == NULL) {
+		return false;
+	}
+
+	if (format == CANNY_MASK_BIT1) {
+		size = (size_t) (width + 7) / 8 * height;
+	} else {
+		size = (size_t) width * height;
+	}
+	result = fwrite(header.data(), 1, header.size(), file) == header.size() &&
+	         fwrite(mask, 1, size, file) == size;
+
+	return (fclose(file) == 0) && result;
+}
+
+CannyMappedFile::CannyMappedFile()
+{
+	data = NULL;
+	size = 0;
+}
+
+CannyMappedFile::~CannyMappedFile()
+{
+	this->Close();
+}
+
+bool CannyMappedFile::Map(int descriptor, size_t size, bool writable)
+{
+	void *mapped = MAP_FAILED;
+
+	if (size > 0) {
+		mapped = mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+		              MAP_SHARED, descriptor, 0);
+	}
+	close(descriptor);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	data = (uint8_t *) mapped;
+	this->size = size;
+	return true;
+}
+
+bool CannyMappedFile::Open(const std::string &path)
+{
+	struct stat status;
+
+	this->Close();
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+	if (fstat(descriptor, &status) != 0) {
+		close(descriptor);
+		return false;
+	}
+
+	return this->Map(descriptor, status.st_size, false);
+}
+
+bool CannyMappedFile::Create(const std::string &path, size_t size)
+{
+	this->Close();
+	int descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (descriptor < 0) {
+		return false;
+	}
+	if (ftruncate(descriptor, size) != 0) {
+		close(descriptor);
+		return false;
+	}
+
+	return this->Map(descriptor, size, true);
+}
+
+bool CannyMappedFile::CreateTemporary(const std::string &directory, size_t size)
+{
+	std::string path = directory + "/canny-XXXXXX";
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back('\0');
+
+	this->Close();
+	int descriptor = mkstemp(name.data());
+	if (descriptor < 0) {
+		return false;
+	}
+	// File lives only as long as it is mapped.
+	unlink(name.data());
+	if (ftruncate(descriptor, size) != 0) {
+		close(descriptor);
+		return false;
+	}
+
+	return this->Map(descriptor, size, true);
+}
+
+void CannyMappedFile::Close()
+{
+	if (data != NULL) {
+		munmap(data, size);
+	}
+	data = NULL;
+	size = 0;
+}
+
+uint8_t *CannyMappedFile::Data() const
+{
+	return data;
+}
+
+size_t CannyMappedFile::Size() const
+{
+	return size;
+}
+
+void CannyMappedFile::Release(const uint8_t *begin, const uint8_t *end)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long first = (unsigned long) begin / page * page;
+	unsigned long last = ((unsigned long) end + page - 1) / page * page;
+
+	if (data != NULL && first < last) {
+		madvise((void *) first, last - first, MADV_DONTNEED);
+	}
+}
@@ -0,0 +1,192 @@
+/**
+ * \file      CannyImageIO.h
+ * \brief     Reading and writing of PGM/PPM/PBM images, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYIMAGEIO_H_
+#define _CANNYIMAGEIO_H_
+
+#include <string>
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+
+/**
+ * \brief Image owning its pixels, packed rows.
+ */
+struct CannyImage
+{
+	/**
+	 * \var Pixels, `height` rows of `width` * pixel size bytes.
+	 */
+	std::vector<uint8_t> pixels;
+
+	/**
+	 * \var Size of image, in pixels.
+	 */
+	unsigned int width, height;
+
+	/**
+	 * \var Layout of pixels.
+	 */
+	CannyPixelFormat format;
+
+	/**
+	 * \brief Returns view of the image, as accepted by detector.
+	 */
+	CannyImageView View() const;
+};
+
+/**
+ * \brief File mapped into memory, for images bigger than memory.
+ *
+ * Pages are read from (and written back to) file by the system on demand,
+ * so only pages touched recently take memory. Release() gives pages no
+ * longer needed back at once.
+ */
+class CannyMappedFile
+{
+	public:
+		/**
+		 * \brief Constructor, nothing is mapped.
+		 */
+		CannyMappedFile();
+
+		/**
+		 * \brief Destructor, unmaps file.
+		 */
+		~CannyMappedFile();
+
+		/**
+		 * \brief Maps existing file, for reading only.
+		 *
+		 * \param path Name of file.
+		 * \return False if file cannot be opened or mapped, or is empty.
+		 */
+		bool Open(const std::string &path);
+
+		/**
+		 * \brief Creates (or truncates) file of given size and maps it for
+		 * reading and writing. New file is filled with zeros.
+		 *
+		 * \param path Name of file.
+		 * \param size Size of file, in bytes.
+		 * \return False if file cannot be created or mapped.
+		 */
+		bool Create(const std::string &path, size_t size);
+
+		/**
+		 * \brief Maps temporary file, removed as soon as it is created.
+		 *
+		 * \param directory Directory file is created in.
+		 * \param size Size of file, in bytes.
+		 * \return False if file cannot be created or mapped.
+		 */
+		bool CreateTemporary(const std::string &directory, size_t size);
+
+		/**
+		 * \brief Unmaps file, changes are written back by the system.
+		 */
+		void Close();
+
+		/**
+		 * \brief Returns first byte of file, NULL if nothing is mapped.
+		 */
+		uint8_t *Data() const;
+
+		/**
+		 * \brief Returns size of file, in bytes.
+		 */
+		size_t Size() const;
+
+		/**
+		 * \brief Drops pages of given range from memory of process.
+		 *
+		 * Pages are dropped whole, so bytes next to the range sharing pages
+		 * with it are dropped as well. Content is kept by file and read
+		 * again when accessed.
+		 *
+		 * \param begin First byte of range.
+		 * \param end One past last byte of range.
+		 */
+		void Release(const uint8_t *begin, const uint8_t *end);
+
+	private:
+		CannyMappedFile(const CannyMappedFile &);
+		CannyMappedFile &operator=(const CannyMappedFile &);
+
+		/**
+		 * \brief Maps open file descriptor, which is closed afterwards.
+		 */
+		bool Map(int descriptor, size_t size, bool writable);
+
+		/**
+		 * \var Mapped bytes.
+		 */
+		uint8_t *data;
+
+		/**
+		 * \var Number of mapped bytes.
+		 */
+		size_t size;
+};
+
+/**
+ * \brief Reads header of binary PGM (P5) or PPM (P6) file.
+ *
+ * \param path Name of file.
+ * \param width Width of image.
+ * \param height Height of image.
+ * \param format CANNY_PIXEL_GRAY8 for PGM, CANNY_PIXEL_RGB24 for PPM.
+ * \param offset Position of first pixel in file, in bytes.
+ * \return False if file cannot be read or is not supported.
+ */
+bool CannyReadPNMHeader(const std::string &path, unsigned int &width,
+                        unsigned int &height, CannyPixelFormat &format,
+                        size_t &offset);
+
+/**
+ * \brief Reads binary PGM (P5) or PPM (P6) file with maximum value 255.
+ *
+ * PGM gives CANNY_PIXEL_GRAY8 image, PPM gives CANNY_PIXEL_RGB24 one, so
+ * pixels are never converted.
+ *
+ * \param path Name of file.
+ * \param image Image read. Its buffer is reused, if big enough.
+ * \return False if file cannot be read or is not supported.
+ */
+bool CannyReadPNM(const std::string &path, CannyImage &image);
+
+/**
+ * \brief Writes edge mask as binary PGM (P5) or PBM (P4) file.
+ *
+ * CANNY_MASK_GRAY8 mask is written as PGM, CANNY_MASK_BIT1 as PBM. Note
+ * that in PBM set bits are black, so edges are drawn black on white.
+ *
+ * \param path Name of file.
+ * \param mask Mask, rows packed with no padding.
+ * \param width Width of mask, in pixels.
+ * \param height Height of mask, in pixels.
+ * \param format CANNY_MASK_GRAY8 or CANNY_MASK_BIT1.
+ * \return False if file cannot be written.
+ */
+bool CannyWritePNM(const std::string &path, const uint8_t *mask,
+                   unsigned int width, unsigned int height,
+                   CannyMaskFormat format);
+
+/**
+ * \brief Returns header of PGM (P5) or PBM (P4) file written for mask.
+ *
+ * \param width Width of mask, in pixels.
+ * \param height Height of mask, in pixels.
+ * \param format CANNY_MASK_GRAY8 or CANNY_MASK_BIT1.
+ */
+std::string CannyPNMMaskHeader(unsigned int width, unsigned int height,
+                               CannyMaskFormat format);
+
+#endif // #ifndef _CANNYIMAGEIO_H_
@@ -0,0 +1,642 @@
+/**
+ * \file      CannyIncrementalProcessor.cpp
+ * \brief     Edge detection in frames of static scenes.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "CannyIncrementalProcessor.h"
+
+/**
+ * \brief Tells if pixel belongs to components of given tracing step.
+ */
+static inline bool IsNode(uint8_t value, bool hysteresis, uint8_t lowThreshold)
+{
+	return hysteresis ? value >= lowThreshold : value == 128 || value == 255;
+}
+
+/**
+ * \brief Calls function with index of each neighbour of pixel, all eight
+ * or diagonal ones only.
+ */
+template <typename Function>
+static inline void ForNeighbours(unsigned int i, unsigned int width, unsigned int height,
+                                 bool diagonal, const Function &function)
+{
+	long x = i / width;
+	long y = i % width;
+
+	for (long x1 = x - 1; x1 <= x + 1; x1++) {
+		for (long y1 = y - 1; y1 <= y + 1; y1++) {
+			if ((x1 == x && y1 == y) || (diagonal && (x1 == x || y1 == y))) {
+				continue;
+			}
+			if ((x1 >= 0) & (y1 >= 0) & (x1 < height) & (y1 < width)) {
+				function((unsigned int) (x1 * width + y1));
+			}
+		}
+	}
+}
+
+CannyIncrementalProcessor::CannyIncrementalProcessor()
+{
+	tile_size = 64;
+	tile_rows = tile_columns = 0;
+	changed_tile_count = 0;
+	valid = false;
+	width = height = 0;
+	sigma = 0.0f;
+	low_threshold = high_threshold = 0;
+	edge_max = 0.0f;
+	memset(&mask, 0, sizeof(mask));
+	// Suppressed image of last frame is compared with next one.
+	detector.SetKeepSuppressed(true);
+}
+
+void CannyIncrementalProcessor::SetTileSize(unsigned int size)
+{
+	tile_size = size < 8 ? 8 : size;
+	this->Reset();
+}
+
+unsigned int CannyIncrementalProcessor::GetTileSize() const
+{
+	return tile_size;
+}
+
+void CannyIncrementalProcessor::SetThreadCount(unsigned int count)
+{
+	detector.SetThreadCount(count);
+}
+
+void CannyIncrementalProcessor::SetFixedPoint(bool fixed_point)
+{
+	detector.SetFixedPoint(fixed_point);
+	this->Reset();
+}
+
+void CannyIncrementalProcessor::SetGradient(CannyGradient gradient)
+{
+	detector.SetGradient(gradient);
+	this->Reset();
+}
+
+void CannyIncrementalProcessor::SetRecursiveSigma(float min_sigma)
+{
+	detector.SetRecursiveSigma(min_sigma);
+	this->Reset();
+}
+
+void CannyIncrementalProcessor::SetBorder(CannyBorder border, uint8_t value)
+{
+	detector.SetBorder(border, value);
+	this->Reset();
+}
+
+void CannyIncrementalProcessor::Reset()
+{
+	valid = false;
+}
+
+unsigned long CannyIncrementalProcessor::GetTileCount() const
+{
+	return tile_rows * tile_columns;
+}
+
+unsigned long CannyIncrementalProcessor::GetChangedTileCount() const
+{
+	return changed_tile_count;
+}
+
+bool CannyIncrementalProcessor::ProcessFrame(const CannyImageView &image,
+                                             const CannyMaskView &mask, float sigma,
+                                             uint8_t lowThreshold, uint8_t highThreshold)
+{
+	CannyEdgeDetector &d = detector;
+
+	/*
+	 * Checking arguments and preparing buffers. Buffers moved by growing
+	 * arena have lost what they kept.
+	 */
+	unsigned long allocations = d.GetAllocationCount();
+	if (!d.BeginImage(image, mask, sigma)) {
+		return false;
+	}
+	bool whole = !valid || allocations != d.GetAllocationCount() ||
+	             image.width != width || image.height != height || sigma != this->sigma;
+
+	unsigned int halfsize = d.mask_halfsize;
+	unsigned long enlarged_width = image.width + 2 * halfsize;
+	unsigned long enlarged_height = image.height + 2 * halfsize;
+	tile_rows = (enlarged_height + tile_size - 1) / tile_size;
+	tile_columns = (enlarged_width + tile_size - 1) / tile_size;
+
+	// Each pixel blurred with recursive filter depends on whole row and
+	// column, there is nothing to save.
+	if (d.UsesRecursiveBlur()) {
+		valid = false;
+		changed_tile_count = tile_rows * tile_columns;
+		return d.ProcessImage(image, mask, sigma, lowThreshold, highThreshold);
+	}
+
+	width = image.width;
+	height = image.height;
+	this->sigma = sigma;
+
+	if (whole) {
+		size_t size = enlarged_width * enlarged_height;
+		gray.resize(size);
+		blurred.resize(size);
+		propagated.resize(size);
+		traced.resize(size);
+		marks.assign(size, 0);
+		changed_rows.resize(enlarged_height);
+		tile_max.assign(tile_rows * tile_columns, 0.0f);
+
+		// Outermost pixels are never touched by tiles, they have no
+		// gradient.
+		memset(d.edge_magnitude, 0, size * sizeof(float));
+		memset(d.edge_direction, 0, size);
+		memset(d.suppressed_bitmap, 0, size);
+	}
+
+	/*
+	 * Conversion to grayscale and "widening", as in ProcessImage(), then
+	 * comparison with previous frame. Unlike ProcessImage(), image is
+	 * copied inside margins, so whole enlarged frames can be compared.
+	 */
+	if (image.format != CANNY_PIXEL_GRAY8) {
+		d.Luminance();
+	}
+	d.PreProcessImage();
+	d.CopyImage();
+	this->FindChangedTiles(whole);
+
+	/*
+	 * Blur, Sobel and suppression of changed tiles, each step with halo its
+	 * result depends on.
+	 */
+	this->ListTiles(halfsize, blur_tiles);
+	this->BlurTiles(blur_tiles);
+
+	this->ListTiles(halfsize + 1, sobel_tiles);
+	this->SobelTiles(sobel_tiles);
+
+	float max = 0.0f;
+	for (size_t i = 0; i < tile_max.size(); i++) {
+		max = tile_max[i] > max ? tile_max[i] : max;
+	}
+	d.edge_max = max > 0.0f ? max : 1.0f;
+	if (d.gradient == CANNY_GRADIENT_SQUARED) {
+		d.edge_max = sqrtf(d.edge_max);
+	}
+
+	// All suppressed pixels are scaled with maximum.
+	if (whole || d.edge_max != edge_max) {
+		suppress_tiles.resize(tile_rows * tile_columns);
+		for (unsigned long i = 0; i < suppress_tiles.size(); i++) {
+			suppress_tiles[i] = i;
+		}
+	} else {
+		this->ListTiles(halfsize + 2, suppress_tiles);
+	}
+	this->SuppressTiles(suppress_tiles);
+	edge_max = d.edge_max;
+
+	/*
+	 * Tracing of edges. Whole frame is traced when it is cheaper or
+	 * thresholds are not those previous edges were traced with.
+	 */
+	bool retrace = whole || lowThreshold != low_threshold ||
+	               highThreshold != high_threshold || lowThreshold > highThreshold;
+	if (!retrace) {
+		this->FindChangedPixels(suppress_tiles);
+		retrace = changed_pixels.size() > enlarged_width * enlarged_height / 16;
+	}
+	if (retrace) {
+		this->StoreTiles(suppress_tiles);
+		this->TraceFrame(lowThreshold, highThreshold);
+	} else {
+		this->TraceChanged(lowThreshold, highThreshold);
+	}
+	low_threshold = lowThreshold;
+	high_threshold = highThreshold;
+
+	/*
+	 * Changed rows go to mask, or all of them if mask is not the one
+	 * previous edges were written into.
+	 */
+	bool new_mask = mask.data != this->mask.data || mask.stride != this->mask.stride ||
+	                mask.format != this->mask.format;
+	this->WriteMask(mask, retrace || new_mask);
+	this->mask = mask;
+
+	valid = true;
+	return true;
+}
+
+void CannyIncrementalProcessor::FindChangedTiles(bool whole)
+{
+	CannyEdgeDetector &d = detector;
+	unsigned long count = tile_rows * tile_columns;
+
+	changed_tiles.assign(count, whole);
+	if (whole) {
+		memcpy(gray.data(), d.workspace_bitmap, gray.size());
+		changed_tile_count = count;
+		return;
+	}
+
+	// Rows that differ are copied at once, so previous frame is ready for
+	// next comparison.
+	d.thread_pool.ParallelFor(0, count, [&](unsigned long first, unsigned long last) {
+		for (unsigned long tile = first; tile < last; tile++) {
+			unsigned long first_row, last_row, first_column, last_column;
+			this->TileRect(tile, 0, 0, first_row, last_row, first_column, last_column);
+
+			for (unsigned long x = first_row; x < last_row; x++) {
+				unsigned long i = x * d.width + first_column;
+				if (memcmp(gray.data() + i, d.workspace_bitmap + i, last_column - first_column) != 0) {
+					memcpy(gray.data() + i, d.workspace_bitmap + i, last_column - first_column);
+					changed_tiles[tile] = 1;
+				}
+			}
+		}
+	});
+
+	changed_tile_count = std::count(changed_tiles.begin(), changed_tiles.end(), 1);
+}
+
+void CannyIncrementalProcessor::ListTiles(unsigned int reach,
+                                          std::vector<unsigned long> &list) const
+{
+	long distance = (reach + tile_size - 1) / tile_size;
+
+	list.clear();
+	for (long row = 0; row < (long) tile_rows; row++) {
+		for (long column = 0; column < (long) tile_columns; column++) {
+			bool near = false;
+			for (long x = std::max(row - distance, 0L);
+			     x <= std::min(row + distance, (long) tile_rows - 1) && !near; x++) {
+				for (long y = std::max(column - distance, 0L);
+				     y <= std::min(column + distance, (long) tile_columns - 1); y++) {
+					near |= changed_tiles[x * tile_columns + y] != 0;
+				}
+			}
+			if (near) {
+				list.push_back(row * tile_columns + column);
+			}
+		}
+	}
+}
+
+bool CannyIncrementalProcessor::TileRect(unsigned long tile, unsigned int row_margin,
+                                         unsigned int column_margin, unsigned long &first_row,
+                                         unsigned long &last_row, unsigned long &first_column,
+                                         unsigned long &last_column) const
+{
+	unsigned long rows = detector.height;
+	unsigned long columns = detector.width;
+
+	first_row = tile / tile_columns * tile_size;
+	last_row = std::min(first_row + tile_size, rows - row_margin);
+	first_row = std::max(first_row, (unsigned long) row_margin);
+	first_column = tile % tile_columns * tile_size;
+	last_column = std::min(first_column + tile_size, columns - column_margin);
+	first_column = std::max(first_column, (unsigned long) column_margin);
+
+	return first_row < last_row && first_column < last_column;
+}
+
+void CannyIncrementalProcessor::BlurTiles(const std::vector<unsigned long> &list)
+{
+	CannyEdgeDetector &d = detector;
+	unsigned int halfsize = d.mask_halfsize;
+	unsigned long stride = d.width;
+
+	uint16_t *blur_buffer_fixed = (uint16_t *) d.blur_buffer;
+	const uint16_t *horizontal_fixed = d.gaussian_kernel_fixed;
+	const uint16_t *vertical_fixed = d.gaussian_kernel_fixed + d.mask_size;
+
+	// Horizontal pass, into the same buffer as GaussianBlur() uses. Sums
+	// outside of listed tiles are still those of previous frames.
+	d.thread_pool.ParallelFor(0, list.size(), [&](unsigned long first, unsigned long last) {
+		for (unsigned long t = first; t < last; t++) {
+			unsigned long first_row, last_row, first_column, last_column;
+			if (!this->TileRect(list[t], 0, halfsize, first_row, last_row, first_column, last_column)) {
+				continue;
+			}
+
+			for (unsigned long x = first_row; x < last_row; x++) {
+				unsigned long i = x * stride + first_column;
+				if (d.fixed_point) {
+					d.kernels->blur_horizontal_fixed(d.workspace_bitmap + i, blur_buffer_fixed + i,
+					                                 last_column - first_column,
+					                                 horizontal_fixed, halfsize);
+				} else {
+					d.kernels->blur_horizontal(d.workspace_bitmap + i, d.blur_buffer + i,
+					                           last_column - first_column,
+					                           d.gaussian_kernel, halfsize);
+				}
+			}
+		}
+	});
+
+	// Vertical pass. Margin pixels are not blurred, they are copied.
+	d.thread_pool.ParallelFor(0, list.size(), [&](unsigned long first, unsigned long last) {
+		for (unsigned long t = first; t < last; t++) {
+			unsigned long first_row, last_row, first_column, last_column;
+			this->TileRect(list[t], 0, 0, first_row, last_row, first_column, last_column);
+			unsigned long inner_first = std::max(first_column, (unsigned long) halfsize);
+			unsigned long inner_last = std::min(last_column, stride - halfsize);
+
+			for (unsigned long x = first_row; x < last_row; x++) {
+				unsigned long row = x * stride;
+				if (x < halfsize || x >= d.height - halfsize || inner_first >= inner_last) {
+					memcpy(blurred.data() + row + first_column, d.workspace_bitmap + row + first_column,
+					       last_column - first_column);
+					continue;
+				}
+
+				memcpy(blurred.data() + row + first_column, d.workspace_bitmap + row + first_column,
+				       inner_first - first_column);
+				memcpy(blurred.data() + row + inner_last, d.workspace_bitmap + row + inner_last,
+				       last_column - inner_last);
+				if (d.fixed_point) {
+					d.kernels->blur_vertical_fixed(blur_buffer_fixed + row + inner_first, stride,
+					                               blurred.data() + row + inner_first,
+					                               inner_last - inner_first, vertical_fixed,
+					                               halfsize);
+				} else {
+					d.kernels->blur_vertical(d.blur_buffer + row + inner_first, stride,
+					                         blurred.data() + row + inner_first,
+					                         inner_last - inner_first, d.gaussian_kernel,
+					                         halfsize);
+				}
+			}
+		}
+	});
+}
+
+void CannyIncrementalProcessor::SobelTiles(const std::vector<unsigned long> &list)
+{
+	CannyEdgeDetector &d = detector;
+	CannySobelKernel sobel = d.SobelKernel();
+
+	d.thread_pool.ParallelFor(0, list.size(), [&](unsigned long first, unsigned long last) {
+		for (unsigned long t = first; t < last; t++) {
+			unsigned long first_row, last_row, first_column, last_column;
+			float max = 0.0f;
+
+			if (this->TileRect(list[t], 1, 1, first_row, last_row, first_column, last_column)) {
+				for (unsigned long x = first_row; x < last_row; x++) {
+					unsigned long i = x * d.width + first_column;
+					float row_max = sobel(blurred.data() + i, d.width, d.edge_magnitude + i,
+					                      d.edge_direction + i, last_column - first_column);
+					max = row_max > max ? row_max : max;
+				}
+			}
+			tile_max[list[t]] = max;
+		}
+	});
+}
+
+void CannyIncrementalProcessor::SuppressTiles(const std::vector<unsigned long> &list)
+{
+	CannyEdgeDetector &d = detector;
+
+	d.thread_pool.ParallelFor(0, list.size(), [&](unsigned long first, unsigned long last) {
+		for (unsigned long t = first; t < last; t++) {
+			unsigned long first_row, last_row, first_column, last_column;
+			if (this->TileRect(list[t], 1, 1, first_row, last_row, first_column, last_column)) {
+				d.SuppressRect(first_row, last_row, first_column, last_column);
+			}
+		}
+	});
+}
+
+void CannyIncrementalProcessor::FindChangedPixels(const std::vector<unsigned long> &list)
+{
+	CannyEdgeDetector &d = detector;
+
+	changed_pixels.clear();
+	for (size_t t = 0; t < list.size(); t++) {
+		unsigned long first_row, last_row, first_column, last_column;
+		if (!this->TileRect(list[t], 1, 1, first_row, last_row, first_column, last_column)) {
+			continue;
+		}
+
+		for (unsigned long x = first_row; x < last_row; x++) {
+			unsigned long i = x * d.width + first_column;
+			if (memcmp(d.suppressed_bitmap + i, d.workspace_bitmap + i, last_column - first_column) == 0) {
+				continue;
+			}
+			for (unsigned long y = i; y < i + last_column - first_column; y++) {
+				if (d.suppressed_bitmap[y] != d.workspace_bitmap[y]) {
+					changed_pixels.push_back(y);
+				}
+			}
+		}
+	}
+}
+
+void CannyIncrementalProcessor::StoreTiles(const std::vector<unsigned long> &list)
+{
+	CannyEdgeDetector &d = detector;
+
+	d.thread_pool.ParallelFor(0, list.size(), [&](unsigned long first, unsigned long last) {
+		for (unsigned long t = first; t < last; t++) {
+			unsigned long first_row, last_row, first_column, last_column;
+			if (!this->TileRect(list[t], 1, 1, first_row, last_row, first_column, last_column)) {
+				continue;
+			}
+			for (unsigned long x = first_row; x < last_row; x++) {
+				unsigned long i = x * d.width + first_column;
+				memcpy(d.suppressed_bitmap + i, d.workspace_bitmap + i, last_column - first_column);
+			}
+		}
+	});
+}
+
+void CannyIncrementalProcessor::TraceFrame(uint8_t lowThreshold, uint8_t highThreshold)
+{
+	CannyEdgeDetector &d = detector;
+	size_t size = (size_t) d.width * d.height;
+
+	memcpy(d.workspace_bitmap, d.suppressed_bitmap, size);
+	d.PropagateEdges();
+	memcpy(propagated.data(), d.workspace_bitmap, size);
+	d.Hysteresis(lowThreshold, highThreshold);
+	memcpy(traced.data(), d.workspace_bitmap, size);
+}
+
+void CannyIncrementalProcessor::TraceChanged(uint8_t lowThreshold, uint8_t highThreshold)
+{
+	CannyEdgeDetector &d = detector;
+	uint8_t *suppressed = d.suppressed_bitmap;
+
+	std::fill(changed_rows.begin(), changed_rows.end(), 0);
+
+	/*
+	 * Propagation. Only components holding changed pixels, as they were
+	 * and as they are, may propagate differently. Together they are made of
+	 * whole components of current frame, so they are traced on their own.
+	 */
+	region.clear();
+	this->AddComponents(suppressed, changed_pixels, PROPAGATION, lowThreshold);
+	for (size_t k = 0; k < changed_pixels.size(); k++) {
+		suppressed[changed_pixels[k]] = d.workspace_bitmap[changed_pixels[k]];
+	}
+	this->AddComponents(suppressed, changed_pixels, PROPAGATION, lowThreshold);
+	this->ReachRegion(suppressed, PROPAGATION, lowThreshold, highThreshold);
+
+	propagated_pixels.clear();
+	propagated_values.clear();
+	for (size_t k = 0; k < region.size(); k++) {
+		unsigned int i = region[k];
+		uint8_t value = suppressed[i];
+		if (value == 128) {
+			value = (marks[i] & MARK_REACHED) ? 255 : 0;
+		}
+		if (value != propagated[i]) {
+			propagated_pixels.push_back(i);
+			propagated_values.push_back(value);
+		}
+	}
+	// Changed pixels outside of components are not 128 either, they keep
+	// their value.
+	for (size_t k = 0; k < changed_pixels.size(); k++) {
+		unsigned int i = changed_pixels[k];
+		if (!(marks[i] & MARK_REGION) && suppressed[i] != propagated[i]) {
+			propagated_pixels.push_back(i);
+			propagated_values.push_back(suppressed[i]);
+		}
+	}
+	for (size_t k = 0; k < region.size(); k++) {
+		marks[region[k]] = 0;
+	}
+
+	/*
+	 * Hysteresis, the same way, for pixels changed by propagation.
+	 * Changed pixels outside of components are below lower threshold both
+	 * times, they are not edges.
+	 */
+	region.clear();
+	this->AddComponents(propagated.data(), propagated_pixels, HYSTERESIS, lowThreshold);
+	for (size_t k = 0; k < propagated_pixels.size(); k++) {
+		propagated[propagated_pixels[k]] = propagated_values[k];
+	}
+	this->AddComponents(propagated.data(), propagated_pixels, HYSTERESIS, lowThreshold);
+	this->ReachRegion(propagated.data(), HYSTERESIS, lowThreshold, highThreshold);
+
+	for (size_t k = 0; k < region.size(); k++) {
+		unsigned int i = region[k];
+		uint8_t value = (marks[i] & MARK_REACHED) ? 255 : 0;
+		if (value != traced[i]) {
+			traced[i] = value;
+			changed_rows[i / d.width] = 1;
+		}
+		marks[i] = 0;
+	}
+}
+
+void CannyIncrementalProcessor::AddComponents(const uint8_t *pixels,
+                                              const std::vector<unsigned int> &seeds,
+                                              Round round, uint8_t lowThreshold)
+{
+	bool hysteresis = round == HYSTERESIS;
+	unsigned int columns = detector.width;
+	unsigned int rows = detector.height;
+
+	for (size_t k = 0; k < seeds.size(); k++) {
+		unsigned int seed = seeds[k];
+		if ((marks[seed] & MARK_REGION) || !IsNode(pixels[seed], hysteresis, lowThreshold)) {
+			continue;
+		}
+
+		marks[seed] |= MARK_REGION;
+		region.push_back(seed);
+		stack.push_back(seed);
+		while (!stack.empty()) {
+			unsigned int i = stack.back();
+			stack.pop_back();
+
+			ForNeighbours(i, columns, rows, hysteresis, [&](unsigned int j) {
+				if (!(marks[j] & MARK_REGION) && IsNode(pixels[j], hysteresis, lowThreshold)) {
+					marks[j] |= MARK_REGION;
+					region.push_back(j);
+					stack.push_back(j);
+				}
+			});
+		}
+	}
+}
+
+void CannyIncrementalProcessor::ReachRegion(const uint8_t *pixels, Round round,
+                                            uint8_t lowThreshold, uint8_t highThreshold)
+{
+	bool hysteresis = round == HYSTERESIS;
+	unsigned int columns = detector.width;
+	unsigned int rows = detector.height;
+
+	// Strong pixels are 255 ones in propagation, those above upper
+	// threshold in hysteresis. Weak ones they reach are 128 ones, or those
+	// above lower threshold.
+	for (size_t k = 0; k < region.size(); k++) {
+		unsigned int i = region[k];
+		if (hysteresis ? pixels[i] >= highThreshold : pixels[i] == 255) {
+			marks[i] |= MARK_REACHED;
+			stack.push_back(i);
+		}
+	}
+
+	while (!stack.empty()) {
+		unsigned int i = stack.back();
+		stack.pop_back();
+
+		ForNeighbours(i, columns, rows, hysteresis, [&](unsigned int j) {
+			if (!(marks[j] & MARK_REACHED) &&
+			    (hysteresis ? pixels[j] >= lowThreshold : pixels[j] == 128)) {
+				marks[j] |= MARK_REACHED;
+				stack.push_back(j);
+			}
+		});
+	}
+}
+
+void CannyIncrementalProcessor::WriteMask(const CannyMaskView &mask, bool whole)
+{
+	CannyEdgeDetector &d = detector;
+	unsigned int halfsize = d.mask_halfsize;
+	CannyRegion band;
+
+	memset(&band, 0, sizeof(band));
+	band.width = width;
+
+	// Runs of changed rows are written as bands.
+	unsigned int x = 0;
+	while (x < height) {
+		if (!whole && !changed_rows[x + halfsize]) {
+			x++;
+			continue;
+		}
+
+		unsigned int end = x + 1;
+		while (end < height && (whole || changed_rows[end + halfsize])) {
+			end++;
+		}
+		band.top = x;
+		band.height = end - x;
+		d.WriteRegion(band, traced.data() + (unsigned long) (x + halfsize) * d.width + halfsize,
+		              d.width, mask, width, x, 0);
+		x = end;
+	}
+}
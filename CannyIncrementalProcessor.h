@@ -0,0 +1,341 @@
+/**
+ * \file      CannyIncrementalProcessor.h
+ * \brief     Edge detection in frames of static scenes, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYINCREMENTALPROCESSOR_H_
+#define _CANNYINCREMENTALPROCESSOR_H_
+
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+
+/**
+ * \brief Detects edges in frames of fixed camera, redoing changed parts only.
+ *
+ * Enlarged frame (see CannyEdgeDetector::ProcessImage()) is cut into square
+ * tiles and compared with previous frame tile by tile. Blur, Sobel and
+ * suppression of non maximum pixels are run only on tiles that changed and
+ * on those within reach of Gauss mask, Sobel mask and suppression around
+ * them. Blurred image, gradient and suppressed image of whole frame are kept
+ * between frames for that. Suppression is scaled with maximum gradient
+ * magnitude of whole frame, so if the maximum changes, it is done on whole
+ * frame again.
+ *
+ * Propagation of edges and hysteresis are repeated only on connected
+ * components holding pixels whose suppressed value changed, as they were
+ * before and as they are after the change. Only rows of mask holding changed
+ * edge pixels are written, if mask is the one given with previous frame.
+ *
+ * Masks are same as ProcessImage() of detector with same settings gives.
+ * Whole frame is processed again if its size or sigma changes, or if blur is
+ * done with recursive filter (see CannyEdgeDetector::SetRecursiveSigma()),
+ * whose pixels depend on whole row and column. Edges are traced on whole
+ * frame if thresholds change, if lower one is above upper one (result then
+ * depends on order pixels are visited in) or if too many pixels changed.
+ */
+class CannyIncrementalProcessor
+{
+	public:
+		/**
+		 * \brief Constructor, tiles of 64 x 64 pixels, one thread.
+		 */
+		CannyIncrementalProcessor();
+
+		/**
+		 * \brief Sets size of tiles frames are compared in.
+		 *
+		 * Smaller tiles follow changes more closely, but halo around each
+		 * changed tile is redone as well. Next frame is processed whole.
+		 *
+		 * \param size Width and height of tile, in pixels.
+		 */
+		void SetTileSize(unsigned int size);
+
+		/**
+		 * \brief Returns size of tiles.
+		 */
+		unsigned int GetTileSize() const;
+
+		/**
+		 * \brief Sets number of threads tiles are processed on.
+		 *
+		 * \param count Number of threads, 0 means one per hardware thread.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetFixedPoint().
+		 *
+		 * Next frame is processed whole.
+		 */
+		void SetFixedPoint(bool fixed_point);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetGradient().
+		 *
+		 * Next frame is processed whole.
+		 */
+		void SetGradient(CannyGradient gradient);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetRecursiveSigma().
+		 *
+		 * Next frame is processed whole.
+		 */
+		void SetRecursiveSigma(float min_sigma);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetBorder().
+		 *
+		 * Next frame is processed whole.
+		 */
+		void SetBorder(CannyBorder border, uint8_t value = 0);
+
+		/**
+		 * \brief Forgets previous frame, next one is processed whole.
+		 */
+		void Reset();
+
+		/**
+		 * \brief Processes frame and writes edges into caller's mask.
+		 *
+		 * Same as CannyEdgeDetector::ProcessImage(), but only parts of frame
+		 * that changed since previous call are processed. If mask is the one
+		 * given with previous frame, only its rows where edges changed are
+		 * written, so it must still hold edges of previous frame. Mask must
+		 * not share memory with input.
+		 *
+		 * \param image Source frame.
+		 * \param mask Destination mask, of `image.width` * `image.height`
+		 * pixels.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if frame, mask or sigma is invalid, see
+		 * CannyEdgeDetector::ProcessImage().
+		 */
+		bool ProcessFrame(const CannyImageView &image, const CannyMaskView &mask,
+		                  float sigma = 1.0f, uint8_t lowThreshold = 30,
+		                  uint8_t highThreshold = 80);
+
+		/**
+		 * \brief Returns number of tiles last frame was cut into.
+		 */
+		unsigned long GetTileCount() const;
+
+		/**
+		 * \brief Returns number of tiles that changed in last frame.
+		 *
+		 * Equal to GetTileCount() if frame was processed whole.
+		 */
+		unsigned long GetChangedTileCount() const;
+
+	private:
+		/**
+		 * \brief Edge tracing step components are followed in.
+		 */
+		enum Round
+		{
+			PROPAGATION, ///< 128 and 255 pixels, 8-connected.
+			HYSTERESIS   ///< Pixels above lower threshold, diagonally connected.
+		};
+
+		/**
+		 * \brief Flags of `marks`.
+		 */
+		enum
+		{
+			MARK_REGION = 1, ///< Pixel is in `region`.
+			MARK_REACHED = 2 ///< Pixel is connected with strong one.
+		};
+
+		CannyIncrementalProcessor(const CannyIncrementalProcessor &);
+		CannyIncrementalProcessor &operator=(const CannyIncrementalProcessor &);
+
+		/**
+		 * \brief Compares workspace with previous frame and updates it.
+		 *
+		 * \param whole True to take all tiles as changed.
+		 */
+		void FindChangedTiles(bool whole);
+
+		/**
+		 * \brief Lists changed tiles and tiles within given distance of them.
+		 *
+		 * \param reach Distance in pixels.
+		 * \param list Indices of tiles.
+		 */
+		void ListTiles(unsigned int reach, std::vector<unsigned long> &list) const;
+
+		/**
+		 * \brief Gives rows and columns of tile, without given margins of
+		 * enlarged frame.
+		 *
+		 * \return False if nothing is left of tile.
+		 */
+		bool TileRect(unsigned long tile, unsigned int row_margin,
+		              unsigned int column_margin, unsigned long &first_row,
+		              unsigned long &last_row, unsigned long &first_column,
+		              unsigned long &last_column) const;
+
+		/**
+		 * \brief Blurs listed tiles of workspace into `blurred`.
+		 */
+		void BlurTiles(const std::vector<unsigned long> &list);
+
+		/**
+		 * \brief Applies Sobel masks on listed tiles of `blurred`.
+		 *
+		 * Maximum magnitude of each tile goes into `tile_max`.
+		 */
+		void SobelTiles(const std::vector<unsigned long> &list);
+
+		/**
+		 * \brief Suppresses non maximum pixels of listed tiles into
+		 * workspace.
+		 */
+		void SuppressTiles(const std::vector<unsigned long> &list);
+
+		/**
+		 * \brief Finds pixels of listed tiles whose suppressed value changed.
+		 */
+		void FindChangedPixels(const std::vector<unsigned long> &list);
+
+		/**
+		 * \brief Copies listed tiles of workspace into suppressed image.
+		 */
+		void StoreTiles(const std::vector<unsigned long> &list);
+
+		/**
+		 * \brief Traces edges of whole frame.
+		 */
+		void TraceFrame(uint8_t lowThreshold, uint8_t highThreshold);
+
+		/**
+		 * \brief Traces edges of components holding changed pixels.
+		 */
+		void TraceChanged(uint8_t lowThreshold, uint8_t highThreshold);
+
+		/**
+		 * \brief Adds components holding given pixels to `region`.
+		 *
+		 * \param pixels Image components are found in.
+		 * \param seeds Pixels components are looked for from.
+		 * \param round Which pixels are connected, and how.
+		 * \param lowThreshold Lower threshold of hysteresis.
+		 */
+		void AddComponents(const uint8_t *pixels, const std::vector<unsigned int> &seeds,
+		                   Round round, uint8_t lowThreshold);
+
+		/**
+		 * \brief Marks pixels of `region` connected with strong ones.
+		 *
+		 * \param pixels Image components are found in.
+		 * \param round Which pixels are connected, and how.
+		 * \param lowThreshold Lower threshold of hysteresis.
+		 * \param highThreshold Upper threshold of hysteresis.
+		 */
+		void ReachRegion(const uint8_t *pixels, Round round, uint8_t lowThreshold,
+		                 uint8_t highThreshold);
+
+		/**
+		 * \brief Writes traced frame into mask.
+		 *
+		 * \param mask Mask of frame.
+		 * \param whole True to write all rows, not only changed ones.
+		 */
+		void WriteMask(const CannyMaskView &mask, bool whole);
+
+		/**
+		 * \var Detector whose steps and buffers are used.
+		 */
+		CannyEdgeDetector detector;
+
+		/**
+		 * \var Size of tiles.
+		 */
+		unsigned int tile_size;
+
+		/**
+		 * \var Number of tiles of enlarged frame, in rows and columns.
+		 */
+		unsigned long tile_rows, tile_columns;
+
+		/**
+		 * \var Flag of each tile, true if it changed.
+		 */
+		std::vector<uint8_t> changed_tiles;
+
+		/**
+		 * \var Number of changed tiles.
+		 */
+		unsigned long changed_tile_count;
+
+		/**
+		 * \var Tiles to be blurred, differentiated and suppressed.
+		 */
+		std::vector<unsigned long> blur_tiles, sobel_tiles, suppress_tiles;
+
+		/**
+		 * \var Maximum gradient magnitude of each tile.
+		 */
+		std::vector<float> tile_max;
+
+		/**
+		 * \var Enlarged gray frame, blurred frame, suppressed image after
+		 * propagation of edges and after hysteresis, of last frame.
+		 * Suppressed image itself is kept in detector.
+		 */
+		std::vector<uint8_t> gray, blurred, propagated, traced;
+
+		/**
+		 * \var Flags of pixels, see MARK_REGION and MARK_REACHED.
+		 */
+		std::vector<uint8_t> marks;
+
+		/**
+		 * \var Pixels whose suppressed value, or value after propagation,
+		 * changed, and value after propagation of the latter.
+		 */
+		std::vector<unsigned int> changed_pixels, propagated_pixels;
+		std::vector<uint8_t> propagated_values;
+
+		/**
+		 * \var Pixels of components being traced again.
+		 */
+		std::vector<unsigned int> region;
+
+		/**
+		 * \var Worklist of component search.
+		 */
+		std::vector<unsigned int> stack;
+
+		/**
+		 * \var Flag of each row of enlarged frame, true if its edges
+		 * changed.
+		 */
+		std::vector<uint8_t> changed_rows;
+
+		/**
+		 * \var True if buffers hold last frame.
+		 */
+		bool valid;
+
+		/**
+		 * \var Size, sigma, thresholds, gradient maximum and mask of last
+		 * frame.
+		 */
+		unsigned int width, height;
+		float sigma;
+		uint8_t low_threshold, high_threshold;
+		float edge_max;
+		CannyMaskView mask;
+};
+
+#endif // #ifndef _CANNYINCREMENTALPROCESSOR_H_
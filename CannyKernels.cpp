@@ -0,0 +1,299 @@
+/**
+ * \file      CannyKernels.cpp
+ * \brief     Scalar row kernels and instruction set dispatch.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CannyKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#	define CANNY_KERNELS_X86
+#endif
+
+#ifdef CANNY_KERNELS_X86
+/*
+ * Tables defined in files compiled with vector instruction sets enabled.
+ */
+extern const CannyKernels canny_kernels_sse41;
+extern const CannyKernels canny_kernels_avx2;
+#endif
+
+static void LuminanceGray(const uint8_t *source, uint8_t *destination,
+                          size_t count)
+{
+	memcpy(destination, source, count);
+}
+
+template <CannyPixelFormat format>
+static void LuminanceColor(const uint8_t *source, uint8_t *destination,
+                           size_t count)
+{
+	const unsigned int size = CannyPixelSize(format);
+	const unsigned int red = CannyRedOffset(format);
+
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *pixel = source + size * i;
+		destination[i] = CannyLuminance(pixel[2 - red], pixel[1], pixel[red]);
+	}
+}
+
+template <unsigned int Halfsize>
+static void BlurHorizontalSized(const uint8_t *source, float *destination,
+                                size_t count, const float *kernel,
+                                unsigned int halfsize)
+{
+	const uint8_t *first = source - halfsize;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	for (size_t i = 0; i < count; i++) {
+		float new_pixel = 0.0f;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += (float) first[i + k] * kernel[k];
+		}
+		destination[i] = new_pixel;
+	}
+}
+
+static void BlurHorizontal(const uint8_t *source, float *destination,
+                           size_t count, const float *kernel,
+                           unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurHorizontalSized, halfsize, source, destination, count, kernel, halfsize);
+}
+
+template <unsigned int Halfsize>
+static void BlurVerticalSized(const float *source, size_t stride,
+                              uint8_t *destination, size_t count,
+                              const float *kernel, unsigned int halfsize)
+{
+	const float *first = source - halfsize * stride;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	for (size_t i = 0; i < count; i++) {
+		float new_pixel = 0.0f;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += first[k * stride + i] * kernel[k];
+		}
+		destination[i] = (uint8_t) (new_pixel + 0.5f);
+	}
+}
+
+static void BlurVertical(const float *source, size_t stride,
+                         uint8_t *destination, size_t count,
+                         const float *kernel, unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurVerticalSized, halfsize, source, stride, destination, count, kernel, halfsize);
+}
+
+static float Sobel(const uint8_t *source, size_t stride, float *magnitude,
+                   uint8_t *direction, size_t count)
+{
+	const uint8_t *above = source - stride;
+	const uint8_t *below = source + stride;
+	float max = 0.0f;
+
+	for (size_t i = 0; i < count; i++) {
+		int gx = (below[i - 1] + 2 * below[i] + below[i + 1])
+		       - (above[i - 1] + 2 * above[i] + above[i + 1]);
+		int gy = (above[i - 1] + 2 * source[i - 1] + below[i - 1])
+		       - (above[i + 1] + 2 * source[i + 1] + below[i + 1]);
+
+		magnitude[i] = sqrtf((float) (gx * gx + gy * gy)) * 0.25f;
+		max = magnitude[i] > max ? magnitude[i] : max;
+		direction[i] = CannyDirection(gx, gy);
+	}
+
+	return max;
+}
+
+/**
+ * \brief Sobel operator with squared (`l1` false) or L1 norm.
+ */
+template <bool l1>
+static float SobelFast(const uint8_t *source, size_t stride, float *magnitude,
+                       uint8_t *direction, size_t count)
+{
+	const uint8_t *above = source - stride;
+	const uint8_t *below = source + stride;
+	float max = 0.0f;
+
+	for (size_t i = 0; i < count; i++) {
+		int gx = (below[i - 1] + 2 * below[i] + below[i + 1])
+		       - (above[i - 1] + 2 * above[i] + above[i + 1]);
+		int gy = (above[i - 1] + 2 * source[i - 1] + below[i - 1])
+		       - (above[i + 1] + 2 * source[i + 1] + below[i + 1]);
+
+		if (l1) {
+			magnitude[i] = (float) (abs(gx) + abs(gy));
+		} else {
+			magnitude[i] = (float) (gx * gx + gy * gy);
+		}
+		max = magnitude[i] > max ? magnitude[i] : max;
+		direction[i] = CannyDirectionFast(gx, gy);
+	}
+
+	return max;
+}
+
+template <CannyPixelFormat format>
+static void LuminanceColorFixed(const uint8_t *source, uint8_t *destination,
+                                size_t count)
+{
+	const unsigned int size = CannyPixelSize(format);
+	const unsigned int red = CannyRedOffset(format);
+
+	for (size_t i = 0; i < count; i++) {
+		const uint8_t *pixel = source + size * i;
+		destination[i] = CannyLuminanceFixed(pixel[2 - red], pixel[1], pixel[red]);
+	}
+}
+
+template <unsigned int Halfsize>
+static void BlurHorizontalFixedSized(const uint8_t *source, uint16_t *destination,
+                                     size_t count, const uint16_t *kernel,
+                                     unsigned int halfsize)
+{
+	const uint8_t *first = source - halfsize;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	for (size_t i = 0; i < count; i++) {
+		uint16_t new_pixel = 0;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += first[i + k] * kernel[k];
+		}
+		destination[i] = new_pixel;
+	}
+}
+
+static void BlurHorizontalFixed(const uint8_t *source, uint16_t *destination,
+                                size_t count, const uint16_t *kernel,
+                                unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurHorizontalFixedSized, halfsize, source, destination, count, kernel, halfsize);
+}
+
+template <unsigned int Halfsize>
+static void BlurVerticalFixedSized(const uint16_t *source, size_t stride,
+                                   uint8_t *destination, size_t count,
+                                   const uint16_t *kernel, unsigned int halfsize)
+{
+	const uint16_t *first = source - halfsize * stride;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	for (size_t i = 0; i < count; i++) {
+		uint32_t new_pixel = 0;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += (uint32_t) first[k * stride + i] * kernel[k];
+		}
+		destination[i] = CannyBlurFixedRound(new_pixel);
+	}
+}
+
+static void BlurVerticalFixed(const uint16_t *source, size_t stride,
+                              uint8_t *destination, size_t count,
+                              const uint16_t *kernel, unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurVerticalFixedSized, halfsize, source, stride, destination, count, kernel, halfsize);
+}
+
+static void BlurRecursive(float *row, ptrdiff_t step, uint8_t *destination,
+                          size_t count, const CannyRecursiveFilter *filter)
+{
+	for (size_t i = 0; i < count; i++) {
+		row[i] = CannyRecursiveStep(row + i, step, filter);
+	}
+	if (destination != NULL) {
+		for (size_t i = 0; i < count; i++) {
+			destination[i] = CannyRecursiveRound(row[i]);
+		}
+	}
+}
+
+static void TransposeGray(const uint8_t *source, size_t stride, float *destination,
+                          size_t rows, size_t count)
+{
+	for (size_t y = 0; y < count; y++) {
+		for (size_t x = 0; x < rows; x++) {
+			destination[y * rows + x] = source[x * stride + y];
+		}
+	}
+}
+
+static void TransposeFloat(const float *source, float *destination, size_t stride,
+                           size_t rows, size_t count)
+{
+	for (size_t y = 0; y < count; y++) {
+		for (size_t x = 0; x < rows; x++) {
+			destination[x * stride + y] = source[y * rows + x];
+		}
+	}
+}
+
+static const CannyKernels canny_kernels_scalar = {
+	CANNY_KERNELS_SCALAR,
+	"scalar",
+	{
+		LuminanceGray,
+		LuminanceColor<CANNY_PIXEL_BGR24>,
+		LuminanceColor<CANNY_PIXEL_RGB24>,
+		LuminanceColor<CANNY_PIXEL_BGRA32>
+	},
+	BlurHorizontal,
+	BlurVertical,
+	Sobel,
+	{
+		LuminanceGray,
+		LuminanceColorFixed<CANNY_PIXEL_BGR24>,
+		LuminanceColorFixed<CANNY_PIXEL_RGB24>,
+		LuminanceColorFixed<CANNY_PIXEL_BGRA32>
+	},
+	BlurHorizontalFixed,
+	BlurVerticalFixed,
+	SobelFast<false>,
+	SobelFast<true>,
+	BlurRecursive,
+	TransposeGray,
+	TransposeFloat
+};
+
+const CannyKernels *CannySelectKernels(CannyKernelSet set)
+{
+#ifdef CANNY_KERNELS_X86
+	__builtin_cpu_init();
+	bool has_sse41 = __builtin_cpu_supports("sse4.1");
+	bool has_avx2 = __builtin_cpu_supports("avx2");
+
+	switch (set) {
+		case CANNY_KERNELS_AUTO:
+			if (has_avx2) {
+				return &canny_kernels_avx2;
+			} else if (has_sse41) {
+				return &canny_kernels_sse41;
+			}
+			return &canny_kernels_scalar;
+		case CANNY_KERNELS_SCALAR:
+			return &canny_kernels_scalar;
+		case CANNY_KERNELS_SSE41:
+			return has_sse41 ? &canny_kernels_sse41 : NULL;
+		case CANNY_KERNELS_AVX2:
+			return has_avx2 ? &canny_kernels_avx2 : NULL;
+	}
+#else
+	if (set == CANNY_KERNELS_AUTO || set == CANNY_KERNELS_SCALAR) {
+		return &canny_kernels_scalar;
+	}
+#endif
+
+	return NULL;
+}
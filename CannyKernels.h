@@ -0,0 +1,452 @@
+/**
+ * \file      CannyKernels.h
+ * \brief     Row kernels used by Canny algorithm, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYKERNELS_H_
+#define _CANNYKERNELS_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \brief Instruction sets kernels are implemented for.
+ */
+enum CannyKernelSet
+{
+	CANNY_KERNELS_AUTO,   ///< Best set supported by current processor.
+	CANNY_KERNELS_SCALAR, ///< Plain C++, works everywhere.
+	CANNY_KERNELS_SSE41,  ///< SSE4.1 (x86).
+	CANNY_KERNELS_AVX2    ///< AVX2 (x86).
+};
+
+/**
+ * \brief Layouts of input pixels.
+ */
+enum CannyPixelFormat
+{
+	CANNY_PIXEL_GRAY8,   ///< One byte of luminance.
+	CANNY_PIXEL_BGR24,   ///< Blue, green, red bytes.
+	CANNY_PIXEL_RGB24,   ///< Red, green, blue bytes.
+	CANNY_PIXEL_BGRA32,  ///< Blue, green, red and ignored alpha bytes.
+	CANNY_PIXEL_FORMATS  ///< Number of formats.
+};
+
+/**
+ * \brief Ways of computing gradient magnitude and direction.
+ */
+enum CannyGradient
+{
+	CANNY_GRADIENT_EXACT,   ///< Euclidean norm, direction from atan2.
+	CANNY_GRADIENT_SQUARED, ///< Squared Euclidean norm, sector from tangents.
+	CANNY_GRADIENT_L1       ///< Sum of absolute values, sector from tangents.
+};
+
+/**
+ * \brief Edge directions, two-bit codes stored by Sobel kernels.
+ */
+enum CannyDirectionCode
+{
+	CANNY_DIRECTION_0,   ///< Gradient along x, 0 degrees.
+	CANNY_DIRECTION_45,  ///< 45 degrees.
+	CANNY_DIRECTION_90,  ///< Gradient along y, 90 degrees.
+	CANNY_DIRECTION_135  ///< 135 degrees.
+};
+
+/**
+ * \brief Coefficients of recursive approximation of Gauss filter.
+ *
+ * Third order filter of Young and van Vliet, run forward and then backward
+ * along signal:
+ *
+ *     w[n] = b * x[n] + a[2] * w[n - 3] + a[1] * w[n - 2] + a[0] * w[n - 1]
+ *     y[n] = b * w[n] + a[2] * y[n + 3] + a[1] * y[n + 2] + a[0] * y[n + 1]
+ *
+ * Signal is extended with its first and last values. Forward pass starts
+ * in steady state of first value, backward pass in state given by matrix
+ * of Triggs and Sdika, so result is the same as for infinite extension.
+ */
+struct CannyRecursiveFilter
+{
+	/**
+	 * \var Weight of input, 1 - a[0] - a[1] - a[2].
+	 */
+	float b;
+
+	/**
+	 * \var Weights of previous outputs, nearest first.
+	 */
+	float a[3];
+
+	/**
+	 * \var Row-major 3x3 matrix giving y[N], y[N + 1], y[N + 2] (minus
+	 * last value) from w[N - 1], w[N - 2], w[N - 3] (minus last value).
+	 */
+	float m[9];
+};
+
+/**
+ * \brief Applies Sobel operator to row of pixels.
+ *
+ * Gradients are computed in 16-bit integers. Magnitude depends on kernel,
+ * direction is one of CannyDirectionCode values.
+ *
+ * \param source First pixel of central row. Pixels around the row must
+ * be readable.
+ * \param stride Distance between rows, in bytes.
+ * \param magnitude Row of `count` gradient magnitudes.
+ * \param direction Row of `count` gradient directions.
+ * \param count Number of pixels.
+ * \return Maximum magnitude in the row (0 for empty row).
+ */
+typedef float (*CannySobelKernel)(const uint8_t *source, size_t stride,
+                                  float *magnitude, uint8_t *direction,
+                                  size_t count);
+
+/**
+ * \brief Table of row kernels implemented with one instruction set.
+ *
+ * Each kernel processes `count` consecutive pixels of one row. All sets
+ * give bit-identical results, vectorized ones only do it faster. Tables
+ * are obtained with CannySelectKernels().
+ */
+struct CannyKernels
+{
+	/**
+	 * \var Instruction set of this table.
+	 */
+	CannyKernelSet set;
+
+	/**
+	 * \var Human readable name of instruction set.
+	 */
+	const char *name;
+
+	/**
+	 * \brief Converts row of pixels into row of gray pixels, one function
+	 * per CannyPixelFormat. Gray pixels are just copied.
+	 *
+	 * \param source Row of `count` pixels.
+	 * \param destination Row of `count` gray pixels.
+	 * \param count Number of pixels.
+	 */
+	void (*luminance[CANNY_PIXEL_FORMATS])(const uint8_t *source,
+	                                       uint8_t *destination, size_t count);
+
+	/**
+	 * \brief Convolves row with one-dimensional kernel.
+	 *
+	 * \param source First pixel to be convolved. `halfsize` pixels on both
+	 * sides of the row must be readable.
+	 * \param destination Row of `count` convolved values.
+	 * \param count Number of pixels.
+	 * \param kernel Kernel of 2 * `halfsize` + 1 weights.
+	 * \param halfsize Half of kernel width.
+	 */
+	void (*blur_horizontal)(const uint8_t *source, float *destination,
+	                        size_t count, const float *kernel,
+	                        unsigned int halfsize);
+
+	/**
+	 * \brief Convolves column-wise rows of horizontal pass with kernel.
+	 *
+	 * \param source First pixel of central row. `halfsize` rows above and
+	 * below must be readable.
+	 * \param stride Distance between rows, in elements.
+	 * \param destination Row of `count` blurred pixels, rounded.
+	 * \param count Number of pixels.
+	 * \param kernel Kernel of 2 * `halfsize` + 1 weights.
+	 * \param halfsize Half of kernel width.
+	 */
+	void (*blur_vertical)(const float *source, size_t stride,
+	                      uint8_t *destination, size_t count,
+	                      const float *kernel, unsigned int halfsize);
+
+	/**
+	 * \brief Sobel operator, CANNY_GRADIENT_EXACT.
+	 *
+	 * Magnitude is Euclidean norm divided by 4, direction is picked with
+	 * CannyDirection().
+	 */
+	CannySobelKernel sobel;
+
+	/**
+	 * \brief Fixed-point variant of luminance.
+	 *
+	 * Uses 8.8 weights, see CannyLuminanceFixed().
+	 */
+	void (*luminance_fixed[CANNY_PIXEL_FORMATS])(const uint8_t *source,
+	                                             uint8_t *destination,
+	                                             size_t count);
+
+	/**
+	 * \brief Fixed-point variant of blur_horizontal.
+	 *
+	 * \param kernel Weights with 8 fractional bits, summing up to 256, so
+	 * results fit 16-bit accumulators.
+	 */
+	void (*blur_horizontal_fixed)(const uint8_t *source, uint16_t *destination,
+	                              size_t count, const uint16_t *kernel,
+	                              unsigned int halfsize);
+
+	/**
+	 * \brief Fixed-point variant of blur_vertical.
+	 *
+	 * \param kernel Weights with 15 fractional bits, summing up to 32768.
+	 * Accumulated in 32 bits and rounded, see CannyBlurFixedRound().
+	 */
+	void (*blur_vertical_fixed)(const uint16_t *source, size_t stride,
+	                            uint8_t *destination, size_t count,
+	                            const uint16_t *kernel, unsigned int halfsize);
+
+	/**
+	 * \brief Sobel operator, CANNY_GRADIENT_SQUARED.
+	 *
+	 * Magnitude is gx * gx + gy * gy (exact, it never exceeds 2^24),
+	 * direction is picked with CannyDirectionFast().
+	 */
+	CannySobelKernel sobel_squared;
+
+	/**
+	 * \brief Sobel operator, CANNY_GRADIENT_L1.
+	 *
+	 * Magnitude is |gx| + |gy|, direction is picked with
+	 * CannyDirectionFast().
+	 */
+	CannySobelKernel sobel_l1;
+
+	/**
+	 * \brief Performs one step of recursive Gauss filter on row of
+	 * independent signals, in place.
+	 *
+	 * Signals run across rows: `row[j]` is next input of signal `j` and
+	 * `row[j + k * step]` its output `k` steps back, so vectorized kernels
+	 * filter neighbouring signals at once. Cost per value does not depend
+	 * on sigma.
+	 *
+	 * \param row Row of `count` inputs, replaced by outputs.
+	 * \param step Distance to previous output of the same signal, in
+	 * elements: minus row stride in forward pass, plus in backward pass.
+	 * \param destination If not NULL, row of `count` outputs rounded with
+	 * CannyRecursiveRound().
+	 * \param count Number of signals.
+	 * \param filter Filter coefficients.
+	 */
+	void (*blur_recursive)(float *row, ptrdiff_t step, uint8_t *destination,
+	                       size_t count, const CannyRecursiveFilter *filter);
+
+	/**
+	 * \brief Transposes strip of gray rows into floating-point columns.
+	 *
+	 * Value `y` of row `x` becomes `destination[y * rows + x]`, so that
+	 * rows can be filtered by blur_recursive.
+	 *
+	 * \param source First pixel of first row.
+	 * \param stride Distance between rows, in bytes.
+	 * \param destination Transposed strip, `count` rows of `rows` values.
+	 * \param rows Number of rows of strip.
+	 * \param count Number of pixels of each row.
+	 */
+	void (*transpose_gray)(const uint8_t *source, size_t stride, float *destination,
+	                       size_t rows, size_t count);
+
+	/**
+	 * \brief Transposes strip back, reverse of transpose_gray.
+	 *
+	 * \param source Transposed strip, `count` rows of `rows` values.
+	 * \param destination First value of first row.
+	 * \param stride Distance between rows, in elements.
+	 * \param rows Number of rows of strip.
+	 * \param count Number of values of each row.
+	 */
+	void (*transpose_float)(const float *source, float *destination, size_t stride,
+	                        size_t rows, size_t count);
+};
+
+/**
+ * \brief Returns kernel table for given instruction set.
+ *
+ * CANNY_KERNELS_AUTO is resolved with CPUID to the best supported set.
+ *
+ * \param set Requested instruction set.
+ * \return Kernel table or NULL if processor does not support the set.
+ */
+const CannyKernels *CannySelectKernels(CannyKernelSet set);
+
+/**
+ * \brief Calls instance of blur kernel template specialized for half size
+ * of Gauss mask.
+ *
+ * Sigmas up to about 2.6 give masks of 3, 5, 7 or 9 weights. Instances for
+ * them know number of weights at compile time, so loops over weights are
+ * unrolled and weights stay in registers. Other sizes go to generic
+ * instance, `kernel<0>`. Weights are summed in the same order by all
+ * instances, so results are identical.
+ */
+#define CANNY_BLUR_SIZED(kernel, halfsize, ...) \
+	switch (halfsize) { \
+		case 1: kernel<1>(__VA_ARGS__); break; \
+		case 2: kernel<2>(__VA_ARGS__); break; \
+		case 3: kernel<3>(__VA_ARGS__); break; \
+		case 4: kernel<4>(__VA_ARGS__); break; \
+		default: kernel<0>(__VA_ARGS__); break; \
+	}
+
+/**
+ * \brief Unrolls following loop over weights of Gauss mask, completely
+ * when number of weights is known at compile time.
+ */
+#define CANNY_UNROLL_WEIGHTS _Pragma("GCC unroll 9")
+
+/**
+ * \brief Returns number of bytes per pixel of given format.
+ */
+static inline unsigned int CannyPixelSize(CannyPixelFormat format)
+{
+	switch (format) {
+		case CANNY_PIXEL_BGR24:
+		case CANNY_PIXEL_RGB24:
+			return 3;
+		case CANNY_PIXEL_BGRA32:
+			return 4;
+		default:
+			return 1;
+	}
+}
+
+/**
+ * \brief Returns offset of red byte within pixel of given color format.
+ *
+ * Blue byte lies at 2 minus this offset, green one in the middle.
+ */
+static inline unsigned int CannyRedOffset(CannyPixelFormat format)
+{
+	return format == CANNY_PIXEL_RGB24 ? 0 : 2;
+}
+
+/**
+ * \brief Standard equation from RGB to grayscale.
+ *
+ * Computed in single precision, with no fused operations, so that scalar
+ * and vector kernels agree on every pixel.
+ */
+static inline uint8_t CannyLuminance(uint8_t blue, uint8_t green, uint8_t red)
+{
+	return (uint8_t) (0.299f * red + 0.587f * green + 0.114f * blue);
+}
+
+/**
+ * \brief Equation from RGB to grayscale with 8.8 fixed-point weights.
+ *
+ * Weights (77, 150, 29) sum up to 256, so result never exceeds 255 and
+ * differs from CannyLuminance() by at most one gray level.
+ */
+static inline uint8_t CannyLuminanceFixed(uint8_t blue, uint8_t green, uint8_t red)
+{
+	return (uint8_t) ((77 * red + 150 * green + 29 * blue) >> 8);
+}
+
+/**
+ * \brief Turns vertical blur accumulator into pixel value.
+ *
+ * Accumulator carries 8 + 15 fractional bits of both passes.
+ */
+static inline uint8_t CannyBlurFixedRound(uint32_t accumulator)
+{
+	return (uint8_t) ((accumulator + (1u << 22)) >> 23);
+}
+
+/**
+ * \brief Performs one step of recursive Gauss filter for one signal.
+ *
+ * Reference for vectorized kernels, which add products in the same order:
+ * oldest output first, so that only the last addition waits for previous
+ * output.
+ */
+static inline float CannyRecursiveStep(const float *value, ptrdiff_t step,
+                                       const CannyRecursiveFilter *filter)
+{
+	return filter->b * value[0] + filter->a[2] * value[3 * step] +
+	       filter->a[1] * value[2 * step] + filter->a[0] * value[step];
+}
+
+/**
+ * \brief Turns output of recursive Gauss filter into pixel value.
+ *
+ * Filter is not strictly positive, so values may slightly overshoot.
+ */
+static inline uint8_t CannyRecursiveRound(float value)
+{
+	value += 0.5f;
+	value = value < 0.0f ? 0.0f : value;
+	value = value > 255.0f ? 255.0f : value;
+	return (uint8_t) value;
+}
+
+/**
+ * \brief Picks one of four edge directions for a gradient.
+ *
+ * \param gx Gradient along x (rows).
+ * \param gy Gradient along y (columns).
+ * \return Direction, one of CannyDirectionCode values.
+ */
+static inline uint8_t CannyDirection(int gx, int gy)
+{
+	float angle = 0.0f;
+
+	if ((gx != 0) || (gy != 0)) {
+		angle = atan2((float) gy, (float) gx) * 180.0 / 3.14159265f;
+	}
+	if (((angle > 22.5f) && (angle <= 67.5f)) ||
+	    ((angle > -157.5f) && (angle <= -112.5f))) {
+		return CANNY_DIRECTION_45;
+	} else if (((angle > 67.5f) && (angle <= 112.5f)) ||
+	           ((angle > -112.5f) && (angle <= -67.5f))) {
+		return CANNY_DIRECTION_90;
+	} else if (((angle > 112.5f) && (angle <= 157.5f)) ||
+	           ((angle > -67.5f) && (angle <= -22.5f))) {
+		return CANNY_DIRECTION_135;
+	}
+	return CANNY_DIRECTION_0;
+}
+
+/**
+ * \brief Multiplier of tan(22.5 degrees) with 16 fractional bits.
+ */
+#define CANNY_TAN_22_5 27146
+
+/**
+ * \brief Picks one of four edge directions without atan2.
+ *
+ * Sector is found by comparing |gy| with |gx| scaled by tan(22.5) and
+ * tan(67.5) = 2 + tan(22.5), in integers, so vector kernels can do the
+ * same. Only pixels lying exactly on sector boundary (within rounding of
+ * the tangent) may get other direction than from CannyDirection().
+ *
+ * \param gx Gradient along x (rows), |gx| <= 1020.
+ * \param gy Gradient along y (columns), |gy| <= 1020.
+ * \return Direction, one of CannyDirectionCode values.
+ */
+static inline uint8_t CannyDirectionFast(int gx, int gy)
+{
+	int ax = gx < 0 ? -gx : gx;
+	int ay = gy < 0 ? -gy : gy;
+	// Integer ay compared with real ax * tan(22.5) equals comparison with
+	// its floor.
+	int tangent = (ax * CANNY_TAN_22_5) >> 16;
+
+	if (ay <= tangent) {
+		return CANNY_DIRECTION_0;
+	} else if (ay - 2 * ax > tangent) {
+		return CANNY_DIRECTION_90;
+	}
+	return (gx ^ gy) < 0 ? CANNY_DIRECTION_135 : CANNY_DIRECTION_45;
+}
+
+#endif // #ifndef _CANNYKERNELS_H_
@@ -0,0 +1,642 @@
+/**
+ * \file      CannyKernelsAVX2.cpp
+ * \brief     Row kernels vectorized with AVX2.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ * This file is compiled with -mavx2, so nothing here may be called before
+ * CannySelectKernels() confirms processor support. All functions are
+ * static, otherwise linker could pick their AVX2 copies for scalar code.
+ * FMA is deliberately not enabled, results must match scalar kernels.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CannyKernels.h"
+
+/**
+ * \brief Gathers blue, green and red bytes of 16 pixels.
+ */
+template <CannyPixelFormat format>
+static inline void LoadChannels(const uint8_t *source, __m128i &blue,
+                                __m128i &green, __m128i &red)
+{
+	if (format == CANNY_PIXEL_BGRA32) {
+		const __m128i low_byte = _mm_set1_epi32(0xff);
+		__m128i channel[3][2];
+
+		for (int j = 0; j < 2; j++) {
+			__m128i a0 = _mm_loadu_si128((const __m128i *) (source + 32 * j));
+			__m128i a1 = _mm_loadu_si128((const __m128i *) (source + 32 * j + 16));
+			for (int c = 0; c < 3; c++) {
+				channel[c][j] = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(a0, 8 * c), low_byte),
+				                                 _mm_and_si128(_mm_srli_epi32(a1, 8 * c), low_byte));
+			}
+		}
+		blue = _mm_packus_epi16(channel[0][0], channel[0][1]);
+		green = _mm_packus_epi16(channel[1][0], channel[1][1]);
+		red = _mm_packus_epi16(channel[2][0], channel[2][1]);
+	} else {
+		// Byte shuffles gathering one channel of 16 pixels out of 48 bytes.
+		const __m128i blue_0  = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i blue_1  = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+		const __m128i blue_2  = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+		const __m128i green_0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i green_1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+		const __m128i green_2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+		const __m128i red_0   = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i red_1   = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+		const __m128i red_2   = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+
+		__m128i a0 = _mm_loadu_si128((const __m128i *) source);
+		__m128i a1 = _mm_loadu_si128((const __m128i *) (source + 16));
+		__m128i a2 = _mm_loadu_si128((const __m128i *) (source + 32));
+
+		__m128i first = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, blue_0),
+		                                          _mm_shuffle_epi8(a1, blue_1)),
+		                             _mm_shuffle_epi8(a2, blue_2));
+		green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, green_0),
+		                                  _mm_shuffle_epi8(a1, green_1)),
+		                     _mm_shuffle_epi8(a2, green_2));
+		__m128i third = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, red_0),
+		                                          _mm_shuffle_epi8(a1, red_1)),
+		                             _mm_shuffle_epi8(a2, red_2));
+		blue = format == CANNY_PIXEL_RGB24 ? third : first;
+		red = format == CANNY_PIXEL_RGB24 ? first : third;
+	}
+}
+
+static void LuminanceGray(const uint8_t *source, uint8_t *destination,
+                          size_t count)
+{
+	memcpy(destination, source, count);
+}
+
+template <CannyPixelFormat format>
+static void LuminanceColor(const uint8_t *source, uint8_t *destination,
+                           size_t count)
+{
+	const unsigned int size = CannyPixelSize(format);
+	const unsigned int red_offset = CannyRedOffset(format);
+	const __m256 red_weight = _mm256_set1_ps(0.299f);
+	const __m256 green_weight = _mm256_set1_ps(0.587f);
+	const __m256 blue_weight = _mm256_set1_ps(0.114f);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i blue, green, red;
+		LoadChannels<format>(source + size * i, blue, green, red);
+
+		__m128i gray[2];
+		for (int j = 0; j < 2; j++) {
+			__m256 b = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(blue));
+			__m256 g = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(green));
+			__m256 r = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(red));
+			__m256 value = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(red_weight, r),
+			                                           _mm256_mul_ps(green_weight, g)),
+			                             _mm256_mul_ps(blue_weight, b));
+			__m256i truncated = _mm256_cvttps_epi32(value);
+			gray[j] = _mm_packs_epi32(_mm256_castsi256_si128(truncated),
+			                          _mm256_extracti128_si256(truncated, 1));
+			blue = _mm_srli_si128(blue, 8);
+			green = _mm_srli_si128(green, 8);
+			red = _mm_srli_si128(red, 8);
+		}
+		_mm_storeu_si128((__m128i *) (destination + i),
+		                 _mm_packus_epi16(gray[0], gray[1]));
+	}
+	for (; i < count; i++) {
+		const uint8_t *pixel = source + size * i;
+		destination[i] = CannyLuminance(pixel[2 - red_offset], pixel[1], pixel[red_offset]);
+	}
+}
+
+template <unsigned int Halfsize>
+static void BlurHorizontalSized(const uint8_t *source, float *destination,
+                                size_t count, const float *kernel,
+                                unsigned int halfsize)
+{
+	const uint8_t *first = source - halfsize;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 new_pixel = _mm256_setzero_ps();
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m128i bytes = _mm_loadl_epi64((const __m128i *) (first + i + k));
+			__m256 value = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+			new_pixel = _mm256_add_ps(new_pixel, _mm256_mul_ps(value, _mm256_set1_ps(kernel[k])));
+		}
+		_mm256_storeu_ps(destination + i, new_pixel);
+	}
+	for (; i < count; i++) {
+		float new_pixel = 0.0f;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += (float) first[i + k] * kernel[k];
+		}
+		destination[i] = new_pixel;
+	}
+}
+
+static void BlurHorizontal(const uint8_t *source, float *destination,
+                           size_t count, const float *kernel,
+                           unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurHorizontalSized, halfsize, source, destination, count, kernel, halfsize);
+}
+
+template <unsigned int Halfsize>
+static void BlurVerticalSized(const float *source, size_t stride,
+                              uint8_t *destination, size_t count,
+                              const float *kernel, unsigned int halfsize)
+{
+	const float *first = source - halfsize * stride;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+	const __m256 half = _mm256_set1_ps(0.5f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 new_pixel = _mm256_setzero_ps();
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m256 value = _mm256_loadu_ps(first + k * stride + i);
+			new_pixel = _mm256_add_ps(new_pixel, _mm256_mul_ps(value, _mm256_set1_ps(kernel[k])));
+		}
+		__m256i rounded = _mm256_cvttps_epi32(_mm256_add_ps(new_pixel, half));
+		__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(rounded),
+		                                _mm256_extracti128_si256(rounded, 1));
+		_mm_storel_epi64((__m128i *) (destination + i), _mm_packus_epi16(words, words));
+	}
+	for (; i < count; i++) {
+		float new_pixel = 0.0f;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += first[k * stride + i] * kernel[k];
+		}
+		destination[i] = (uint8_t) (new_pixel + 0.5f);
+	}
+}
+
+static void BlurVertical(const float *source, size_t stride,
+                         uint8_t *destination, size_t count,
+                         const float *kernel, unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurVerticalSized, halfsize, source, stride, destination, count, kernel, halfsize);
+}
+
+static inline __m256i LoadPixels(const uint8_t *source)
+{
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) source));
+}
+
+static inline __m256 Magnitude(__m128i gx, __m128i gy)
+{
+	__m256i gx_wide = _mm256_cvtepi16_epi32(gx);
+	__m256i gy_wide = _mm256_cvtepi16_epi32(gy);
+	__m256i square = _mm256_add_epi32(_mm256_mullo_epi32(gx_wide, gx_wide),
+	                                  _mm256_mullo_epi32(gy_wide, gy_wide));
+	return _mm256_mul_ps(_mm256_sqrt_ps(_mm256_cvtepi32_ps(square)),
+	                     _mm256_set1_ps(0.25f));
+}
+
+static float Sobel(const uint8_t *source, size_t stride, float *magnitude,
+                   uint8_t *direction, size_t count)
+{
+	const uint8_t *above = source - stride;
+	const uint8_t *below = source + stride;
+	__m256 max_vector = _mm256_setzero_ps();
+	int16_t gx_values[16];
+	int16_t gy_values[16];
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i above_left   = LoadPixels(above + i - 1);
+		__m256i above_center = LoadPixels(above + i);
+		__m256i above_right  = LoadPixels(above + i + 1);
+		__m256i left         = LoadPixels(source + i - 1);
+		__m256i right        = LoadPixels(source + i + 1);
+		__m256i below_left   = LoadPixels(below + i - 1);
+		__m256i below_center = LoadPixels(below + i);
+		__m256i below_right  = LoadPixels(below + i + 1);
+
+		__m256i gx = _mm256_sub_epi16(
+			_mm256_add_epi16(_mm256_add_epi16(below_left, below_right),
+			                 _mm256_slli_epi16(below_center, 1)),
+			_mm256_add_epi16(_mm256_add_epi16(above_left, above_right),
+			                 _mm256_slli_epi16(above_center, 1)));
+		__m256i gy = _mm256_sub_epi16(
+			_mm256_add_epi16(_mm256_add_epi16(above_left, below_left),
+			                 _mm256_slli_epi16(left, 1)),
+			_mm256_add_epi16(_mm256_add_epi16(above_right, below_right),
+			                 _mm256_slli_epi16(right, 1)));
+
+		__m256 magnitude_low = Magnitude(_mm256_castsi256_si128(gx),
+		                                 _mm256_castsi256_si128(gy));
+		__m256 magnitude_high = Magnitude(_mm256_extracti128_si256(gx, 1),
+		                                  _mm256_extracti128_si256(gy, 1));
+		_mm256_storeu_ps(magnitude + i, magnitude_low);
+		_mm256_storeu_ps(magnitude + i + 8, magnitude_high);
+		max_vector = _mm256_max_ps(max_vector, _mm256_max_ps(magnitude_low, magnitude_high));
+
+		_mm256_storeu_si256((__m256i *) gx_values, gx);
+		_mm256_storeu_si256((__m256i *) gy_values, gy);
+		for (int j = 0; j < 16; j++) {
+			direction[i + j] = CannyDirection(gx_values[j], gy_values[j]);
+		}
+	}
+
+	float max_values[8];
+	float max = 0.0f;
+	_mm256_storeu_ps(max_values, max_vector);
+	for (int j = 0; j < 8; j++) {
+		max = max_values[j] > max ? max_values[j] : max;
+	}
+
+	for (; i < count; i++) {
+		int gx = (below[i - 1] + 2 * below[i] + below[i + 1])
+		       - (above[i - 1] + 2 * above[i] + above[i + 1]);
+		int gy = (above[i - 1] + 2 * source[i - 1] + below[i - 1])
+		       - (above[i + 1] + 2 * source[i + 1] + below[i + 1]);
+
+		magnitude[i] = sqrtf((float) (gx * gx + gy * gy)) * 0.25f;
+		max = magnitude[i] > max ? magnitude[i] : max;
+		direction[i] = CannyDirection(gx, gy);
+	}
+
+	return max;
+}
+
+/**
+ * \brief Vector version of CannyDirectionFast(), sixteen 16-bit codes.
+ */
+static inline __m256i DirectionFast(__m256i gx, __m256i gy)
+{
+	__m256i ax = _mm256_abs_epi16(gx);
+	__m256i ay = _mm256_abs_epi16(gy);
+	__m256i tangent = _mm256_mulhi_epu16(ax, _mm256_set1_epi16(CANNY_TAN_22_5));
+	__m256i not_horizontal = _mm256_cmpgt_epi16(ay, tangent);
+	__m256i vertical = _mm256_cmpgt_epi16(_mm256_sub_epi16(ay, _mm256_add_epi16(ax, ax)), tangent);
+	__m256i opposite = _mm256_srai_epi16(_mm256_xor_si256(gx, gy), 15);
+
+	// 45 degrees, turned into 135 where signs of gradients differ.
+	__m256i code = _mm256_or_si256(_mm256_set1_epi16(CANNY_DIRECTION_45),
+	                               _mm256_and_si256(opposite, _mm256_set1_epi16(CANNY_DIRECTION_135 & ~CANNY_DIRECTION_45)));
+	code = _mm256_blendv_epi8(code, _mm256_set1_epi16(CANNY_DIRECTION_90), vertical);
+	return _mm256_and_si256(code, not_horizontal);
+}
+
+/**
+ * \brief Squares of eight gradients, in order.
+ */
+static inline __m256 SquaredMagnitude(__m128i gx, __m128i gy)
+{
+	__m256i pairs = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(gx, gy)),
+	                                        _mm_unpackhi_epi16(gx, gy), 1);
+	return _mm256_cvtepi32_ps(_mm256_madd_epi16(pairs, pairs));
+}
+
+/**
+ * \brief Sobel operator with squared (`l1` false) or L1 norm.
+ */
+template <bool l1>
+static float SobelFast(const uint8_t *source, size_t stride, float *magnitude,
+                       uint8_t *direction, size_t count)
+{
+	const uint8_t *above = source - stride;
+	const uint8_t *below = source + stride;
+	__m256 max_vector = _mm256_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i above_left   = LoadPixels(above + i - 1);
+		__m256i above_center = LoadPixels(above + i);
+		__m256i above_right  = LoadPixels(above + i + 1);
+		__m256i left         = LoadPixels(source + i - 1);
+		__m256i right        = LoadPixels(source + i + 1);
+		__m256i below_left   = LoadPixels(below + i - 1);
+		__m256i below_center = LoadPixels(below + i);
+		__m256i below_right  = LoadPixels(below + i + 1);
+
+		__m256i gx = _mm256_sub_epi16(
+			_mm256_add_epi16(_mm256_add_epi16(below_left, below_right),
+			                 _mm256_slli_epi16(below_center, 1)),
+			_mm256_add_epi16(_mm256_add_epi16(above_left, above_right),
+			                 _mm256_slli_epi16(above_center, 1)));
+		__m256i gy = _mm256_sub_epi16(
+			_mm256_add_epi16(_mm256_add_epi16(above_left, below_left),
+			                 _mm256_slli_epi16(left, 1)),
+			_mm256_add_epi16(_mm256_add_epi16(above_right, below_right),
+			                 _mm256_slli_epi16(right, 1)));
+
+		__m256 magnitude_low, magnitude_high;
+		if (l1) {
+			__m256i sum = _mm256_add_epi16(_mm256_abs_epi16(gx), _mm256_abs_epi16(gy));
+			magnitude_low = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(sum)));
+			magnitude_high = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(sum, 1)));
+		} else {
+			magnitude_low = SquaredMagnitude(_mm256_castsi256_si128(gx),
+			                                 _mm256_castsi256_si128(gy));
+			magnitude_high = SquaredMagnitude(_mm256_extracti128_si256(gx, 1),
+			                                  _mm256_extracti128_si256(gy, 1));
+		}
+		_mm256_storeu_ps(magnitude + i, magnitude_low);
+		_mm256_storeu_ps(magnitude + i + 8, magnitude_high);
+		max_vector = _mm256_max_ps(max_vector, _mm256_max_ps(magnitude_low, magnitude_high));
+
+		__m256i code = DirectionFast(gx, gy);
+		_mm_storeu_si128((__m128i *) (direction + i),
+		                 _mm_packus_epi16(_mm256_castsi256_si128(code),
+		                                  _mm256_extracti128_si256(code, 1)));
+	}
+
+	float max_values[8];
+	float max = 0.0f;
+	_mm256_storeu_ps(max_values, max_vector);
+	for (int j = 0; j < 8; j++) {
+		max = max_values[j] > max ? max_values[j] : max;
+	}
+
+	for (; i < count; i++) {
+		int gx = (below[i - 1] + 2 * below[i] + below[i + 1])
+		       - (above[i - 1] + 2 * above[i] + above[i + 1]);
+		int gy = (above[i - 1] + 2 * source[i - 1] + below[i - 1])
+		       - (above[i + 1] + 2 * source[i + 1] + below[i + 1]);
+
+		if (l1) {
+			magnitude[i] = (float) (abs(gx) + abs(gy));
+		} else {
+			magnitude[i] = (float) (gx * gx + gy * gy);
+		}
+		max = magnitude[i] > max ? magnitude[i] : max;
+		direction[i] = CannyDirectionFast(gx, gy);
+	}
+
+	return max;
+}
+
+template <CannyPixelFormat format>
+static void LuminanceColorFixed(const uint8_t *source, uint8_t *destination,
+                                size_t count)
+{
+	const unsigned int size = CannyPixelSize(format);
+	const unsigned int red_offset = CannyRedOffset(format);
+	const __m256i red_weight = _mm256_set1_epi16(77);
+	const __m256i green_weight = _mm256_set1_epi16(150);
+	const __m256i blue_weight = _mm256_set1_epi16(29);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i blue, green, red;
+		LoadChannels<format>(source + size * i, blue, green, red);
+
+		// Weighted sum never exceeds 255 * 256, so it fits unsigned words.
+		__m256i gray = _mm256_add_epi16(_mm256_add_epi16(
+			_mm256_mullo_epi16(_mm256_cvtepu8_epi16(red), red_weight),
+			_mm256_mullo_epi16(_mm256_cvtepu8_epi16(green), green_weight)),
+			_mm256_mullo_epi16(_mm256_cvtepu8_epi16(blue), blue_weight));
+		gray = _mm256_srli_epi16(gray, 8);
+		_mm_storeu_si128((__m128i *) (destination + i),
+		                 _mm_packus_epi16(_mm256_castsi256_si128(gray),
+		                                  _mm256_extracti128_si256(gray, 1)));
+	}
+	for (; i < count; i++) {
+		const uint8_t *pixel = source + size * i;
+		destination[i] = CannyLuminanceFixed(pixel[2 - red_offset], pixel[1], pixel[red_offset]);
+	}
+}
+
+template <unsigned int Halfsize>
+static void BlurHorizontalFixedSized(const uint8_t *source, uint16_t *destination,
+                                     size_t count, const uint16_t *kernel,
+                                     unsigned int halfsize)
+{
+	const uint8_t *first = source - halfsize;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i new_pixel = _mm256_setzero_si256();
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m256i value = LoadPixels(first + i + k);
+			new_pixel = _mm256_add_epi16(new_pixel, _mm256_mullo_epi16(value, _mm256_set1_epi16(kernel[k])));
+		}
+		_mm256_storeu_si256((__m256i *) (destination + i), new_pixel);
+	}
+	for (; i < count; i++) {
+		uint16_t new_pixel = 0;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += first[i + k] * kernel[k];
+		}
+		destination[i] = new_pixel;
+	}
+}
+
+static void BlurHorizontalFixed(const uint8_t *source, uint16_t *destination,
+                                size_t count, const uint16_t *kernel,
+                                unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurHorizontalFixedSized, halfsize, source, destination, count, kernel, halfsize);
+}
+
+template <unsigned int Halfsize>
+static void BlurVerticalFixedSized(const uint16_t *source, size_t stride,
+                                   uint8_t *destination, size_t count,
+                                   const uint16_t *kernel, unsigned int halfsize)
+{
+	const uint16_t *first = source - halfsize * stride;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+	const __m256i half = _mm256_set1_epi32(1 << 22);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m256i new_low = half;
+		__m256i new_high = half;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m256i value = _mm256_loadu_si256((const __m256i *) (first + k * stride + i));
+			__m256i weight = _mm256_set1_epi16((int16_t) kernel[k]);
+			// 32-bit products out of their low and high halves, which is
+			// cheaper than widening values and multiplying in 32 bits.
+			__m256i product_low = _mm256_mullo_epi16(value, weight);
+			__m256i product_high = _mm256_mulhi_epu16(value, weight);
+			new_low = _mm256_add_epi32(new_low, _mm256_unpacklo_epi16(product_low, product_high));
+			new_high = _mm256_add_epi32(new_high, _mm256_unpackhi_epi16(product_low, product_high));
+		}
+		// Unpacking and packing both work within 128-bit lanes, so pixels
+		// come out in order.
+		__m256i words = _mm256_packus_epi32(_mm256_srli_epi32(new_low, 23),
+		                                    _mm256_srli_epi32(new_high, 23));
+		_mm_storeu_si128((__m128i *) (destination + i),
+		                 _mm_packus_epi16(_mm256_castsi256_si128(words),
+		                                  _mm256_extracti128_si256(words, 1)));
+	}
+	for (; i < count; i++) {
+		uint32_t new_pixel = 0;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += (uint32_t) first[k * stride + i] * kernel[k];
+		}
+		destination[i] = CannyBlurFixedRound(new_pixel);
+	}
+}
+
+static void BlurVerticalFixed(const uint16_t *source, size_t stride,
+                              uint8_t *destination, size_t count,
+                              const uint16_t *kernel, unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurVerticalFixedSized, halfsize, source, stride, destination, count, kernel, halfsize);
+}
+
+static void BlurRecursive(float *row, ptrdiff_t step, uint8_t *destination,
+                          size_t count, const CannyRecursiveFilter *filter)
+{
+	const __m256 b = _mm256_set1_ps(filter->b);
+	const __m256 a1 = _mm256_set1_ps(filter->a[0]);
+	const __m256 a2 = _mm256_set1_ps(filter->a[1]);
+	const __m256 a3 = _mm256_set1_ps(filter->a[2]);
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256 black = _mm256_setzero_ps();
+	const __m256 white = _mm256_set1_ps(255.0f);
+	size_t i = 0;
+
+	// Same order of operations as CannyRecursiveStep().
+	for (; i + 8 <= count; i += 8) {
+		__m256 value = _mm256_mul_ps(b, _mm256_loadu_ps(row + i));
+		value = _mm256_add_ps(value, _mm256_mul_ps(a3, _mm256_loadu_ps(row + i + 3 * step)));
+		value = _mm256_add_ps(value, _mm256_mul_ps(a2, _mm256_loadu_ps(row + i + 2 * step)));
+		value = _mm256_add_ps(value, _mm256_mul_ps(a1, _mm256_loadu_ps(row + i + step)));
+		_mm256_storeu_ps(row + i, value);
+		if (destination != NULL) {
+			// Same clamping as CannyRecursiveRound().
+			__m256 pixel = _mm256_min_ps(_mm256_max_ps(_mm256_add_ps(value, half), black), white);
+			__m256i words = _mm256_cvttps_epi32(pixel);
+			__m128i packed = _mm_packus_epi32(_mm256_castsi256_si128(words),
+			                                  _mm256_extracti128_si256(words, 1));
+			_mm_storel_epi64((__m128i *) (destination + i), _mm_packus_epi16(packed, packed));
+		}
+	}
+	for (; i < count; i++) {
+		row[i] = CannyRecursiveStep(row + i, step, filter);
+		if (destination != NULL) {
+			destination[i] = CannyRecursiveRound(row[i]);
+		}
+	}
+}
+
+/**
+ * \brief Transposes 8x8 block of floats held in registers.
+ */
+static inline void Transpose8x8(__m256 block[8])
+{
+	__m256 pairs[8], quads[8];
+
+	for (int k = 0; k < 8; k += 2) {
+		pairs[k] = _mm256_unpacklo_ps(block[k], block[k + 1]);
+		pairs[k + 1] = _mm256_unpackhi_ps(block[k], block[k + 1]);
+	}
+	for (int k = 0; k < 8; k += 4) {
+		quads[k] = _mm256_shuffle_ps(pairs[k], pairs[k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+		quads[k + 1] = _mm256_shuffle_ps(pairs[k], pairs[k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+		quads[k + 2] = _mm256_shuffle_ps(pairs[k + 1], pairs[k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+		quads[k + 3] = _mm256_shuffle_ps(pairs[k + 1], pairs[k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+	}
+	for (int k = 0; k < 4; k++) {
+		block[k] = _mm256_permute2f128_ps(quads[k], quads[k + 4], 0x20);
+		block[k + 4] = _mm256_permute2f128_ps(quads[k], quads[k + 4], 0x31);
+	}
+}
+
+static void TransposeGray(const uint8_t *source, size_t stride, float *destination,
+                          size_t rows, size_t count)
+{
+	size_t y = 0;
+
+	// Rows are taken eight at a time, in 8x8 blocks.
+	if (rows % 8 == 0) {
+		for (; y + 8 <= count; y += 8) {
+			for (size_t x = 0; x < rows; x += 8) {
+				__m256 block[8];
+				for (int k = 0; k < 8; k++) {
+					__m128i bytes = _mm_loadl_epi64((const __m128i *) (source + (x + k) * stride + y));
+					block[k] = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(bytes));
+				}
+				Transpose8x8(block);
+				for (int k = 0; k < 8; k++) {
+					_mm256_storeu_ps(destination + (y + k) * rows + x, block[k]);
+				}
+			}
+		}
+	}
+	for (; y < count; y++) {
+		for (size_t x = 0; x < rows; x++) {
+			destination[y * rows + x] = source[x * stride + y];
+		}
+	}
+}
+
+static void TransposeFloat(const float *source, float *destination, size_t stride,
+                           size_t rows, size_t count)
+{
+	size_t y = 0;
+
+	if (rows % 8 == 0) {
+		for (; y + 8 <= count; y += 8) {
+			for (size_t x = 0; x < rows; x += 8) {
+				__m256 block[8];
+				for (int k = 0; k < 8; k++) {
+					block[k] = _mm256_loadu_ps(source + (y + k) * rows + x);
+				}
+				Transpose8x8(block);
+				for (int k = 0; k < 8; k++) {
+					_mm256_storeu_ps(destination + (x + k) * stride + y, block[k]);
+				}
+			}
+		}
+	}
+	for (; y < count; y++) {
+		for (size_t x = 0; x < rows; x++) {
+			destination[x * stride + y] = source[y * rows + x];
+		}
+	}
+}
+
+extern const CannyKernels canny_kernels_avx2;
+const CannyKernels canny_kernels_avx2 = {
+	CANNY_KERNELS_AVX2,
+	"avx2",
+	{
+		LuminanceGray,
+		LuminanceColor<CANNY_PIXEL_BGR24>,
+		LuminanceColor<CANNY_PIXEL_RGB24>,
+		LuminanceColor<CANNY_PIXEL_BGRA32>
+	},
+	BlurHorizontal,
+	BlurVertical,
+	Sobel,
+	{
+		LuminanceGray,
+		LuminanceColorFixed<CANNY_PIXEL_BGR24>,
+		LuminanceColorFixed<CANNY_PIXEL_RGB24>,
+		LuminanceColorFixed<CANNY_PIXEL_BGRA32>
+	},
+	BlurHorizontalFixed,
+	BlurVerticalFixed,
+	SobelFast<false>,
+	SobelFast<true>,
+	BlurRecursive,
+	TransposeGray,
+	TransposeFloat
+};
+
+#endif // #if defined(__x86_64__) || defined(__i386__)
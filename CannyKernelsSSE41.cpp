@@ -0,0 +1,599 @@
+/**
+ * \file      CannyKernelsSSE41.cpp
+ * \brief     Row kernels vectorized with SSE4.1.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ * This file is compiled with -msse4.1, so nothing here may be called before
+ * CannySelectKernels() confirms processor support. All functions are
+ * static, otherwise linker could pick their SSE4.1 copies for scalar code.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <smmintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CannyKernels.h"
+
+/**
+ * \brief Gathers blue, green and red bytes of 16 pixels.
+ */
+template <CannyPixelFormat format>
+static inline void LoadChannels(const uint8_t *source, __m128i &blue,
+                                __m128i &green, __m128i &red)
+{
+	if (format == CANNY_PIXEL_BGRA32) {
+		const __m128i low_byte = _mm_set1_epi32(0xff);
+		__m128i channel[3][2];
+
+		for (int j = 0; j < 2; j++) {
+			__m128i a0 = _mm_loadu_si128((const __m128i *) (source + 32 * j));
+			__m128i a1 = _mm_loadu_si128((const __m128i *) (source + 32 * j + 16));
+			for (int c = 0; c < 3; c++) {
+				channel[c][j] = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(a0, 8 * c), low_byte),
+				                                 _mm_and_si128(_mm_srli_epi32(a1, 8 * c), low_byte));
+			}
+		}
+		blue = _mm_packus_epi16(channel[0][0], channel[0][1]);
+		green = _mm_packus_epi16(channel[1][0], channel[1][1]);
+		red = _mm_packus_epi16(channel[2][0], channel[2][1]);
+	} else {
+		// Byte shuffles gathering one channel of 16 pixels out of 48 bytes.
+		const __m128i blue_0  = _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i blue_1  = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1);
+		const __m128i blue_2  = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13);
+		const __m128i green_0 = _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i green_1 = _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1);
+		const __m128i green_2 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14);
+		const __m128i red_0   = _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i red_1   = _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1);
+		const __m128i red_2   = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15);
+
+		__m128i a0 = _mm_loadu_si128((const __m128i *) source);
+		__m128i a1 = _mm_loadu_si128((const __m128i *) (source + 16));
+		__m128i a2 = _mm_loadu_si128((const __m128i *) (source + 32));
+
+		__m128i first = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, blue_0),
+		                                          _mm_shuffle_epi8(a1, blue_1)),
+		                             _mm_shuffle_epi8(a2, blue_2));
+		green = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, green_0),
+		                                  _mm_shuffle_epi8(a1, green_1)),
+		                     _mm_shuffle_epi8(a2, green_2));
+		__m128i third = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, red_0),
+		                                          _mm_shuffle_epi8(a1, red_1)),
+		                             _mm_shuffle_epi8(a2, red_2));
+		blue = format == CANNY_PIXEL_RGB24 ? third : first;
+		red = format == CANNY_PIXEL_RGB24 ? first : third;
+	}
+}
+
+static void LuminanceGray(const uint8_t *source, uint8_t *destination,
+                          size_t count)
+{
+	memcpy(destination, source, count);
+}
+
+template <CannyPixelFormat format>
+static void LuminanceColor(const uint8_t *source, uint8_t *destination,
+                           size_t count)
+{
+	const unsigned int size = CannyPixelSize(format);
+	const unsigned int red_offset = CannyRedOffset(format);
+	const __m128 red_weight = _mm_set1_ps(0.299f);
+	const __m128 green_weight = _mm_set1_ps(0.587f);
+	const __m128 blue_weight = _mm_set1_ps(0.114f);
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i blue, green, red;
+		LoadChannels<format>(source + size * i, blue, green, red);
+
+		__m128i gray[4];
+		for (int j = 0; j < 4; j++) {
+			__m128 b = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(blue));
+			__m128 g = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(green));
+			__m128 r = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(red));
+			__m128 value = _mm_add_ps(_mm_add_ps(_mm_mul_ps(red_weight, r),
+			                                     _mm_mul_ps(green_weight, g)),
+			                          _mm_mul_ps(blue_weight, b));
+			gray[j] = _mm_cvttps_epi32(value);
+			blue = _mm_srli_si128(blue, 4);
+			green = _mm_srli_si128(green, 4);
+			red = _mm_srli_si128(red, 4);
+		}
+		__m128i packed = _mm_packus_epi16(_mm_packs_epi32(gray[0], gray[1]),
+		                                  _mm_packs_epi32(gray[2], gray[3]));
+		_mm_storeu_si128((__m128i *) (destination + i), packed);
+	}
+	for (; i < count; i++) {
+		const uint8_t *pixel = source + size * i;
+		destination[i] = CannyLuminance(pixel[2 - red_offset], pixel[1], pixel[red_offset]);
+	}
+}
+
+template <unsigned int Halfsize>
+static void BlurHorizontalSized(const uint8_t *source, float *destination,
+                                size_t count, const float *kernel,
+                                unsigned int halfsize)
+{
+	const uint8_t *first = source - halfsize;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 new_pixel = _mm_setzero_ps();
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			int32_t bytes;
+			memcpy(&bytes, first + i + k, sizeof(bytes));
+			__m128 value = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+			new_pixel = _mm_add_ps(new_pixel, _mm_mul_ps(value, _mm_set1_ps(kernel[k])));
+		}
+		_mm_storeu_ps(destination + i, new_pixel);
+	}
+	for (; i < count; i++) {
+		float new_pixel = 0.0f;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += (float) first[i + k] * kernel[k];
+		}
+		destination[i] = new_pixel;
+	}
+}
+
+static void BlurHorizontal(const uint8_t *source, float *destination,
+                           size_t count, const float *kernel,
+                           unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurHorizontalSized, halfsize, source, destination, count, kernel, halfsize);
+}
+
+template <unsigned int Halfsize>
+static void BlurVerticalSized(const float *source, size_t stride,
+                              uint8_t *destination, size_t count,
+                              const float *kernel, unsigned int halfsize)
+{
+	const float *first = source - halfsize * stride;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 new_pixel = _mm_setzero_ps();
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m128 value = _mm_loadu_ps(first + k * stride + i);
+			new_pixel = _mm_add_ps(new_pixel, _mm_mul_ps(value, _mm_set1_ps(kernel[k])));
+		}
+		__m128i rounded = _mm_cvttps_epi32(_mm_add_ps(new_pixel, half));
+		rounded = _mm_packus_epi16(_mm_packs_epi32(rounded, rounded), rounded);
+		int32_t bytes = _mm_cvtsi128_si32(rounded);
+		memcpy(destination + i, &bytes, sizeof(bytes));
+	}
+	for (; i < count; i++) {
+		float new_pixel = 0.0f;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += first[k * stride + i] * kernel[k];
+		}
+		destination[i] = (uint8_t) (new_pixel + 0.5f);
+	}
+}
+
+static void BlurVertical(const float *source, size_t stride,
+                         uint8_t *destination, size_t count,
+                         const float *kernel, unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurVerticalSized, halfsize, source, stride, destination, count, kernel, halfsize);
+}
+
+static inline __m128i LoadPixels(const uint8_t *source)
+{
+	return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) source));
+}
+
+static float Sobel(const uint8_t *source, size_t stride, float *magnitude,
+                   uint8_t *direction, size_t count)
+{
+	const uint8_t *above = source - stride;
+	const uint8_t *below = source + stride;
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	__m128 max_vector = _mm_setzero_ps();
+	int16_t gx_values[8];
+	int16_t gy_values[8];
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i above_left   = LoadPixels(above + i - 1);
+		__m128i above_center = LoadPixels(above + i);
+		__m128i above_right  = LoadPixels(above + i + 1);
+		__m128i left         = LoadPixels(source + i - 1);
+		__m128i right        = LoadPixels(source + i + 1);
+		__m128i below_left   = LoadPixels(below + i - 1);
+		__m128i below_center = LoadPixels(below + i);
+		__m128i below_right  = LoadPixels(below + i + 1);
+
+		__m128i gx = _mm_sub_epi16(
+			_mm_add_epi16(_mm_add_epi16(below_left, below_right),
+			              _mm_slli_epi16(below_center, 1)),
+			_mm_add_epi16(_mm_add_epi16(above_left, above_right),
+			              _mm_slli_epi16(above_center, 1)));
+		__m128i gy = _mm_sub_epi16(
+			_mm_add_epi16(_mm_add_epi16(above_left, below_left),
+			              _mm_slli_epi16(left, 1)),
+			_mm_add_epi16(_mm_add_epi16(above_right, below_right),
+			              _mm_slli_epi16(right, 1)));
+
+		// gx * gx + gy * gy in 32 bits, pairwise.
+		__m128i low = _mm_unpacklo_epi16(gx, gy);
+		__m128i high = _mm_unpackhi_epi16(gx, gy);
+		__m128 magnitude_low = _mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(low, low))), quarter);
+		__m128 magnitude_high = _mm_mul_ps(_mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(high, high))), quarter);
+		_mm_storeu_ps(magnitude + i, magnitude_low);
+		_mm_storeu_ps(magnitude + i + 4, magnitude_high);
+		max_vector = _mm_max_ps(max_vector, _mm_max_ps(magnitude_low, magnitude_high));
+
+		_mm_storeu_si128((__m128i *) gx_values, gx);
+		_mm_storeu_si128((__m128i *) gy_values, gy);
+		for (int j = 0; j < 8; j++) {
+			direction[i + j] = CannyDirection(gx_values[j], gy_values[j]);
+		}
+	}
+
+	float max_values[4];
+	float max = 0.0f;
+	_mm_storeu_ps(max_values, max_vector);
+	for (int j = 0; j < 4; j++) {
+		max = max_values[j] > max ? max_values[j] : max;
+	}
+
+	for (; i < count; i++) {
+		int gx = (below[i - 1] + 2 * below[i] + below[i + 1])
+		       - (above[i - 1] + 2 * above[i] + above[i + 1]);
+		int gy = (above[i - 1] + 2 * source[i - 1] + below[i - 1])
+		       - (above[i + 1] + 2 * source[i + 1] + below[i + 1]);
+
+		magnitude[i] = sqrtf((float) (gx * gx + gy * gy)) * 0.25f;
+		max = magnitude[i] > max ? magnitude[i] : max;
+		direction[i] = CannyDirection(gx, gy);
+	}
+
+	return max;
+}
+
+/**
+ * \brief Vector version of CannyDirectionFast(), eight 16-bit codes.
+ */
+static inline __m128i DirectionFast(__m128i gx, __m128i gy)
+{
+	__m128i ax = _mm_abs_epi16(gx);
+	__m128i ay = _mm_abs_epi16(gy);
+	__m128i tangent = _mm_mulhi_epu16(ax, _mm_set1_epi16(CANNY_TAN_22_5));
+	__m128i not_horizontal = _mm_cmpgt_epi16(ay, tangent);
+	__m128i vertical = _mm_cmpgt_epi16(_mm_sub_epi16(ay, _mm_add_epi16(ax, ax)), tangent);
+	__m128i opposite = _mm_srai_epi16(_mm_xor_si128(gx, gy), 15);
+
+	// 45 degrees, turned into 135 where signs of gradients differ.
+	__m128i code = _mm_or_si128(_mm_set1_epi16(CANNY_DIRECTION_45),
+	                            _mm_and_si128(opposite, _mm_set1_epi16(CANNY_DIRECTION_135 & ~CANNY_DIRECTION_45)));
+	code = _mm_blendv_epi8(code, _mm_set1_epi16(CANNY_DIRECTION_90), vertical);
+	return _mm_and_si128(code, not_horizontal);
+}
+
+/**
+ * \brief Sobel operator with squared (`l1` false) or L1 norm.
+ */
+template <bool l1>
+static float SobelFast(const uint8_t *source, size_t stride, float *magnitude,
+                       uint8_t *direction, size_t count)
+{
+	const uint8_t *above = source - stride;
+	const uint8_t *below = source + stride;
+	__m128 max_vector = _mm_setzero_ps();
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i above_left   = LoadPixels(above + i - 1);
+		__m128i above_center = LoadPixels(above + i);
+		__m128i above_right  = LoadPixels(above + i + 1);
+		__m128i left         = LoadPixels(source + i - 1);
+		__m128i right        = LoadPixels(source + i + 1);
+		__m128i below_left   = LoadPixels(below + i - 1);
+		__m128i below_center = LoadPixels(below + i);
+		__m128i below_right  = LoadPixels(below + i + 1);
+
+		__m128i gx = _mm_sub_epi16(
+			_mm_add_epi16(_mm_add_epi16(below_left, below_right),
+			              _mm_slli_epi16(below_center, 1)),
+			_mm_add_epi16(_mm_add_epi16(above_left, above_right),
+			              _mm_slli_epi16(above_center, 1)));
+		__m128i gy = _mm_sub_epi16(
+			_mm_add_epi16(_mm_add_epi16(above_left, below_left),
+			              _mm_slli_epi16(left, 1)),
+			_mm_add_epi16(_mm_add_epi16(above_right, below_right),
+			              _mm_slli_epi16(right, 1)));
+
+		__m128 magnitude_low, magnitude_high;
+		if (l1) {
+			__m128i sum = _mm_add_epi16(_mm_abs_epi16(gx), _mm_abs_epi16(gy));
+			magnitude_low = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(sum));
+			magnitude_high = _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_srli_si128(sum, 8)));
+		} else {
+			__m128i low = _mm_unpacklo_epi16(gx, gy);
+			__m128i high = _mm_unpackhi_epi16(gx, gy);
+			magnitude_low = _mm_cvtepi32_ps(_mm_madd_epi16(low, low));
+			magnitude_high = _mm_cvtepi32_ps(_mm_madd_epi16(high, high));
+		}
+		_mm_storeu_ps(magnitude + i, magnitude_low);
+		_mm_storeu_ps(magnitude + i + 4, magnitude_high);
+		max_vector = _mm_max_ps(max_vector, _mm_max_ps(magnitude_low, magnitude_high));
+
+		__m128i code = DirectionFast(gx, gy);
+		_mm_storel_epi64((__m128i *) (direction + i), _mm_packus_epi16(code, code));
+	}
+
+	float max_values[4];
+	float max = 0.0f;
+	_mm_storeu_ps(max_values, max_vector);
+	for (int j = 0; j < 4; j++) {
+		max = max_values[j] > max ? max_values[j] : max;
+	}
+
+	for (; i < count; i++) {
+		int gx = (below[i - 1] + 2 * below[i] + below[i + 1])
+		       - (above[i - 1] + 2 * above[i] + above[i + 1]);
+		int gy = (above[i - 1] + 2 * source[i - 1] + below[i - 1])
+		       - (above[i + 1] + 2 * source[i + 1] + below[i + 1]);
+
+		if (l1) {
+			magnitude[i] = (float) (abs(gx) + abs(gy));
+		} else {
+			magnitude[i] = (float) (gx * gx + gy * gy);
+		}
+		max = magnitude[i] > max ? magnitude[i] : max;
+		direction[i] = CannyDirectionFast(gx, gy);
+	}
+
+	return max;
+}
+
+template <CannyPixelFormat format>
+static void LuminanceColorFixed(const uint8_t *source, uint8_t *destination,
+                                size_t count)
+{
+	const unsigned int size = CannyPixelSize(format);
+	const unsigned int red_offset = CannyRedOffset(format);
+	const __m128i red_weight = _mm_set1_epi16(77);
+	const __m128i green_weight = _mm_set1_epi16(150);
+	const __m128i blue_weight = _mm_set1_epi16(29);
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i blue, green, red;
+		LoadChannels<format>(source + size * i, blue, green, red);
+
+		// Weighted sum never exceeds 255 * 256, so it fits unsigned words.
+		__m128i gray_low = _mm_add_epi16(_mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(red, zero), red_weight),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(green, zero), green_weight)),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(blue, zero), blue_weight));
+		__m128i gray_high = _mm_add_epi16(_mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(red, zero), red_weight),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(green, zero), green_weight)),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(blue, zero), blue_weight));
+		_mm_storeu_si128((__m128i *) (destination + i),
+		                 _mm_packus_epi16(_mm_srli_epi16(gray_low, 8),
+		                                  _mm_srli_epi16(gray_high, 8)));
+	}
+	for (; i < count; i++) {
+		const uint8_t *pixel = source + size * i;
+		destination[i] = CannyLuminanceFixed(pixel[2 - red_offset], pixel[1], pixel[red_offset]);
+	}
+}
+
+template <unsigned int Halfsize>
+static void BlurHorizontalFixedSized(const uint8_t *source, uint16_t *destination,
+                                     size_t count, const uint16_t *kernel,
+                                     unsigned int halfsize)
+{
+	const uint8_t *first = source - halfsize;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i new_pixel = _mm_setzero_si128();
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m128i value = LoadPixels(first + i + k);
+			new_pixel = _mm_add_epi16(new_pixel, _mm_mullo_epi16(value, _mm_set1_epi16(kernel[k])));
+		}
+		_mm_storeu_si128((__m128i *) (destination + i), new_pixel);
+	}
+	for (; i < count; i++) {
+		uint16_t new_pixel = 0;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += first[i + k] * kernel[k];
+		}
+		destination[i] = new_pixel;
+	}
+}
+
+static void BlurHorizontalFixed(const uint8_t *source, uint16_t *destination,
+                                size_t count, const uint16_t *kernel,
+                                unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurHorizontalFixedSized, halfsize, source, destination, count, kernel, halfsize);
+}
+
+template <unsigned int Halfsize>
+static void BlurVerticalFixedSized(const uint16_t *source, size_t stride,
+                                   uint8_t *destination, size_t count,
+                                   const uint16_t *kernel, unsigned int halfsize)
+{
+	const uint16_t *first = source - halfsize * stride;
+	const unsigned int mask_size = Halfsize > 0 ? 2 * Halfsize + 1 : 2 * halfsize + 1;
+	const __m128i half = _mm_set1_epi32(1 << 22);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m128i new_low = half;
+		__m128i new_high = half;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			__m128i value = _mm_loadu_si128((const __m128i *) (first + k * stride + i));
+			__m128i weight = _mm_set1_epi16((int16_t) kernel[k]);
+			// 32-bit products out of their low and high halves, which is
+			// cheaper than widening values and multiplying in 32 bits.
+			__m128i product_low = _mm_mullo_epi16(value, weight);
+			__m128i product_high = _mm_mulhi_epu16(value, weight);
+			new_low = _mm_add_epi32(new_low, _mm_unpacklo_epi16(product_low, product_high));
+			new_high = _mm_add_epi32(new_high, _mm_unpackhi_epi16(product_low, product_high));
+		}
+		__m128i words = _mm_packus_epi32(_mm_srli_epi32(new_low, 23),
+		                                 _mm_srli_epi32(new_high, 23));
+		_mm_storel_epi64((__m128i *) (destination + i), _mm_packus_epi16(words, words));
+	}
+	for (; i < count; i++) {
+		uint32_t new_pixel = 0;
+		CANNY_UNROLL_WEIGHTS
+		for (unsigned int k = 0; k < mask_size; k++) {
+			new_pixel += (uint32_t) first[k * stride + i] * kernel[k];
+		}
+		destination[i] = CannyBlurFixedRound(new_pixel);
+	}
+}
+
+static void BlurVerticalFixed(const uint16_t *source, size_t stride,
+                              uint8_t *destination, size_t count,
+                              const uint16_t *kernel, unsigned int halfsize)
+{
+	CANNY_BLUR_SIZED(BlurVerticalFixedSized, halfsize, source, stride, destination, count, kernel, halfsize);
+}
+
+static void BlurRecursive(float *row, ptrdiff_t step, uint8_t *destination,
+                          size_t count, const CannyRecursiveFilter *filter)
+{
+	const __m128 b = _mm_set1_ps(filter->b);
+	const __m128 a1 = _mm_set1_ps(filter->a[0]);
+	const __m128 a2 = _mm_set1_ps(filter->a[1]);
+	const __m128 a3 = _mm_set1_ps(filter->a[2]);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 black = _mm_setzero_ps();
+	const __m128 white = _mm_set1_ps(255.0f);
+	size_t i = 0;
+
+	// Same order of operations as CannyRecursiveStep().
+	for (; i + 4 <= count; i += 4) {
+		__m128 value = _mm_mul_ps(b, _mm_loadu_ps(row + i));
+		value = _mm_add_ps(value, _mm_mul_ps(a3, _mm_loadu_ps(row + i + 3 * step)));
+		value = _mm_add_ps(value, _mm_mul_ps(a2, _mm_loadu_ps(row + i + 2 * step)));
+		value = _mm_add_ps(value, _mm_mul_ps(a1, _mm_loadu_ps(row + i + step)));
+		_mm_storeu_ps(row + i, value);
+		if (destination != NULL) {
+			// Same clamping as CannyRecursiveRound().
+			__m128 pixel = _mm_min_ps(_mm_max_ps(_mm_add_ps(value, half), black), white);
+			__m128i words = _mm_cvttps_epi32(pixel);
+			words = _mm_packus_epi32(words, words);
+			int bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+			memcpy(destination + i, &bytes, sizeof(bytes));
+		}
+	}
+	for (; i < count; i++) {
+		row[i] = CannyRecursiveStep(row + i, step, filter);
+		if (destination != NULL) {
+			destination[i] = CannyRecursiveRound(row[i]);
+		}
+	}
+}
+
+static void TransposeGray(const uint8_t *source, size_t stride, float *destination,
+                          size_t rows, size_t count)
+{
+	size_t y = 0;
+
+	// Rows are taken four at a time, in 4x4 blocks.
+	if (rows % 4 == 0) {
+		for (; y + 4 <= count; y += 4) {
+			for (size_t x = 0; x < rows; x += 4) {
+				__m128 block[4];
+				for (int k = 0; k < 4; k++) {
+					int bytes;
+					memcpy(&bytes, source + (x + k) * stride + y, sizeof(bytes));
+					block[k] = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+				}
+				_MM_TRANSPOSE4_PS(block[0], block[1], block[2], block[3]);
+				for (int k = 0; k < 4; k++) {
+					_mm_storeu_ps(destination + (y + k) * rows + x, block[k]);
+				}
+			}
+		}
+	}
+	for (; y < count; y++) {
+		for (size_t x = 0; x < rows; x++) {
+			destination[y * rows + x] = source[x * stride + y];
+		}
+	}
+}
+
+static void TransposeFloat(const float *source, float *destination, size_t stride,
+                           size_t rows, size_t count)
+{
+	size_t y = 0;
+
+	if (rows % 4 == 0) {
+		for (; y + 4 <= count; y += 4) {
+			for (size_t x = 0; x < rows; x += 4) {
+				__m128 block[4];
+				for (int k = 0; k < 4; k++) {
+					block[k] = _mm_loadu_ps(source + (y + k) * rows + x);
+				}
+				_MM_TRANSPOSE4_PS(block[0], block[1], block[2], block[3]);
+				for (int k = 0; k < 4; k++) {
+					_mm_storeu_ps(destination + (x + k) * stride + y, block[k]);
+				}
+			}
+		}
+	}
+	for (; y < count; y++) {
+		for (size_t x = 0; x < rows; x++) {
+			destination[x * stride + y] = source[y * rows + x];
+		}
+	}
+}
+
+extern const CannyKernels canny_kernels_sse41;
+const CannyKernels canny_kernels_sse41 = {
+	CANNY_KERNELS_SSE41,
+	"sse4.1",
+	{
+		LuminanceGray,
+		LuminanceColor<CANNY_PIXEL_BGR24>,
+		LuminanceColor<CANNY_PIXEL_RGB24>,
+		LuminanceColor<CANNY_PIXEL_BGRA32>
+	},
+	BlurHorizontal,
+	BlurVertical,
+	Sobel,
+	{
+		LuminanceGray,
+		LuminanceColorFixed<CANNY_PIXEL_BGR24>,
+		LuminanceColorFixed<CANNY_PIXEL_RGB24>,
+		LuminanceColorFixed<CANNY_PIXEL_BGRA32>
+	},
+	BlurHorizontalFixed,
+	BlurVerticalFixed,
+	SobelFast<false>,
+	SobelFast<true>,
+	BlurRecursive,
+	TransposeGray,
+	TransposeFloat
+};
+
+#endif // #if defined(__x86_64__) || defined(__i386__)
@@ -0,0 +1,119 @@
+/**
+ * \file      CannyQueue.h
+ * \brief     Bounded queue connecting stages of processing pipeline.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYQUEUE_H_
+#define _CANNYQUEUE_H_
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+/**
+ * \brief Blocking first-in first-out queue of limited capacity.
+ *
+ * Producer blocks while queue is full, so fast stage cannot run ahead of
+ * slow one and memory stays bounded. Consumers block while it is empty,
+ * until producer closes the queue.
+ */
+template <typename T>
+class CannyQueue
+{
+	public:
+		/**
+		 * \brief Constructor.
+		 *
+		 * \param capacity Maximum number of items waiting in queue.
+		 */
+		explicit CannyQueue(size_t capacity)
+		{
+			this->capacity = capacity > 0 ? capacity : 1;
+			closed = false;
+		}
+
+		/**
+		 * \brief Appends item, waits while queue is full.
+		 *
+		 * \return False if queue is closed, item is dropped then.
+		 */
+		bool Push(T item)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+			if (closed) {
+				return false;
+			}
+			items.push_back(std::move(item));
+			not_empty.notify_one();
+			return true;
+		}
+
+		/**
+		 * \brief Takes first item, waits while queue is empty.
+		 *
+		 * \return False if queue is closed and no item is left.
+		 */
+		bool Pop(T &item)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			not_empty.wait(lock, [this] { return closed || !items.empty(); });
+			if (items.empty()) {
+				return false;
+			}
+			item = std::move(items.front());
+			items.pop_front();
+			not_full.notify_one();
+			return true;
+		}
+
+		/**
+		 * \brief Closes queue. Items already in are still delivered.
+		 */
+		void Close()
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			not_empty.notify_all();
+			not_full.notify_all();
+		}
+
+	private:
+		CannyQueue(const CannyQueue &);
+		CannyQueue &operator=(const CannyQueue &);
+
+		/**
+		 * \var Items waiting, oldest first.
+		 */
+		std::deque<T> items;
+
+		/**
+		 * \var Maximum size of `items`.
+		 */
+		size_t capacity;
+
+		/**
+		 * \var Set when producer is done.
+		 */
+		bool closed;
+
+		/**
+		 * \var Guards all fields above.
+		 */
+		std::mutex mutex;
+
+		/**
+		 * \var Wake consumers and producers.
+		 */
+		std::condition_variable not_empty, not_full;
+};
+
+#endif // #ifndef _CANNYQUEUE_H_
@@ -0,0 +1,93 @@
+/**
+ * \file      CannyStats.cpp
+ * \brief     Statistics and tracing of Canny algorithm.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stdio.h>
+
+#include "CannyStats.h"
+
+static const char *stage_names[CANNY_STAGES] = {
+	"Luminance",
+	"PreProcessImage",
+	"GaussianBlur",
+	"EdgeDetection",
+	"NonMaxSuppression",
+	"StreamImage",
+	"TaskImage",
+	"PropagateEdges",
+	"Hysteresis",
+	"PostProcessImage"
+};
+
+const char *CannyStageName(CannyStage stage)
+{
+	return stage < CANNY_STAGES ? stage_names[stage] : "Unknown";
+}
+
+CannyTrace::CannyTrace()
+{
+	origin = std::chrono::steady_clock::now();
+}
+
+void CannyTrace::AddSpan(CannyStage stage, bool band,
+                         std::chrono::steady_clock::time_point begin,
+                         std::chrono::steady_clock::time_point end)
+{
+	std::thread::id id = std::this_thread::get_id();
+	std::lock_guard<std::mutex> lock(mutex);
+	Span span;
+
+	span.stage = stage;
+	span.band = band;
+	span.thread = 0;
+	while (span.thread < threads.size() && threads[span.thread] != id) {
+		span.thread++;
+	}
+	if (span.thread == threads.size()) {
+		threads.push_back(id);
+	}
+	span.begin = std::chrono::duration<double, std::micro>(begin - origin).count();
+	span.duration = std::chrono::duration<double, std::micro>(end - begin).count();
+	spans.push_back(span);
+}
+
+void CannyTrace::Clear()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	spans.clear();
+}
+
+bool CannyTrace::Write(const std::string &path) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	FILE *file = fopen(path.c_str(), "w");
+
+	if (file == NULL) {
+		return false;
+	}
+
+	// Complete ("X") events, time in microseconds. Threads are numbered
+	// from 1 in order they were first seen.
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for (size_t i = 0; i < threads.size(); i++) {
+		fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %lu, "
+		        "\"args\": {\"name\": \"thread %lu\"}}",
+		        i > 0 ? "," : "", (unsigned long) i + 1, (unsigned long) i + 1);
+	}
+	for (size_t i = 0; i < spans.size(); i++) {
+		const Span &span = spans[i];
+		fprintf(file, ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+		        "\"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+		        CannyStageName(span.stage), span.band ? "band" : "stage",
+		        span.thread + 1, span.begin, span.duration);
+	}
+	fprintf(file, "\n]}\n");
+
+	return fclose(file) == 0;
+}
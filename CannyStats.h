@@ -0,0 +1,176 @@
+/**
+ * \file      CannyStats.h
+ * \brief     Statistics and tracing of Canny algorithm, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ * Statistics and trace are only gathered when CANNY_INSTRUMENTATION is
+ * defined at compile time (`make INSTRUMENTATION=1`). Otherwise all code
+ * gathering them is compiled out and detector refuses to take them.
+ */
+
+#ifndef _CANNYSTATS_H_
+#define _CANNYSTATS_H_
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Statement compiled in only with instrumentation.
+ */
+#ifdef CANNY_INSTRUMENTATION
+#define CANNY_INSTRUMENT(...) __VA_ARGS__
+#else
+#define CANNY_INSTRUMENT(...)
+#endif
+
+/**
+ * \brief Steps of Canny algorithm, as timed by statistics.
+ */
+enum CannyStage
+{
+	CANNY_STAGE_LUMINANCE,           ///< Luminance().
+	CANNY_STAGE_PREPROCESS,          ///< PreProcessImage().
+	CANNY_STAGE_BLUR,                ///< GaussianBlur().
+	CANNY_STAGE_EDGE_DETECTION,      ///< EdgeDetection().
+	CANNY_STAGE_NON_MAX_SUPPRESSION, ///< NonMaxSuppression().
+	CANNY_STAGE_STREAM,              ///< StreamImage(), streaming mode only.
+	CANNY_STAGE_TASKS,               ///< TaskImage(), task scheduling only.
+	CANNY_STAGE_PROPAGATION,         ///< PropagateEdges().
+	CANNY_STAGE_HYSTERESIS,          ///< Hysteresis().
+	CANNY_STAGE_POSTPROCESS,         ///< PostProcessImage().
+	CANNY_STAGES                     ///< Number of stages.
+};
+
+/**
+ * \brief Returns name of stage, same as name of method running it.
+ */
+const char *CannyStageName(CannyStage stage);
+
+/**
+ * \brief Statistics of one ProcessImage() call.
+ *
+ * All fields are reset at the beginning of each call.
+ */
+struct CannyStats
+{
+	/**
+	 * \var Wall time of each stage, in seconds, summed over regions of
+	 * CannyEdgeDetector::ProcessRegions(). Stages not run are 0.
+	 */
+	double stage_seconds[CANNY_STAGES];
+
+	/**
+	 * \var Bytes of arena allocated, 0 when it was big enough.
+	 */
+	unsigned long bytes_allocated;
+
+	/**
+	 * \var Strong pixels edge propagation started from.
+	 */
+	unsigned long propagation_seeds;
+
+	/**
+	 * \var Pixels promoted to edges by propagation.
+	 */
+	unsigned long propagated_pixels;
+
+	/**
+	 * \var Weak pixels promoted to edges by hysteresis.
+	 */
+	unsigned long hysteresis_promoted;
+
+	/**
+	 * \var Maximum number of pixels waiting on worklist, of propagation
+	 * and of hysteresis.
+	 */
+	unsigned long max_worklist_depth;
+
+	/**
+	 * \var Edge pixels in result.
+	 */
+	unsigned long edge_pixels;
+};
+
+/**
+ * \brief Spans of stages run by each thread, written as Chrome trace.
+ *
+ * May be shared by many detectors running in different threads. File is
+ * readable by chrome://tracing and Perfetto.
+ */
+class CannyTrace
+{
+	public:
+		/**
+		 * \brief Constructor, time of trace starts now.
+		 */
+		CannyTrace();
+
+		/**
+		 * \brief Records span of stage run by calling thread.
+		 *
+		 * \param stage Stage run.
+		 * \param band True for one band of stage, false for whole stage.
+		 * \param begin Start of span.
+		 * \param end End of span.
+		 */
+		void AddSpan(CannyStage stage, bool band,
+		             std::chrono::steady_clock::time_point begin,
+		             std::chrono::steady_clock::time_point end);
+
+		/**
+		 * \brief Forgets all spans.
+		 */
+		void Clear();
+
+		/**
+		 * \brief Writes spans as Chrome trace JSON file.
+		 *
+		 * \param path Name of file.
+		 * \return False if file cannot be written.
+		 */
+		bool Write(const std::string &path) const;
+
+	private:
+		/**
+		 * \brief Span of one thread.
+		 */
+		struct Span
+		{
+			CannyStage stage;
+			bool band;
+			unsigned int thread;
+			double begin, duration;
+		};
+
+		CannyTrace(const CannyTrace &);
+		CannyTrace &operator=(const CannyTrace &);
+
+		/**
+		 * \var Spans recorded, in order of their ends.
+		 */
+		std::vector<Span> spans;
+
+		/**
+		 * \var Threads seen, index is thread number in trace.
+		 */
+		std::vector<std::thread::id> threads;
+
+		/**
+		 * \var Time 0 of trace.
+		 */
+		std::chrono::steady_clock::time_point origin;
+
+		/**
+		 * \var Guards all fields above.
+		 */
+		mutable std::mutex mutex;
+};
+
+#endif // #ifndef _CANNYSTATS_H_
@@ -0,0 +1,207 @@
+/**
+ * \file      CannySweep.cpp
+ * \brief     Canny algorithm run with many parameters at once.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+#include "CannySweep.h"
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+CannySweep::CannySweep()
+{
+	luminance_seconds = 0.0;
+	fixed_point = false;
+	gradient = CANNY_GRADIENT_EXACT;
+	recursive_sigma = CannyEdgeDetector().GetRecursiveSigma();
+	border = CANNY_BORDER_REPLICATE;
+	border_value = 0;
+	detectors.push_back(this->NewDetector());
+}
+
+CannySweep::~CannySweep()
+{
+	for (size_t i = 0; i < detectors.size(); i++) {
+		delete detectors[i];
+	}
+}
+
+CannyEdgeDetector *CannySweep::NewDetector() const
+{
+	CannyEdgeDetector *detector = new CannyEdgeDetector();
+	detector->SetFixedPoint(fixed_point);
+	detector->SetGradient(gradient);
+	detector->SetRecursiveSigma(recursive_sigma);
+	detector->SetBorder(border, border_value);
+	// Thresholds after the first go to Rethreshold().
+	detector->SetKeepSuppressed(true);
+	return detector;
+}
+
+void CannySweep::SetThreadCount(unsigned int count)
+{
+	thread_pool.SetThreadCount(count);
+
+	while (detectors.size() < thread_pool.GetThreadCount()) {
+		detectors.push_back(this->NewDetector());
+	}
+	while (detectors.size() > thread_pool.GetThreadCount()) {
+		delete detectors.back();
+		detectors.pop_back();
+	}
+}
+
+void CannySweep::SetFixedPoint(bool fixed_point)
+{
+	this->fixed_point = fixed_point;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetFixedPoint(fixed_point);
+	}
+}
+
+void CannySweep::SetGradient(CannyGradient gradient)
+{
+	this->gradient = gradient;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetGradient(gradient);
+	}
+}
+
+void CannySweep::SetRecursiveSigma(float min_sigma)
+{
+	this->recursive_sigma = min_sigma;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetRecursiveSigma(min_sigma);
+	}
+}
+
+void CannySweep::SetBorder(CannyBorder border, uint8_t value)
+{
+	this->border = border;
+	this->border_value = value;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i]->SetBorder(border, value);
+	}
+}
+
+double CannySweep::GetLuminanceSeconds() const
+{
+	return luminance_seconds;
+}
+
+bool CannySweep::Run(const CannyImageView &image, CannySweepConfig *configs,
+                     unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		if (!CannyEdgeDetector::IsValid(image, configs[i].mask) || !(configs[i].sigma > 0.0f)) {
+			return false;
+		}
+	}
+	if (count == 0) {
+		return true;
+	}
+
+	/*
+	 * Conversion to grayscale, once for all configurations. Gray image is
+	 * then given to detectors, so they skip this step.
+	 */
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	CannyImageView gray = image;
+	if (image.format != CANNY_PIXEL_GRAY8) {
+		const CannyKernels *kernels = detectors[0]->kernels;
+		gray_bitmap.resize((size_t) image.width * image.height);
+		thread_pool.ParallelFor(0, image.height, [&](unsigned long first, unsigned long last) {
+			for (unsigned long x = first; x < last; x++) {
+				if (fixed_point) {
+					kernels->luminance_fixed[image.format](image.data + x * image.stride,
+					                                       gray_bitmap.data() + x * image.width,
+					                                       image.width);
+				} else {
+					kernels->luminance[image.format](image.data + x * image.stride,
+					                                 gray_bitmap.data() + x * image.width,
+					                                 image.width);
+				}
+			}
+		});
+		gray.data = gray_bitmap.data();
+		gray.stride = image.width;
+		gray.format = CANNY_PIXEL_GRAY8;
+	}
+	luminance_seconds = Seconds(start);
+
+	/*
+	 * Configurations grouped by sigma. Biggest sigmas, whose blur costs
+	 * most, go first, so threads finish at similar time.
+	 */
+	std::vector<unsigned int> order(count);
+	for (unsigned int i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [configs](unsigned int a, unsigned int b) {
+		return configs[a].sigma > configs[b].sigma;
+	});
+	std::vector<unsigned int> group_starts;
+	for (unsigned int i = 0; i < count; i++) {
+		if (i == 0 || configs[order[i]].sigma != configs[order[i - 1]].sigma) {
+			group_starts.push_back(i);
+		}
+	}
+	group_starts.push_back(count);
+
+	/*
+	 * Each thread takes next group not taken yet, and processes it with
+	 * its own detector.
+	 */
+	std::atomic<unsigned int> next_group(0);
+	unsigned int groups = group_starts.size() - 1;
+	unsigned int threads = std::min((unsigned int) detectors.size(), groups);
+	thread_pool.ParallelFor(0, threads, [&](unsigned long first, unsigned long last) {
+		for (unsigned long thread = first; thread < last; thread++) {
+			unsigned int group;
+			while ((group = next_group++) < groups) {
+				this->RunGroup(*detectors[thread], gray, configs,
+				               &order[group_starts[group]],
+				               group_starts[group + 1] - group_starts[group]);
+			}
+		}
+	});
+
+	return true;
+}
+
+void CannySweep::RunGroup(CannyEdgeDetector &detector, const CannyImageView &gray,
+                          CannySweepConfig *configs, const unsigned int *group,
+                          unsigned int size)
+{
+	CannySweepConfig &first = configs[group[0]];
+
+	// Steps up to suppression, shared by the group.
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	detector.KeepSuppressed(gray, first.mask, first.sigma);
+	double suppress_seconds = Seconds(start);
+
+	start = std::chrono::steady_clock::now();
+	detector.TraceImage(first.low_threshold, first.high_threshold);
+	first.threshold_seconds = Seconds(start);
+	first.suppress_seconds = suppress_seconds;
+
+	for (unsigned int i = 1; i < size; i++) {
+		CannySweepConfig &config = configs[group[i]];
+
+		start = std::chrono::steady_clock::now();
+		detector.Rethreshold(config.low_threshold, config.high_threshold, config.mask);
+		config.threshold_seconds = Seconds(start);
+		config.suppress_seconds = suppress_seconds;
+	}
+}
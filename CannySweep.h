@@ -0,0 +1,170 @@
+/**
+ * \file      CannySweep.h
+ * \brief     Canny algorithm run with many parameters at once, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYSWEEP_H_
+#define _CANNYSWEEP_H_
+
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+
+/**
+ * \brief One set of parameters of sweep, with its result.
+ */
+struct CannySweepConfig
+{
+	/**
+	 * \var Gaussian function standard deviation.
+	 */
+	float sigma;
+
+	/**
+	 * \var Thresholds of hysteresis (from range of 0-255).
+	 */
+	uint8_t low_threshold, high_threshold;
+
+	/**
+	 * \var Destination mask, of size of image.
+	 */
+	CannyMaskView mask;
+
+	/**
+	 * \var Filled by sweep: time of steps from blur to suppression of non
+	 * maximum pixels, in seconds. Same for all configurations of one sigma,
+	 * as they share these steps.
+	 */
+	double suppress_seconds;
+
+	/**
+	 * \var Filled by sweep: time of propagation, hysteresis and writing of
+	 * mask, in seconds.
+	 */
+	double threshold_seconds;
+};
+
+/**
+ * \brief Runs Canny algorithm with many parameters on one image.
+ *
+ * Each step is done only as many times as needed: conversion to
+ * grayscale once per image, blur, Sobel and suppression of non maximum
+ * pixels once per distinct sigma, hysteresis once per configuration.
+ * Groups of configurations with the same sigma run in parallel, each on
+ * its own detector. Masks are same as ProcessImage() would give.
+ */
+class CannySweep
+{
+	public:
+		/**
+		 * \brief Constructor, sweep runs on one thread.
+		 */
+		CannySweep();
+
+		/**
+		 * \brief Destructor, frees detectors.
+		 */
+		~CannySweep();
+
+		/**
+		 * \brief Sets number of sigma groups processed at once.
+		 *
+		 * \param count Number of threads, 0 means one per hardware thread.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetFixedPoint().
+		 */
+		void SetFixedPoint(bool fixed_point);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetGradient().
+		 */
+		void SetGradient(CannyGradient gradient);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetRecursiveSigma().
+		 */
+		void SetRecursiveSigma(float min_sigma);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetBorder().
+		 */
+		void SetBorder(CannyBorder border, uint8_t value = 0);
+
+		/**
+		 * \brief Processes image with all configurations.
+		 *
+		 * \param image Source image.
+		 * \param configs Configurations, timings are written into them.
+		 * \param count Number of configurations.
+		 * \return False if image, any mask or sigma is invalid, nothing is
+		 * processed then.
+		 */
+		bool Run(const CannyImageView &image, CannySweepConfig *configs,
+		         unsigned int count);
+
+		/**
+		 * \brief Returns time of conversion to grayscale in last Run().
+		 */
+		double GetLuminanceSeconds() const;
+
+	private:
+		CannySweep(const CannySweep &);
+		CannySweep &operator=(const CannySweep &);
+
+		/**
+		 * \brief Creates detector with current settings.
+		 */
+		CannyEdgeDetector *NewDetector() const;
+
+		/**
+		 * \brief Processes all configurations of one sigma.
+		 *
+		 * \param detector Detector used by calling thread.
+		 * \param gray Grayscale image.
+		 * \param configs All configurations.
+		 * \param group Indices of configurations of the group.
+		 * \param size Number of configurations in the group.
+		 */
+		void RunGroup(CannyEdgeDetector &detector, const CannyImageView &gray,
+		              CannySweepConfig *configs, const unsigned int *group,
+		              unsigned int size);
+
+		/**
+		 * \var One detector per thread.
+		 */
+		std::vector<CannyEdgeDetector *> detectors;
+
+		/**
+		 * \var Threads processing groups and rows of grayscale image.
+		 */
+		CannyThreadPool thread_pool;
+
+		/**
+		 * \var Grayscale image, shared by all groups.
+		 */
+		std::vector<uint8_t> gray_bitmap;
+
+		/**
+		 * \var Time of conversion to grayscale.
+		 */
+		double luminance_seconds;
+
+		/**
+		 * \var Settings passed to detectors.
+		 */
+		bool fixed_point;
+		CannyGradient gradient;
+		float recursive_sigma;
+		CannyBorder border;
+		uint8_t border_value;
+};
+
+#endif // #ifndef _CANNYSWEEP_H_
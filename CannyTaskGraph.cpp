@@ -0,0 +1,197 @@
+/**
+ * \file      CannyTaskGraph.cpp
+ * \brief     Tasks with dependencies run by work-stealing threads.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include "CannyTaskGraph.h"
+
+CannyTaskGraph::CannyTaskGraph()
+{
+	task_count = 0;
+	built = false;
+	pending_size = 0;
+	remaining = 0;
+	queued = 0;
+	idle = 0;
+	queue_count = 0;
+}
+
+void CannyTaskGraph::Clear()
+{
+	task_count = 0;
+	dependencies.clear();
+	built = false;
+}
+
+unsigned int CannyTaskGraph::AddTask()
+{
+	built = false;
+	return task_count++;
+}
+
+void CannyTaskGraph::AddDependency(unsigned int before, unsigned int after)
+{
+	dependencies.push_back(before);
+	dependencies.push_back(after);
+	built = false;
+}
+
+unsigned int CannyTaskGraph::GetTaskCount() const
+{
+	return task_count;
+}
+
+void CannyTaskGraph::Execute(CannyThreadPool &thread_pool, TaskFunction function,
+                             const void *body)
+{
+	if (task_count == 0) {
+		return;
+	}
+
+	/*
+	 * Dependents of each task, sorted by task (counting sort), so that
+	 * finished task finds them at once.
+	 */
+	if (!built) {
+		dependent_starts.assign(task_count + 1, 0);
+		dependency_counts.assign(task_count, 0);
+		for (size_t i = 0; i < dependencies.size(); i += 2) {
+			dependent_starts[dependencies[i] + 1]++;
+			dependency_counts[dependencies[i + 1]]++;
+		}
+		for (unsigned int i = 0; i < task_count; i++) {
+			dependent_starts[i + 1] += dependent_starts[i];
+		}
+		dependents.resize(dependencies.size() / 2);
+		std::vector<unsigned int> next(dependent_starts.begin(), dependent_starts.end() - 1);
+		for (size_t i = 0; i < dependencies.size(); i += 2) {
+			dependents[next[dependencies[i]]++] = dependencies[i + 1];
+		}
+		built = true;
+	}
+
+	if (pending_size < task_count) {
+		pending.reset(new std::atomic<unsigned int>[task_count]);
+		pending_size = task_count;
+	}
+	for (unsigned int i = 0; i < task_count; i++) {
+		pending[i] = dependency_counts[i];
+	}
+	remaining = task_count;
+	queued = 0;
+	idle = 0;
+
+	unsigned int threads = thread_pool.GetThreadCount();
+	if (queue_count != threads) {
+		queues.reset(new Queue[threads]);
+		queue_count = threads;
+	}
+	for (unsigned int q = 0; q < queue_count; q++) {
+		queues[q].tasks.resize(task_count);
+		queues[q].front = queues[q].back = 0;
+	}
+
+	/*
+	 * Tasks depending on nothing are dealt out in contiguous runs, so each
+	 * thread starts on its own part of image. They are queued backwards,
+	 * as owner takes tasks from the back.
+	 */
+	unsigned int roots = 0;
+	for (unsigned int i = 0; i < task_count; i++) {
+		roots += dependency_counts[i] == 0;
+	}
+	unsigned int root = roots;
+	for (unsigned int i = task_count; i-- > 0;) {
+		if (dependency_counts[i] == 0) {
+			root--;
+			this->PushTask((unsigned long) root * queue_count / roots, i);
+		}
+	}
+
+	thread_pool.ParallelFor(0, queue_count, [&](unsigned long first, unsigned long last) {
+		for (unsigned long queue = first; queue < last; queue++) {
+			this->RunQueue(queue, function, body);
+		}
+	});
+}
+
+void CannyTaskGraph::RunQueue(unsigned int queue, TaskFunction function, const void *body)
+{
+	unsigned int task;
+
+	while (remaining > 0) {
+		if (!this->TakeTask(queue, task)) {
+			// Tasks in flight on other threads will make more ready. Thread
+			// is counted idle before it looks at `queued`, and PushTask()
+			// counts task before it looks at `idle`, so no wake-up is lost.
+			std::unique_lock<std::mutex> lock(idle_mutex);
+			idle++;
+			task_ready.wait(lock, [this] { return queued > 0 || remaining == 0; });
+			idle--;
+			continue;
+		}
+
+		function(body, task);
+
+		// Last dependency done makes dependent ready, on this thread.
+		for (unsigned int i = dependent_starts[task]; i < dependent_starts[task + 1]; i++) {
+			if (--pending[dependents[i]] == 0) {
+				this->PushTask(queue, dependents[i]);
+			}
+		}
+		if (--remaining == 0) {
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			task_ready.notify_all();
+		}
+	}
+}
+
+bool CannyTaskGraph::TakeTask(unsigned int queue, unsigned int &task)
+{
+	{
+		Queue &own = queues[queue];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (own.back > own.front) {
+			task = own.tasks[--own.back];
+			queued--;
+			return true;
+		}
+	}
+
+	for (unsigned int i = 1; i < queue_count; i++) {
+		Queue &victim = queues[(queue + i) % queue_count];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.back > victim.front) {
+			task = victim.tasks[victim.front++];
+			queued--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void CannyTaskGraph::PushTask(unsigned int queue, unsigned int task)
+{
+	{
+		Queue &own = queues[queue];
+		std::lock_guard<std::mutex> lock(own.mutex);
+
+		// Queue emptied by thieves starts over, so it never runs past the end.
+		if (own.front == own.back) {
+			own.front = own.back = 0;
+		}
+		own.tasks[own.back++] = task;
+		queued++;
+	}
+
+	if (idle > 0) {
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		task_ready.notify_one();
+	}
+}
@@ -0,0 +1,205 @@
+/**
+ * \file      CannyTaskGraph.h
+ * \brief     Tasks with dependencies run by work-stealing threads, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYTASKGRAPH_H_
+#define _CANNYTASKGRAPH_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CannyThreadPool.h"
+
+/**
+ * \brief Graph of tasks, each started as soon as tasks it depends on are done.
+ *
+ * Tasks are numbered in order they are added. Each thread of the pool has
+ * its own queue of ready tasks. Task finished by a thread makes its
+ * dependents ready on the same thread, which takes the last one made ready
+ * first, so the next step on the same part of image runs while its input
+ * is still in cache. Thread without ready tasks steals the oldest ones of
+ * other threads, or sleeps until some task is made ready. There are no
+ * barriers besides dependencies themselves.
+ *
+ * Graph can be run many times; it is only built again when its shape
+ * changes. Nothing is allocated by Run() once graph of the same size was
+ * run before.
+ */
+class CannyTaskGraph
+{
+	public:
+		/**
+		 * \brief Constructor, creates empty graph.
+		 */
+		CannyTaskGraph();
+
+		/**
+		 * \brief Removes all tasks and dependencies.
+		 */
+		void Clear();
+
+		/**
+		 * \brief Adds task.
+		 *
+		 * \return Number of task, given to body of Run().
+		 */
+		unsigned int AddTask();
+
+		/**
+		 * \brief Makes task wait until another one is done.
+		 *
+		 * \param before Task that must be done first.
+		 * \param after Task that waits for it.
+		 */
+		void AddDependency(unsigned int before, unsigned int after);
+
+		/**
+		 * \brief Returns number of tasks.
+		 */
+		unsigned int GetTaskCount() const;
+
+		/**
+		 * \brief Runs all tasks on threads of pool and waits until they are
+		 * done.
+		 *
+		 * Graph must be acyclic. Body is passed by reference, nothing is
+		 * allocated besides growing of queues.
+		 *
+		 * \param thread_pool Threads tasks run on.
+		 * \param body Function object called with number of each task,
+		 * `body(task)`.
+		 */
+		template <typename Body>
+		void Run(CannyThreadPool &thread_pool, const Body &body)
+		{
+			Execute(thread_pool, &CallBody<Body>, &body);
+		}
+
+	private:
+		/**
+		 * \brief Type-erased task body.
+		 */
+		typedef void (*TaskFunction)(const void *body, unsigned int task);
+
+		/**
+		 * \brief Calls function object of known type.
+		 */
+		template <typename Body>
+		static void CallBody(const void *body, unsigned int task)
+		{
+			(*static_cast<const Body *>(body))(task);
+		}
+
+		/**
+		 * \brief Ready tasks of one thread.
+		 *
+		 * Every task is queued once per run, so array of size of graph never
+		 * overflows. Owner takes tasks from the back, thieves from the front.
+		 */
+		struct Queue
+		{
+			std::mutex mutex;
+			std::vector<unsigned int> tasks;
+			unsigned int front, back;
+		};
+
+		CannyTaskGraph(const CannyTaskGraph &);
+		CannyTaskGraph &operator=(const CannyTaskGraph &);
+
+		/**
+		 * \brief Prepares queues and counters, then runs tasks.
+		 */
+		void Execute(CannyThreadPool &thread_pool, TaskFunction function, const void *body);
+
+		/**
+		 * \brief Main loop of one thread, runs tasks until all are done.
+		 */
+		void RunQueue(unsigned int queue, TaskFunction function, const void *body);
+
+		/**
+		 * \brief Takes next task of own queue or steals one.
+		 *
+		 * \return False if no task is ready anywhere now.
+		 */
+		bool TakeTask(unsigned int queue, unsigned int &task);
+
+		/**
+		 * \brief Adds task to back of queue.
+		 */
+		void PushTask(unsigned int queue, unsigned int task);
+
+		/**
+		 * \var Dependencies as added, pairs of (before, after).
+		 */
+		std::vector<unsigned int> dependencies;
+
+		/**
+		 * \var Number of tasks.
+		 */
+		unsigned int task_count;
+
+		/**
+		 * \var Dependents of each task: those of task `i` are
+		 * `dependents[dependent_starts[i]]` up to `dependent_starts[i + 1]`.
+		 * Built from `dependencies` when graph changes.
+		 */
+		std::vector<unsigned int> dependent_starts, dependents;
+
+		/**
+		 * \var Number of tasks each task depends on.
+		 */
+		std::vector<unsigned int> dependency_counts;
+
+		/**
+		 * \var True if `dependents` were built from current dependencies.
+		 */
+		bool built;
+
+		/**
+		 * \var Dependencies of each task not done yet, during run.
+		 */
+		std::unique_ptr<std::atomic<unsigned int>[]> pending;
+		unsigned int pending_size;
+
+		/**
+		 * \var Tasks not done yet, during run.
+		 */
+		std::atomic<unsigned int> remaining;
+
+		/**
+		 * \var Tasks in queues, not taken yet, during run.
+		 */
+		std::atomic<unsigned int> queued;
+
+		/**
+		 * \var Threads waiting for ready task.
+		 */
+		std::atomic<unsigned int> idle;
+
+		/**
+		 * \var Guards sleep of idle threads.
+		 */
+		std::mutex idle_mutex;
+
+		/**
+		 * \var Wakes idle threads when task is queued or all are done.
+		 */
+		std::condition_variable task_ready;
+
+		/**
+		 * \var One queue per thread.
+		 */
+		std::unique_ptr<Queue[]> queues;
+		unsigned int queue_count;
+};
+
+#endif // #ifndef _CANNYTASKGRAPH_H_
@@ -0,0 +1,173 @@
+/**
+ * \file      CannyThreadPool.cpp
+ * \brief     Worker pool running horizontal bands of image in parallel.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <stddef.h>
+
+#include "CannyThreadPool.h"
+
+CannyThreadPool::CannyThreadPool()
+{
+	job_function = NULL;
+	job_body = NULL;
+	job_first = job_last = 0;
+	job_bands = 0;
+	next_band = 0;
+	pending_bands = 0;
+	generation = 0;
+	stopping = false;
+	trace = NULL;
+	trace_stage = CANNY_STAGE_LUMINANCE;
+}
+
+CannyThreadPool::~CannyThreadPool()
+{
+	StopWorkers();
+}
+
+void CannyThreadPool::SetThreadCount(unsigned int count)
+{
+	if (count == 0) {
+		count = std::thread::hardware_concurrency();
+		count = count > 0 ? count : 1;
+	}
+	if (count == workers.size() + 1) {
+		return;
+	}
+
+	StopWorkers();
+	stopping = false;
+	for (unsigned int i = 1; i < count; i++) {
+		workers.push_back(std::thread(&CannyThreadPool::WorkerLoop, this));
+	}
+}
+
+unsigned int CannyThreadPool::GetThreadCount() const
+{
+	return workers.size() + 1;
+}
+
+void CannyThreadPool::SetTrace(CannyTrace *trace, CannyStage stage)
+{
+	this->trace = trace;
+	trace_stage = stage;
+}
+
+void CannyThreadPool::Run(unsigned long first, unsigned long last,
+                          BandFunction function, const void *body)
+{
+	if (first >= last) {
+		return;
+	}
+
+	// No point in bands shorter than one row.
+	unsigned long bands = workers.size() + 1;
+	bands = bands < last - first ? bands : last - first;
+	if (bands == 1) {
+		RunBand(function, body, first, last);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job_function = function;
+		job_body = body;
+		job_first = first;
+		job_last = last;
+		job_bands = bands;
+		next_band = 0;
+		pending_bands = bands;
+		generation++;
+	}
+	job_posted.notify_all();
+
+	RunBands();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	job_done.wait(lock, [this] { return pending_bands == 0; });
+	job_function = NULL;
+	job_body = NULL;
+}
+
+void CannyThreadPool::WorkerLoop()
+{
+	unsigned long seen_generation = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_posted.wait(lock, [this, seen_generation] {
+				return stopping || generation != seen_generation;
+			});
+			if (stopping) {
+				return;
+			}
+			seen_generation = generation;
+		}
+		RunBands();
+	}
+}
+
+void CannyThreadPool::RunBands()
+{
+	for (;;) {
+		unsigned long band, first, last;
+		BandFunction function;
+		const void *body;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (job_function == NULL || next_band >= job_bands) {
+				return;
+			}
+			band = next_band++;
+			function = job_function;
+			body = job_body;
+			// Bands differ in height by at most one row.
+			first = job_first + (job_last - job_first) * band / job_bands;
+			last = job_first + (job_last - job_first) * (band + 1) / job_bands;
+		}
+
+		RunBand(function, body, first, last);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (--pending_bands == 0) {
+			job_done.notify_one();
+		}
+	}
+}
+
+void CannyThreadPool::StopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	job_posted.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	workers.clear();
+}
+
+void CannyThreadPool::RunBand(BandFunction function, const void *body,
+                              unsigned long first, unsigned long last)
+{
+#ifdef CANNY_INSTRUMENTATION
+	if (trace != NULL) {
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		function(body, first, last);
+		trace->AddSpan(trace_stage, true, begin, std::chrono::steady_clock::now());
+		return;
+	}
+#endif
+
+	function(body, first, last);
+}
@@ -0,0 +1,196 @@
+/**
+ * \file      CannyThreadPool.h
+ * \brief     Worker pool running horizontal bands of image in parallel.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYTHREADPOOL_H_
+#define _CANNYTHREADPOOL_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "CannyStats.h"
+
+/**
+ * \brief Pool of worker threads splitting row ranges into bands.
+ *
+ * Workers are started once and sleep between jobs. Calling thread always
+ * takes part in the work, so pool of one thread has no workers at all and
+ * runs everything inline.
+ */
+class CannyThreadPool
+{
+	public:
+		/**
+		 * \brief Constructor, creates single-threaded pool.
+		 */
+		CannyThreadPool();
+
+		/**
+		 * \brief Destructor, stops and joins workers.
+		 */
+		~CannyThreadPool();
+
+		/**
+		 * \brief Changes number of threads used by ParallelFor().
+		 *
+		 * \param count Number of threads including caller, 0 means one per
+		 * hardware thread.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief Returns number of threads used by ParallelFor().
+		 */
+		unsigned int GetThreadCount() const;
+
+		/**
+		 * \brief Makes following ParallelFor() calls record their bands.
+		 *
+		 * Works only with CANNY_INSTRUMENTATION, see CannyStats.h.
+		 *
+		 * \param trace Trace spans are added to, NULL stops recording.
+		 * \param stage Stage bands belong to.
+		 */
+		void SetTrace(CannyTrace *trace, CannyStage stage);
+
+		/**
+		 * \brief Splits rows into equal bands and processes them in parallel.
+		 *
+		 * Returns after all bands are done, so consecutive calls act as
+		 * barriers between stages of the algorithm. Body is passed by
+		 * reference, nothing is allocated.
+		 *
+		 * \param first First row.
+		 * \param last One past last row.
+		 * \param body Function object called with half-open range of rows
+		 * of one band, `body(first, last)`.
+		 */
+		template <typename Body>
+		void ParallelFor(unsigned long first, unsigned long last, const Body &body)
+		{
+			Run(first, last, &CallBody<Body>, &body);
+		}
+
+	private:
+		/**
+		 * \brief Type-erased band body.
+		 */
+		typedef void (*BandFunction)(const void *body, unsigned long first,
+		                             unsigned long last);
+
+		/**
+		 * \brief Calls function object of known type.
+		 */
+		template <typename Body>
+		static void CallBody(const void *body, unsigned long first,
+		                     unsigned long last)
+		{
+			(*static_cast<const Body *>(body))(first, last);
+		}
+
+		/**
+		 * \brief Splits rows into bands and waits until they are done.
+		 */
+		void Run(unsigned long first, unsigned long last,
+		         BandFunction function, const void *body);
+
+		CannyThreadPool(const CannyThreadPool &);
+		CannyThreadPool &operator=(const CannyThreadPool &);
+
+		/**
+		 * \brief Main loop of worker thread.
+		 */
+		void WorkerLoop();
+
+		/**
+		 * \brief Claims and runs bands of current job until none is left.
+		 */
+		void RunBands();
+
+		/**
+		 * \brief Stops and joins all workers.
+		 */
+		void StopWorkers();
+
+		/**
+		 * \brief Runs one band, recording its span if trace is set.
+		 */
+		void RunBand(BandFunction function, const void *body,
+		             unsigned long first, unsigned long last);
+
+		/**
+		 * \var Worker threads (thread count minus one).
+		 */
+		std::vector<std::thread> workers;
+
+		/**
+		 * \var Guards all job fields below.
+		 */
+		std::mutex mutex;
+
+		/**
+		 * \var Wakes workers when job is posted or pool is stopped.
+		 */
+		std::condition_variable job_posted;
+
+		/**
+		 * \var Wakes caller when last band is done.
+		 */
+		std::condition_variable job_done;
+
+		/**
+		 * \var Body of current job and function calling it.
+		 */
+		BandFunction job_function;
+		const void *job_body;
+
+		/**
+		 * \var Row range of current job.
+		 */
+		unsigned long job_first, job_last;
+
+		/**
+		 * \var Number of bands current job is split into.
+		 */
+		unsigned long job_bands;
+
+		/**
+		 * \var Next band to be claimed.
+		 */
+		unsigned long next_band;
+
+		/**
+		 * \var Number of bands not finished yet.
+		 */
+		unsigned long pending_bands;
+
+		/**
+		 * \var Incremented with each job, so workers notice new one.
+		 */
+		unsigned long generation;
+
+		/**
+		 * \var Set when workers should exit.
+		 */
+		bool stopping;
+
+		/**
+		 * \var Trace bands are recorded in, or NULL.
+		 */
+		CannyTrace *trace;
+
+		/**
+		 * \var Stage bands are recorded as.
+		 */
+		CannyStage trace_stage;
+};
+
+#endif // #ifndef _CANNYTHREADPOOL_H_
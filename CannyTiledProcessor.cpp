@@ -0,0 +1,735 @@
+/**
+ * \file      CannyTiledProcessor.cpp
+ * \brief     Edge detection in images bigger than memory.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "CannyTiledProcessor.h"
+
+/**
+ * \brief Flags of roots of tile components.
+ */
+enum
+{
+	ROOT_STRONG = 1, ///< Component holds strong pixel.
+	ROOT_BORDER = 2, ///< Component touches border of tile.
+	ROOT_ALIVE = 4,  ///< Component is joined with strong one in other tile.
+	ROOT_LISTED = 8  ///< Component got its number already.
+};
+
+/**
+ * \brief Returns root of pixel, halving path on the way.
+ */
+static inline unsigned int FindRoot(unsigned int *parent, unsigned int i)
+{
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+/**
+ * \brief Joins sets of two pixels, smaller index becomes root.
+ */
+static inline void JoinRoots(unsigned int *parent, unsigned int a, unsigned int b)
+{
+	a = FindRoot(parent, a);
+	b = FindRoot(parent, b);
+	if (a < b) {
+		parent[b] = a;
+	} else if (b < a) {
+		parent[a] = b;
+	}
+}
+
+void CannyTiledProcessor::Components::Clear()
+{
+	parent.clear();
+	strong.clear();
+}
+
+unsigned int CannyTiledProcessor::Components::Add(const uint8_t *strong,
+                                                  unsigned int count)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned int first = parent.size();
+
+	for (unsigned int i = 0; i < count; i++) {
+		parent.push_back(first + i);
+		this->strong.push_back(strong[i]);
+	}
+	return first;
+}
+
+unsigned int CannyTiledProcessor::Components::Find(unsigned int component)
+{
+	return FindRoot(parent.data(), component);
+}
+
+void CannyTiledProcessor::Components::Union(unsigned int a, unsigned int b)
+{
+	if (a != NO_COMPONENT && b != NO_COMPONENT) {
+		JoinRoots(parent.data(), a, b);
+	}
+}
+
+void CannyTiledProcessor::Components::Finish()
+{
+	for (size_t i = 0; i < parent.size(); i++) {
+		strong[this->Find(i)] |= strong[i];
+	}
+	for (size_t i = 0; i < parent.size(); i++) {
+		strong[i] = strong[this->Find(i)];
+	}
+}
+
+CannyTiledProcessor::CannyTiledProcessor()
+{
+	tile_size = 1024;
+	tile_rows = tile_columns = 0;
+	low_threshold = high_threshold = 0;
+	fixed_point = false;
+	gradient = CANNY_GRADIENT_EXACT;
+	border = CANNY_BORDER_REPLICATE;
+	border_value = 0;
+	sigma = 1.0f;
+	edge_max = 1.0f;
+	mask_halfsize = 0;
+	memset(&image, 0, sizeof(image));
+
+	const char *directory = getenv("TMPDIR");
+	scratch_directory = directory != NULL && directory[0] != '\0' ? directory : "/tmp";
+
+	workers.push_back(new Worker());
+}
+
+CannyTiledProcessor::~CannyTiledProcessor()
+{
+	for (size_t i = 0; i < workers.size(); i++) {
+		delete workers[i];
+	}
+}
+
+void CannyTiledProcessor::SetTileSize(unsigned int size)
+{
+	// Labels of tile pixels are 32-bit, so tiles are kept well below that.
+	size = size < 8 ? 8 : size;
+	size = size > 16384 ? 16384 : size;
+	tile_size = (size + 7) / 8 * 8;
+}
+
+unsigned int CannyTiledProcessor::GetTileSize() const
+{
+	return tile_size;
+}
+
+void CannyTiledProcessor::SetThreadCount(unsigned int count)
+{
+	thread_pool.SetThreadCount(count);
+
+	while (workers.size() < thread_pool.GetThreadCount()) {
+		Worker *worker = new Worker();
+		worker->detector.SetFixedPoint(fixed_point);
+		worker->detector.SetGradient(gradient);
+		worker->detector.SetBorder(border, border_value);
+		workers.push_back(worker);
+	}
+	while (workers.size() > thread_pool.GetThreadCount()) {
+		delete workers.back();
+		workers.pop_back();
+	}
+}
+
+void CannyTiledProcessor::SetFixedPoint(bool fixed_point)
+{
+	this->fixed_point = fixed_point;
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i]->detector.SetFixedPoint(fixed_point);
+	}
+}
+
+void CannyTiledProcessor::SetGradient(CannyGradient gradient)
+{
+	this->gradient = gradient;
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i]->detector.SetGradient(gradient);
+	}
+}
+
+void CannyTiledProcessor::SetBorder(CannyBorder border, uint8_t value)
+{
+	this->border = border;
+	this->border_value = value;
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i]->detector.SetBorder(border, value);
+	}
+}
+
+void CannyTiledProcessor::SetScratchDirectory(const std::string &directory)
+{
+	scratch_directory = directory;
+}
+
+bool CannyTiledProcessor::ProcessImage(const CannyImageView &image, const CannyMaskView &mask,
+                                       float sigma, uint8_t lowThreshold,
+                                       uint8_t highThreshold)
+{
+	return this->Run(image, mask, sigma, lowThreshold, highThreshold, NULL, NULL);
+}
+
+bool CannyTiledProcessor::ProcessFile(const std::string &input, const std::string &output,
+                                      CannyMaskFormat format, float sigma,
+                                      uint8_t lowThreshold, uint8_t highThreshold)
+{
+	unsigned int width, height;
+	CannyPixelFormat pixel_format;
+	size_t offset;
+	CannyMappedFile input_file;
+
+	if (!CannyReadPNMHeader(input, width, height, pixel_format, offset) ||
+	    !input_file.Open(input)) {
+		return false;
+	}
+	size_t size = (size_t) width * height * CannyPixelSize(pixel_format);
+	if (input_file.Size() < offset || input_file.Size() - offset < size) {
+		return false;
+	}
+
+	CannyImageView image = {input_file.Data() + offset, width, height,
+	                        (size_t) width * CannyPixelSize(pixel_format), pixel_format};
+	return this->ProcessMapped(image, output, format, sigma, lowThreshold, highThreshold,
+	                           &input_file);
+}
+
+bool CannyTiledProcessor::ProcessRawFile(const std::string &input, unsigned int width,
+                                         unsigned int height, CannyPixelFormat pixel_format,
+                                         const std::string &output, CannyMaskFormat format,
+                                         float sigma, uint8_t lowThreshold,
+                                         uint8_t highThreshold)
+{
+	CannyMappedFile input_file;
+
+	if (pixel_format >= CANNY_PIXEL_FORMATS || !input_file.Open(input)) {
+		return false;
+	}
+	size_t stride = (size_t) width * CannyPixelSize(pixel_format);
+	if (input_file.Size() < stride * height) {
+		return false;
+	}
+
+	CannyImageView image = {input_file.Data(), width, height, stride, pixel_format};
+	return this->ProcessMapped(image, output, format, sigma, lowThreshold, highThreshold,
+	                           &input_file);
+}
+
+bool CannyTiledProcessor::ProcessMapped(const CannyImageView &image, const std::string &output,
+                                        CannyMaskFormat format, float sigma,
+                                        uint8_t lowThreshold, uint8_t highThreshold,
+                                        CannyMappedFile *input)
+{
+	CannyMappedFile output_file;
+
+	if (format == CANNY_MASK_BGR24) {
+		return false;
+	}
+
+	// Mask is written straight into file, after PNM header.
+	std::string header = CannyPNMMaskHeader(image.width, image.height, format);
+	size_t stride = CannyEdgeDetector::MaskRowSize(image.width, format);
+	if (!output_file.Create(output, header.size() + stride * image.height)) {
+		return false;
+	}
+	memcpy(output_file.Data(), header.data(), header.size());
+
+	CannyMaskView mask = {output_file.Data() + header.size(), stride, format};
+	return this->Run(image, mask, sigma, lowThreshold, highThreshold, input, &output_file);
+}
+
+/**
+ * \brief Drops rows of mapped file up to `row`, if not dropped yet.
+ *
+ * \param file Mapped file, or NULL if rows are not mapped by us.
+ * \param data First row.
+ * \param stride Distance between rows, in bytes.
+ * \param row One past last row to be dropped.
+ * \param released One past last row dropped so far, updated.
+ */
+static void ReleaseRows(CannyMappedFile *file, const uint8_t *data, size_t stride,
+                        unsigned long row, unsigned long &released)
+{
+	if (file != NULL && row > released) {
+		file->Release(data + released * stride, data + row * stride);
+		released = row;
+	}
+}
+
+bool CannyTiledProcessor::Run(const CannyImageView &image, const CannyMaskView &mask,
+                              float sigma, uint8_t lowThreshold, uint8_t highThreshold,
+                              CannyMappedFile *input, CannyMappedFile *output)
+{
+	if (!CannyEdgeDetector::IsValid(image, mask) || !(sigma > 0.0f)) {
+		return false;
+	}
+
+	/*
+	 * Enlarged image, as whole-image detector would see it. Suppressed
+	 * magnitudes, and later input of hysteresis, are kept in scratch file
+	 * of its size.
+	 */
+	unsigned int halfsize = CannyEdgeDetector::MaskSize(sigma) / 2;
+	unsigned long height = image.height + 2 * (unsigned long) halfsize;
+	unsigned long width = image.width + 2 * (unsigned long) halfsize;
+	if (!scratch.CreateTemporary(scratch_directory, height * width)) {
+		return false;
+	}
+	uint8_t *suppressed = scratch.Data();
+
+	this->image = image;
+	this->sigma = sigma;
+	mask_halfsize = halfsize;
+	low_threshold = lowThreshold;
+	high_threshold = highThreshold;
+	this->MakeTiles(height, width, halfsize);
+	components[PROPAGATION].Clear();
+	components[HYSTERESIS].Clear();
+
+	// Rows of input needed by tile row: Gauss margin, Sobel and suppression
+	// halo above it, two rows below it.
+	unsigned long halo = 2 * (unsigned long) halfsize + 2;
+	auto first_input_row = [&](unsigned long tile_row) -> unsigned long {
+		if (tile_row >= tile_rows) {
+			return image.height;
+		}
+		unsigned long row = tiles[tile_row * tile_columns].row;
+		return row > halo ? row - halo : 0;
+	};
+	unsigned long released = 0;
+
+	/*
+	 * Maximum gradient magnitude of whole image, which scales suppressed
+	 * magnitudes. Tiles cover enlarged image exactly once.
+	 */
+	float max = 0.0f;
+	std::mutex max_mutex;
+	for (unsigned long tile_row = 0; tile_row < tile_rows; tile_row++) {
+		this->ForEachTile(tile_row, [&](Worker &worker, Tile &tile) {
+			unsigned long first_row, first_column;
+			this->ProcessTile(worker, tile, false, first_row, first_column);
+
+			CannyEdgeDetector &detector = worker.detector;
+			float tile_max = 0.0f;
+			for (unsigned long x = 0; x < tile.row_end - tile.row; x++) {
+				const float *magnitude = detector.edge_magnitude +
+					(first_row + x) * detector.width + first_column;
+				for (unsigned long y = 0; y < tile.column_end - tile.column; y++) {
+					tile_max = magnitude[y] > tile_max ? magnitude[y] : tile_max;
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(max_mutex);
+			max = tile_max > max ? tile_max : max;
+		});
+		ReleaseRows(input, image.data, image.stride, first_input_row(tile_row + 1), released);
+	}
+	edge_max = max > 0.0f ? max : 1.0f;
+	if (gradient == CANNY_GRADIENT_SQUARED) {
+		edge_max = sqrtf(edge_max);
+	}
+
+	/*
+	 * Suppression of non maximum pixels. Edges lying inside tiles are
+	 * propagated at once, those touching borders are left for later.
+	 */
+	released = 0;
+	unsigned long released_scratch = 0;
+	for (unsigned long tile_row = 0; tile_row < tile_rows; tile_row++) {
+		this->ForEachTile(tile_row, [&](Worker &worker, Tile &tile) {
+			unsigned long first_row, first_column;
+			this->ProcessTile(worker, tile, true, first_row, first_column);
+
+			CannyEdgeDetector &detector = worker.detector;
+			uint8_t *pixels = detector.workspace_bitmap + first_row * detector.width + first_column;
+			this->LabelTile(worker, tile, pixels, detector.width, PROPAGATION, false);
+
+			for (unsigned long x = 0; x < tile.row_end - tile.row; x++) {
+				memcpy(suppressed + (tile.row + x) * width + tile.column,
+				       pixels + x * detector.width, tile.column_end - tile.column);
+			}
+		});
+		ReleaseRows(input, image.data, image.stride, first_input_row(tile_row + 1), released);
+		ReleaseRows(&scratch, suppressed, width, tiles[tile_row * tile_columns].row_end,
+		            released_scratch);
+	}
+	this->StitchTiles(PROPAGATION);
+
+	/*
+	 * Propagation of edges crossing tiles, then hysteresis of edges lying
+	 * inside tiles.
+	 */
+	released_scratch = 0;
+	for (unsigned long tile_row = 0; tile_row < tile_rows; tile_row++) {
+		this->ForEachTile(tile_row, [&](Worker &worker, Tile &tile) {
+			uint8_t *pixels = suppressed + tile.row * width + tile.column;
+			this->LabelTile(worker, tile, pixels, width, PROPAGATION, true);
+			this->LabelTile(worker, tile, pixels, width, HYSTERESIS, false);
+		});
+		ReleaseRows(&scratch, suppressed, width, tiles[tile_row * tile_columns].row_end,
+		            released_scratch);
+	}
+	this->StitchTiles(HYSTERESIS);
+
+	/*
+	 * Hysteresis of edges crossing tiles. Margins are cut off, the rest
+	 * goes to mask.
+	 */
+	released_scratch = 0;
+	unsigned long released_mask = 0;
+	for (unsigned long tile_row = 0; tile_row < tile_rows; tile_row++) {
+		this->ForEachTile(tile_row, [&](Worker &worker, Tile &tile) {
+			uint8_t *pixels = suppressed + tile.row * width + tile.column;
+			this->LabelTile(worker, tile, pixels, width, HYSTERESIS, true);
+			this->WriteMask(tile, pixels, width, mask);
+		});
+		ReleaseRows(&scratch, suppressed, width, tiles[tile_row * tile_columns].row_end,
+		            released_scratch);
+		unsigned long mask_row = tiles[tile_row * tile_columns].row_end;
+		mask_row = mask_row > halfsize ? mask_row - halfsize : 0;
+		mask_row = mask_row < image.height ? mask_row : image.height;
+		ReleaseRows(output, mask.data, mask.stride, mask_row, released_mask);
+	}
+
+	scratch.Close();
+	return true;
+}
+
+void CannyTiledProcessor::MakeTiles(unsigned long height, unsigned long width,
+                                    unsigned int halfsize)
+{
+	// Borders of tiles lie at multiples of tile size in original image, so
+	// first tile row and column also hold margin. Border falling into far
+	// margin is dropped, last tile row and column take the margin instead
+	// of tiles outside of image.
+	std::vector<unsigned long> rows, columns;
+	for (unsigned long row = 0; row < height - halfsize; row = row == 0 ? halfsize + tile_size : row + tile_size) {
+		rows.push_back(row);
+	}
+	rows.push_back(height);
+	for (unsigned long column = 0; column < width - halfsize; column = column == 0 ? halfsize + tile_size : column + tile_size) {
+		columns.push_back(column);
+	}
+	columns.push_back(width);
+
+	tile_rows = rows.size() - 1;
+	tile_columns = columns.size() - 1;
+	tiles.resize(tile_rows * tile_columns);
+	for (unsigned long i = 0; i < tile_rows; i++) {
+		for (unsigned long j = 0; j < tile_columns; j++) {
+			Tile &tile = tiles[i * tile_columns + j];
+			tile.row = rows[i];
+			tile.row_end = rows[i + 1];
+			tile.column = columns[j];
+			tile.column_end = columns[j + 1];
+		}
+	}
+}
+
+template <typename Function>
+void CannyTiledProcessor::ForEachTile(unsigned long tile_row, const Function &function)
+{
+	// Each thread takes next tile not taken yet, with its own worker.
+	std::atomic<unsigned long> next_tile(0);
+	unsigned long count = std::min((unsigned long) workers.size(), tile_columns);
+
+	thread_pool.ParallelFor(0, count, [&](unsigned long first, unsigned long last) {
+		for (unsigned long worker = first; worker < last; worker++) {
+			unsigned long column;
+			while ((column = next_tile++) < tile_columns) {
+				function(*workers[worker], tiles[tile_row * tile_columns + column]);
+			}
+		}
+	});
+}
+
+void CannyTiledProcessor::ProcessTile(Worker &worker, const Tile &tile, bool suppress,
+                                      unsigned long &first_row, unsigned long &first_column)
+{
+	CannyEdgeDetector &detector = worker.detector;
+	static uint8_t unused_mask;
+
+	/*
+	 * Part of original image tile depends on. Detector enlarges it with its
+	 * own margins, so row r of its workspace is row `top` + r of whole
+	 * enlarged image. Rows and columns near edges of the part differ from
+	 * those of whole image, but they are outside of tile.
+	 */
+	unsigned long halo = 2 * (unsigned long) mask_halfsize + 2;
+	unsigned long top = tile.row > halo ? tile.row - halo : 0;
+	unsigned long left = tile.column > halo ? tile.column - halo : 0;
+	unsigned long bottom = std::min((unsigned long) image.height, tile.row_end + 2);
+	unsigned long right = std::min((unsigned long) image.width, tile.column_end + 2);
+
+	CannyImageView part = {image.data + top * image.stride + left * CannyPixelSize(image.format),
+	                       (unsigned int) (right - left), (unsigned int) (bottom - top),
+	                       image.stride, image.format};
+	// Mask is never written, steps end with suppression.
+	CannyMaskView mask = {&unused_mask, part.width, CANNY_MASK_GRAY8};
+
+	detector.BeginImage(part, mask, sigma);
+	if (image.format != CANNY_PIXEL_GRAY8) {
+		detector.Luminance();
+	}
+	detector.PreProcessImage();
+	detector.GaussianBlur();
+	detector.EdgeDetection();
+	if (suppress) {
+		// Scaled with maximum of whole image, not of tile.
+		detector.edge_max = edge_max;
+		detector.NonMaxSuppression();
+	}
+
+	first_row = tile.row - top;
+	first_column = tile.column - left;
+}
+
+void CannyTiledProcessor::LabelTile(Worker &worker, Tile &tile, uint8_t *pixels, size_t stride,
+                                    Round round, bool resolve)
+{
+	unsigned int rows = tile.row_end - tile.row;
+	unsigned int columns = tile.column_end - tile.column;
+	bool diagonal = round == HYSTERESIS;
+	uint8_t weak = std::min(low_threshold, high_threshold);
+	Components &tile_components = components[round];
+
+	// Propagation joins 128 pixels with 255 ones, hysteresis weak pixels
+	// with strong ones.
+	auto candidate = [&](uint8_t value) {
+		return round == PROPAGATION ? value == 128 || value == 255 : value >= weak;
+	};
+	auto strong = [&](uint8_t value) {
+		return round == PROPAGATION ? value == 255 : value >= high_threshold;
+	};
+
+	worker.labels.resize((size_t) rows * columns);
+	worker.flags.assign((size_t) rows * columns, 0);
+	unsigned int *labels = worker.labels.data();
+	uint8_t *flags = worker.flags.data();
+
+	/*
+	 * Each pixel is joined with neighbours above and on the left, which
+	 * are labeled already. Hysteresis follows only diagonal neighbours,
+	 * same as CannyEdgeDetector::HysteresisTrace().
+	 */
+	for (unsigned int x = 0; x < rows; x++) {
+		const uint8_t *row = pixels + x * stride;
+		for (unsigned int y = 0; y < columns; y++) {
+			unsigned int i = x * columns + y;
+			if (!candidate(row[y])) {
+				labels[i] = NO_COMPONENT;
+				continue;
+			}
+			labels[i] = i;
+			if (x > 0) {
+				if (y > 0 && labels[i - columns - 1] != NO_COMPONENT) {
+					JoinRoots(labels, i, i - columns - 1);
+				}
+				if (!diagonal && labels[i - columns] != NO_COMPONENT) {
+					JoinRoots(labels, i, i - columns);
+				}
+				if (y + 1 < columns && labels[i - columns + 1] != NO_COMPONENT) {
+					JoinRoots(labels, i, i - columns + 1);
+				}
+			}
+			if (!diagonal && y > 0 && labels[i - 1] != NO_COMPONENT) {
+				JoinRoots(labels, i, i - 1);
+			}
+		}
+	}
+
+	// Every pixel gets its root. Roots learn if component is strong and if
+	// it touches border.
+	for (unsigned int x = 0; x < rows; x++) {
+		const uint8_t *row = pixels + x * stride;
+		for (unsigned int y = 0; y < columns; y++) {
+			unsigned int i = x * columns + y;
+			if (labels[i] == NO_COMPONENT) {
+				continue;
+			}
+			unsigned int root = FindRoot(labels, i);
+			labels[i] = root;
+			if (strong(row[y])) {
+				flags[root] |= ROOT_STRONG;
+			}
+			if (x == 0 || x == rows - 1 || y == 0 || y == columns - 1) {
+				flags[root] |= ROOT_BORDER;
+			}
+		}
+	}
+
+	/*
+	 * Borders of tile: first and last row, first and last column.
+	 */
+	struct Side
+	{
+		std::vector<unsigned int> *components;
+		unsigned int first, step, count;
+	};
+	Side sides[4] = {
+		{&tile.top, 0, 1, columns},
+		{&tile.bottom, (rows - 1) * columns, 1, columns},
+		{&tile.left, 0, columns, rows},
+		{&tile.right, columns - 1, columns, rows}
+	};
+
+	if (!resolve) {
+		// Components touching border get numbers, in order of first border
+		// pixel, and wait for their neighbours.
+		worker.roots.clear();
+		for (unsigned int s = 0; s < 4; s++) {
+			for (unsigned int k = 0; k < sides[s].count; k++) {
+				unsigned int root = labels[sides[s].first + k * sides[s].step];
+				if (root != NO_COMPONENT && !(flags[root] & ROOT_LISTED)) {
+					flags[root] |= ROOT_LISTED;
+					worker.roots.push_back(root);
+				}
+			}
+		}
+
+		std::vector<uint8_t> root_strong(worker.roots.size());
+		for (size_t k = 0; k < worker.roots.size(); k++) {
+			root_strong[k] = (flags[worker.roots[k]] & ROOT_STRONG) != 0;
+		}
+		unsigned int first = tile_components.Add(root_strong.data(), worker.roots.size());
+		worker.components.resize((size_t) rows * columns);
+		for (size_t k = 0; k < worker.roots.size(); k++) {
+			worker.components[worker.roots[k]] = first + k;
+		}
+
+		for (unsigned int s = 0; s < 4; s++) {
+			sides[s].components->resize(sides[s].count);
+			for (unsigned int k = 0; k < sides[s].count; k++) {
+				unsigned int root = labels[sides[s].first + k * sides[s].step];
+				(*sides[s].components)[k] = root == NO_COMPONENT ? NO_COMPONENT : worker.components[root];
+			}
+		}
+	} else {
+		// Labeling is same as in first pass, so components of border
+		// pixels tell which roots are joined with strong ones.
+		for (unsigned int s = 0; s < 4; s++) {
+			for (unsigned int k = 0; k < sides[s].count; k++) {
+				unsigned int root = labels[sides[s].first + k * sides[s].step];
+				unsigned int component = (*sides[s].components)[k];
+				if (root != NO_COMPONENT && component != NO_COMPONENT &&
+				    tile_components.strong[component]) {
+					flags[root] |= ROOT_ALIVE;
+				}
+			}
+		}
+	}
+
+	/*
+	 * Resolving pixels. Hysteresis leaves nothing but edges.
+	 */
+	for (unsigned int x = 0; x < rows; x++) {
+		uint8_t *row = pixels + x * stride;
+		for (unsigned int y = 0; y < columns; y++) {
+			unsigned int root = labels[x * columns + y];
+			if (root == NO_COMPONENT) {
+				if (round == HYSTERESIS) {
+					row[y] = 0;
+				}
+			} else if (resolve || !(flags[root] & ROOT_BORDER)) {
+				row[y] = flags[root] & (ROOT_STRONG | ROOT_ALIVE) ? 255 : 0;
+			}
+		}
+	}
+}
+
+void CannyTiledProcessor::StitchTiles(Round round)
+{
+	Components &tile_components = components[round];
+	// Hysteresis follows diagonal neighbours only.
+	int step = round == HYSTERESIS ? 2 : 1;
+
+	for (unsigned long i = 0; i < tile_rows; i++) {
+		for (unsigned long j = 0; j < tile_columns; j++) {
+			Tile &tile = tiles[i * tile_columns + j];
+
+			// Right neighbour, same rows.
+			if (j + 1 < tile_columns) {
+				const std::vector<unsigned int> &left = tiles[i * tile_columns + j + 1].left;
+				long count = tile.right.size();
+				for (long k = 0; k < count; k++) {
+					for (long d = -1; d <= 1; d += step) {
+						if (k + d >= 0 && k + d < count) {
+							tile_components.Union(tile.right[k], left[k + d]);
+						}
+					}
+				}
+			}
+
+			// Neighbours below, same columns and corners.
+			if (i + 1 < tile_rows) {
+				const Tile *below = &tiles[(i + 1) * tile_columns + j];
+				long count = tile.bottom.size();
+				for (long k = 0; k < count; k++) {
+					for (long d = -1; d <= 1; d += step) {
+						if (k + d >= 0 && k + d < count) {
+							tile_components.Union(tile.bottom[k], below->top[k + d]);
+						}
+					}
+				}
+				if (j + 1 < tile_columns) {
+					tile_components.Union(tile.bottom.back(), below[1].top.front());
+				}
+				if (j > 0) {
+					tile_components.Union(tile.bottom.front(), below[-1].top.back());
+				}
+			}
+		}
+	}
+
+	tile_components.Finish();
+}
+
+void CannyTiledProcessor::WriteMask(const Tile &tile, const uint8_t *pixels, size_t stride,
+                                    const CannyMaskView &mask)
+{
+	// Only part of tile inside original image, margins are cut off.
+	unsigned long first_row = std::max(tile.row, (unsigned long) mask_halfsize);
+	unsigned long last_row = std::min(tile.row_end, (unsigned long) mask_halfsize + image.height);
+	unsigned long first_column = std::max(tile.column, (unsigned long) mask_halfsize);
+	unsigned long last_column = std::min(tile.column_end, (unsigned long) mask_halfsize + image.width);
+
+	for (unsigned long x = first_row; x < last_row; x++) {
+		const uint8_t *row = pixels + (x - tile.row) * stride + (first_column - tile.column);
+		uint8_t *target = mask.data + (x - mask_halfsize) * mask.stride;
+		unsigned long first = first_column - mask_halfsize;
+		unsigned long count = last_column - first_column;
+
+		if (mask.format == CANNY_MASK_GRAY8) {
+			memcpy(target + first, row, count);
+		} else if (mask.format == CANNY_MASK_BIT1) {
+			// Tiles start at multiple of 8 pixels, so they own their bytes.
+			memset(target + first / 8, 0, (count + 7) / 8);
+			for (unsigned long y = 0; y < count; y++) {
+				target[(first + y) / 8] |= (row[y] & 0x80) >> ((first + y) % 8);
+			}
+		} else {
+			for (unsigned long y = 0; y < count; y++) {
+				target[3 * (first + y)] = target[3 * (first + y) + 1] = target[3 * (first + y) + 2] = row[y];
+			}
+		}
+	}
+}
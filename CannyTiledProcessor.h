@@ -0,0 +1,434 @@
+/**
+ * \file      CannyTiledProcessor.h
+ * \brief     Edge detection in images bigger than memory, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYTILEDPROCESSOR_H_
+#define _CANNYTILEDPROCESSOR_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+#include "CannyImageIO.h"
+
+/**
+ * \brief Detects edges in huge images, tile by tile.
+ *
+ * Enlarged image (see CannyEdgeDetector::ProcessImage()) is cut into
+ * square tiles. Each tile is processed by ordinary detector together with
+ * halo of neighbouring pixels wide enough for Gauss mask, Sobel mask and
+ * suppression of non maximum pixels, so its suppressed magnitudes are
+ * exactly those whole image would get. Image is walked four times, tile
+ * row by tile row:
+ * - blur and Sobel, to find maximum gradient magnitude of whole image,
+ * - blur, Sobel and suppression again, scaled with that maximum, result
+ *   goes into scratch file of size of enlarged image,
+ * - propagation of edges, from scratch file back into it,
+ * - hysteresis, result goes into mask.
+ *
+ * Propagation and hysteresis label connected pixels of each tile. Parts of
+ * edges touching border of tile are joined with parts in neighbouring
+ * tiles by union-find over border pixels, so edges crossing tiles are
+ * traced as if image was whole.
+ *
+ * Tiles are always blurred with exact Gauss mask, recursive filter is never
+ * used (see CannyEdgeDetector::SetRecursiveSigma()). Masks are same as
+ * ProcessImage() gives with recursive filter turned off, which for sigma
+ * below 8 is its default, as long as `lowThreshold` is not above
+ * `highThreshold` (result of ProcessImage() then depends on order pixels
+ * are visited in).
+ *
+ * Memory taken is bounded by tile size and number of threads, plus few
+ * bytes per border pixel of each tile. Input, output and scratch file are
+ * mapped into memory and pages are dropped as soon as tile rows using them
+ * are done. Width and height are limited to 2^32 - 1 pixels each, by
+ * CannyImageView; indices of whole image are 64-bit, so their product is
+ * not.
+ */
+class CannyTiledProcessor
+{
+	public:
+		/**
+		 * \brief Constructor, tiles of 1024 x 1024 pixels, one thread.
+		 */
+		CannyTiledProcessor();
+
+		/**
+		 * \brief Destructor, frees detectors.
+		 */
+		~CannyTiledProcessor();
+
+		/**
+		 * \brief Sets size of tiles.
+		 *
+		 * \param size Width and height of tile, in pixels. Rounded up to
+		 * multiple of 8, so that tiles of 1-bit mask start at byte
+		 * boundary.
+		 */
+		void SetTileSize(unsigned int size);
+
+		/**
+		 * \brief Returns size of tiles.
+		 */
+		unsigned int GetTileSize() const;
+
+		/**
+		 * \brief Sets number of tiles processed at once.
+		 *
+		 * \param count Number of threads, 0 means one per hardware thread.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetFixedPoint().
+		 */
+		void SetFixedPoint(bool fixed_point);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetGradient().
+		 */
+		void SetGradient(CannyGradient gradient);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetBorder().
+		 */
+		void SetBorder(CannyBorder border, uint8_t value = 0);
+
+		/**
+		 * \brief Sets directory scratch file is created in.
+		 *
+		 * Scratch file is one byte per pixel of enlarged image. It is
+		 * removed as soon as it is created, so nothing is left behind.
+		 * Default is TMPDIR, or /tmp.
+		 */
+		void SetScratchDirectory(const std::string &directory);
+
+		/**
+		 * \brief Processes image view and writes edges into caller's mask.
+		 *
+		 * Same as CannyEdgeDetector::ProcessImage(), but image may be of
+		 * any size. Mask may share memory with input as well, as mask is
+		 * written only in the last pass.
+		 *
+		 * \param image Source image.
+		 * \param mask Destination mask, of `image.width` * `image.height`
+		 * pixels.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if image or mask is invalid, or scratch file cannot
+		 * be created.
+		 */
+		bool ProcessImage(const CannyImageView &image, const CannyMaskView &mask,
+		                  float sigma = 1.0f, uint8_t lowThreshold = 30,
+		                  uint8_t highThreshold = 80);
+
+		/**
+		 * \brief Processes PGM/PPM file into PGM/PBM file.
+		 *
+		 * Both files are mapped into memory, so neither of them is ever
+		 * read or written whole.
+		 *
+		 * \param input Name of binary PGM (P5) or PPM (P6) file.
+		 * \param output Name of mask file, PGM for CANNY_MASK_GRAY8 or PBM
+		 * for CANNY_MASK_BIT1.
+		 * \param format Layout of mask.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if files cannot be read or written.
+		 */
+		bool ProcessFile(const std::string &input, const std::string &output,
+		                 CannyMaskFormat format, float sigma = 1.0f,
+		                 uint8_t lowThreshold = 30, uint8_t highThreshold = 80);
+
+		/**
+		 * \brief Processes raw file, rows of pixels with no header.
+		 *
+		 * Same as above, but size and layout of image are given.
+		 *
+		 * \param input Name of raw file.
+		 * \param width Width of image.
+		 * \param height Height of image.
+		 * \param pixel_format Layout of pixels, rows are packed.
+		 * \param output Name of mask file.
+		 * \param format Layout of mask.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \return False if files cannot be read or written, or input is
+		 * too small.
+		 */
+		bool ProcessRawFile(const std::string &input, unsigned int width,
+		                    unsigned int height, CannyPixelFormat pixel_format,
+		                    const std::string &output, CannyMaskFormat format,
+		                    float sigma = 1.0f, uint8_t lowThreshold = 30,
+		                    uint8_t highThreshold = 80);
+
+	private:
+		/**
+		 * \brief Part of enlarged image processed at once.
+		 */
+		struct Tile
+		{
+			/**
+			 * \var Rows and columns of enlarged image, one past last
+			 * ones are `row_end` and `column_end`.
+			 */
+			unsigned long row, row_end, column, column_end;
+
+			/**
+			 * \var Components of pixels of first and last row, first and
+			 * last column, NO_COMPONENT for pixels not in any.
+			 */
+			std::vector<unsigned int> top, bottom, left, right;
+		};
+
+		/**
+		 * \brief Edge tracing step done by labeling.
+		 */
+		enum Round
+		{
+			PROPAGATION, ///< 128 pixels 8-connected with 255 ones.
+			HYSTERESIS   ///< Weak pixels diagonally connected with strong ones.
+		};
+
+		/**
+		 * \brief Parts of edges crossing tile borders, merged by union-find.
+		 */
+		struct Components
+		{
+			/**
+			 * \var Parent of each component, roots are their own parents.
+			 */
+			std::vector<unsigned int> parent;
+
+			/**
+			 * \var True for components holding strong pixel. After
+			 * Finish(), true for components joined with any such one.
+			 */
+			std::vector<uint8_t> strong;
+
+			/**
+			 * \var Guards adding of components by many threads.
+			 */
+			std::mutex mutex;
+
+			/**
+			 * \brief Forgets all components.
+			 */
+			void Clear();
+
+			/**
+			 * \brief Adds components, returns number of first one.
+			 *
+			 * \param strong Strength of each component.
+			 * \param count Number of components.
+			 */
+			unsigned int Add(const uint8_t *strong, unsigned int count);
+
+			/**
+			 * \brief Returns root of component.
+			 */
+			unsigned int Find(unsigned int component);
+
+			/**
+			 * \brief Joins two components, either may be NO_COMPONENT.
+			 */
+			void Union(unsigned int a, unsigned int b);
+
+			/**
+			 * \brief Spreads strength over joined components.
+			 */
+			void Finish();
+		};
+
+		/**
+		 * \brief Detector and buffers of one thread.
+		 */
+		struct Worker
+		{
+			CannyEdgeDetector detector;
+
+			/**
+			 * \var Union-find parents of tile pixels, then their roots.
+			 */
+			std::vector<unsigned int> labels;
+
+			/**
+			 * \var Flags of roots (strong, on border, alive).
+			 */
+			std::vector<uint8_t> flags;
+
+			/**
+			 * \var Components given to roots touching tile border.
+			 */
+			std::vector<unsigned int> components;
+
+			/**
+			 * \var Roots touching tile border.
+			 */
+			std::vector<unsigned int> roots;
+		};
+
+		/**
+		 * \var Marks border pixel that is not part of any component.
+		 */
+		static const unsigned int NO_COMPONENT = 0xffffffffu;
+
+		CannyTiledProcessor(const CannyTiledProcessor &);
+		CannyTiledProcessor &operator=(const CannyTiledProcessor &);
+
+		/**
+		 * \brief Runs all passes, optionally dropping pages of mapped
+		 * input and output.
+		 *
+		 * \param input File `image` lies in, or NULL.
+		 * \param output File `mask` lies in, or NULL.
+		 */
+		bool Run(const CannyImageView &image, const CannyMaskView &mask,
+		         float sigma, uint8_t lowThreshold, uint8_t highThreshold,
+		         CannyMappedFile *input, CannyMappedFile *output);
+
+		/**
+		 * \brief Creates mapped output file and runs all passes into it.
+		 *
+		 * \param input File `image` lies in.
+		 */
+		bool ProcessMapped(const CannyImageView &image, const std::string &output,
+		                   CannyMaskFormat format, float sigma, uint8_t lowThreshold,
+		                   uint8_t highThreshold, CannyMappedFile *input);
+
+		/**
+		 * \brief Cuts enlarged image into tiles.
+		 */
+		void MakeTiles(unsigned long height, unsigned long width,
+		               unsigned int halfsize);
+
+		/**
+		 * \brief Runs steps up to Sobel (and suppression) on tile with halo.
+		 *
+		 * \param worker Worker processing the tile.
+		 * \param tile Tile, its pixels are at `first_row`, `first_column`
+		 * of detector workspace afterwards.
+		 * \param suppress True to suppress non maximum pixels as well,
+		 * scaled with `edge_max`.
+		 * \param first_row Row of tile in detector workspace.
+		 * \param first_column Column of tile in detector workspace.
+		 */
+		void ProcessTile(Worker &worker, const Tile &tile, bool suppress,
+		                 unsigned long &first_row, unsigned long &first_column);
+
+		/**
+		 * \brief Labels connected pixels of tile and resolves them.
+		 *
+		 * Pixels of components not touching tile border are resolved at
+		 * once: 255 if component holds strong pixel, 0 otherwise. With
+		 * `resolve` false components touching border are left untouched,
+		 * get numbers in `components` and are written into borders of tile.
+		 * With `resolve` true they are resolved as well, by strength of
+		 * components found in borders of tile.
+		 *
+		 * \param worker Worker processing the tile.
+		 * \param tile Tile.
+		 * \param pixels First pixel of tile.
+		 * \param stride Distance between rows of `pixels`.
+		 * \param round Propagation or hysteresis.
+		 * \param resolve False for first labeling, true for second one.
+		 */
+		void LabelTile(Worker &worker, Tile &tile, uint8_t *pixels, size_t stride,
+		               Round round, bool resolve);
+
+		/**
+		 * \brief Joins components of neighbouring tiles.
+		 */
+		void StitchTiles(Round round);
+
+		/**
+		 * \brief Writes part of tile inside original image into mask.
+		 *
+		 * \param tile Tile.
+		 * \param pixels First pixel of tile, after hysteresis.
+		 * \param stride Distance between rows of `pixels`.
+		 * \param mask Mask of whole image.
+		 */
+		void WriteMask(const Tile &tile, const uint8_t *pixels, size_t stride,
+		               const CannyMaskView &mask);
+
+		/**
+		 * \brief Runs function on all tiles of tile row, in parallel.
+		 */
+		template <typename Function>
+		void ForEachTile(unsigned long tile_row, const Function &function);
+
+		/**
+		 * \var Size of tiles.
+		 */
+		unsigned int tile_size;
+
+		/**
+		 * \var Tiles, row by row, `tile_columns` in each row.
+		 */
+		std::vector<Tile> tiles;
+		unsigned long tile_rows, tile_columns;
+
+		/**
+		 * \var Components of current and previous round.
+		 */
+		Components components[2];
+
+		/**
+		 * \var Thresholds of current image.
+		 */
+		uint8_t low_threshold, high_threshold;
+
+		/**
+		 * \var One worker per thread.
+		 */
+		std::vector<Worker *> workers;
+
+		/**
+		 * \var Threads processing tiles.
+		 */
+		CannyThreadPool thread_pool;
+
+		/**
+		 * \var Scratch file with suppressed image.
+		 */
+		CannyMappedFile scratch;
+
+		/**
+		 * \var Directory scratch file is created in.
+		 */
+		std::string scratch_directory;
+
+		/**
+		 * \var Settings passed to detectors.
+		 */
+		bool fixed_point;
+		CannyGradient gradient;
+		CannyBorder border;
+		uint8_t border_value;
+
+		/**
+		 * \var Image being processed, its sigma and scaled gradient
+		 * maximum.
+		 */
+		CannyImageView image;
+		float sigma;
+		float edge_max;
+
+		/**
+		 * \var Width of margin of enlarged image.
+		 */
+		unsigned int mask_halfsize;
+};
+
+#endif // #ifndef _CANNYTILEDPROCESSOR_H_
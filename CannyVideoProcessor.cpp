@@ -0,0 +1,222 @@
+/**
+ * \file      CannyVideoProcessor.cpp
+ * \brief     Edge detection in sequences of video frames.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#include <limits.h>
+#include <algorithm>
+
+#include "CannyVideoProcessor.h"
+
+CannyVideoProcessor::CannyVideoProcessor(unsigned int width, unsigned int height,
+                                         CannyPixelFormat format, float sigma,
+                                         uint8_t lowThreshold, uint8_t highThreshold,
+                                         unsigned int depth)
+	: free_slots(depth > 2 ? depth : 2),
+	  suppress_queue(depth > 2 ? depth : 2),
+	  trace_queue(depth > 2 ? depth : 2)
+{
+	this->width = width;
+	this->height = height;
+	this->format = format;
+	this->sigma = sigma;
+	low_threshold = lowThreshold;
+	high_threshold = highThreshold;
+	this->depth = depth > 2 ? depth : 2;
+
+	// Same limits as CannyEdgeDetector::BeginImage() checks for each frame.
+	valid = sigma > 0.0f;
+	if (valid) {
+		unsigned long margin = CannyEdgeDetector::MaskSize(sigma) - 1;
+		valid = (unsigned long) (width + margin) * (height + margin) <= UINT_MAX;
+	}
+	pushed_frames = popped_frames = 0;
+	finished_frames = 0;
+	latencies.resize(CANNY_LATENCY_WINDOW);
+
+	slots = new Slot[this->depth];
+	this->ReserveSlots();
+	for (unsigned int i = 0; i < this->depth; i++) {
+		free_slots.Push(&slots[i]);
+	}
+
+	suppress_thread = std::thread(&CannyVideoProcessor::SuppressLoop, this);
+	trace_thread = std::thread(&CannyVideoProcessor::TraceLoop, this);
+}
+
+CannyVideoProcessor::~CannyVideoProcessor()
+{
+	// First stage closes second one's queue when it is done.
+	suppress_queue.Close();
+	suppress_thread.join();
+	trace_thread.join();
+
+	delete[] slots;
+}
+
+void CannyVideoProcessor::ReserveSlots()
+{
+	if (!valid) {
+		return;
+	}
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.Reserve(width, height, sigma);
+	}
+}
+
+void CannyVideoProcessor::SetThreadCount(unsigned int count)
+{
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.SetThreadCount(count);
+	}
+	// Streaming mode needs ring buffers for each thread.
+	this->ReserveSlots();
+}
+
+void CannyVideoProcessor::SetStreaming(bool streaming)
+{
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.SetStreaming(streaming);
+	}
+	this->ReserveSlots();
+}
+
+void CannyVideoProcessor::SetFixedPoint(bool fixed_point)
+{
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.SetFixedPoint(fixed_point);
+	}
+}
+
+void CannyVideoProcessor::SetGradient(CannyGradient gradient)
+{
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.SetGradient(gradient);
+	}
+}
+
+void CannyVideoProcessor::SetRecursiveSigma(float min_sigma)
+{
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.SetRecursiveSigma(min_sigma);
+	}
+}
+
+void CannyVideoProcessor::SetBorder(CannyBorder border, uint8_t value)
+{
+	for (unsigned int i = 0; i < depth; i++) {
+		slots[i].detector.SetBorder(border, value);
+	}
+}
+
+bool CannyVideoProcessor::PushFrame(const CannyImageView &image, const CannyMaskView &mask)
+{
+	if (!valid || image.width != width || image.height != height || image.format != format ||
+	    !CannyEdgeDetector::IsValid(image, mask)) {
+		return false;
+	}
+
+	Slot *slot = NULL;
+	if (!free_slots.Pop(slot)) {
+		return false;
+	}
+	slot->image = image;
+	slot->mask = mask;
+	slot->pushed = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		slot->frame = pushed_frames++;
+	}
+
+	return suppress_queue.Push(slot);
+}
+
+bool CannyVideoProcessor::PopFrame(unsigned long &frame)
+{
+	bool processed;
+
+	return this->PopFrame(frame, processed);
+}
+
+bool CannyVideoProcessor::PopFrame(unsigned long &frame, bool &processed)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (popped_frames == pushed_frames) {
+		return false;
+	}
+	frame_finished.wait(lock, [this] { return !finished.empty(); });
+	frame = finished.front().first;
+	processed = finished.front().second;
+	finished.pop_front();
+	popped_frames++;
+
+	return true;
+}
+
+CannyLatency CannyVideoProcessor::GetLatency() const
+{
+	CannyLatency latency = {0, 0.0, 0.0, 0.0, 0.0};
+	std::vector<double> window;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		latency.frames = finished_frames;
+		unsigned long count = std::min(finished_frames, (unsigned long) latencies.size());
+		window.assign(latencies.begin(), latencies.begin() + count);
+	}
+	if (window.empty()) {
+		return latency;
+	}
+
+	// Nearest-rank percentiles.
+	std::sort(window.begin(), window.end());
+	size_t last = window.size() - 1;
+	latency.p50 = window[last * 50 / 100];
+	latency.p90 = window[last * 90 / 100];
+	latency.p99 = window[last * 99 / 100];
+	latency.max = window[last];
+
+	return latency;
+}
+
+void CannyVideoProcessor::SuppressLoop()
+{
+	Slot *slot = NULL;
+
+	while (suppress_queue.Pop(slot)) {
+		slot->processed = slot->detector.BeginImage(slot->image, slot->mask, sigma);
+		if (slot->processed) {
+			slot->detector.SuppressImage();
+		}
+		trace_queue.Push(slot);
+	}
+	trace_queue.Close();
+}
+
+void CannyVideoProcessor::TraceLoop()
+{
+	Slot *slot = NULL;
+
+	while (trace_queue.Pop(slot)) {
+		if (slot->processed) {
+			slot->detector.TraceImage(low_threshold, high_threshold);
+		}
+
+		double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - slot->pushed).count();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			latencies[finished_frames % latencies.size()] = latency;
+			finished_frames++;
+			finished.push_back(std::make_pair(slot->frame, slot->processed));
+		}
+		frame_finished.notify_one();
+
+		free_slots.Push(slot);
+	}
+}
@@ -0,0 +1,263 @@
+/**
+ * \file      CannyVideoProcessor.h
+ * \brief     Edge detection in sequences of video frames, header file.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ */
+
+#ifndef _CANNYVIDEOPROCESSOR_H_
+#define _CANNYVIDEOPROCESSOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+#include "CannyQueue.h"
+
+/**
+ * \brief Number of last frames latency percentiles are computed from.
+ */
+#define CANNY_LATENCY_WINDOW 1024
+
+/**
+ * \brief Latency of frames, from PushFrame() until mask is written.
+ */
+struct CannyLatency
+{
+	/**
+	 * \var Number of frames finished so far.
+	 */
+	unsigned long frames;
+
+	/**
+	 * \var Percentiles and maximum of last CANNY_LATENCY_WINDOW frames, in
+	 * seconds.
+	 */
+	double p50, p90, p99, max;
+};
+
+/**
+ * \brief Detects edges in stream of frames of the same size.
+ *
+ * Processor is configured once, with size and layout of frames, sigma and
+ * thresholds, and then fed frames. Each frame goes through two stages
+ * running on their own threads: steps up to suppression of non maximum
+ * pixels, then propagation, hysteresis and writing of mask. So hysteresis
+ * of frame N overlaps with blur and Sobel of frame N + 1.
+ *
+ * Frames in flight are held by slots, each with its own detector. Buffers
+ * of detectors are reserved in advance and Gauss mask is built only once
+ * per slot, so frames do not pay for allocation or kernel construction.
+ * Number of slots limits how many frames are in flight at once.
+ *
+ * Masks are same as those of CannyEdgeDetector::ProcessImage().
+ *
+ * Sigma and size of frames are checked by constructor. If sigma is not
+ * positive, or enlarged frame is too big for detector, buffers are not
+ * reserved and every PushFrame() fails.
+ */
+class CannyVideoProcessor
+{
+	public:
+		/**
+		 * \brief Constructor, starts stage threads.
+		 *
+		 * \param width Width of frames.
+		 * \param height Height of frames.
+		 * \param format Layout of pixels of frames.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param lowThreshold Lower threshold of hysteresis (from range of 0-255).
+		 * \param highThreshold Upper threshold of hysteresis (from range of 0-255).
+		 * \param depth Maximum number of frames in flight, at least 2.
+		 */
+		CannyVideoProcessor(unsigned int width, unsigned int height,
+		                    CannyPixelFormat format, float sigma = 1.0f,
+		                    uint8_t lowThreshold = 30, uint8_t highThreshold = 80,
+		                    unsigned int depth = 2);
+
+		/**
+		 * \brief Destructor, finishes frames in flight and stops threads.
+		 */
+		~CannyVideoProcessor();
+
+		/**
+		 * \brief Sets number of threads each stage runs on.
+		 *
+		 * See CannyEdgeDetector::SetThreadCount(). Default is 1. Like other
+		 * setters, may only be called while no frame is in flight.
+		 */
+		void SetThreadCount(unsigned int count);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetStreaming().
+		 */
+		void SetStreaming(bool streaming);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetFixedPoint().
+		 */
+		void SetFixedPoint(bool fixed_point);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetGradient().
+		 */
+		void SetGradient(CannyGradient gradient);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetRecursiveSigma().
+		 */
+		void SetRecursiveSigma(float min_sigma);
+
+		/**
+		 * \brief See CannyEdgeDetector::SetBorder().
+		 */
+		void SetBorder(CannyBorder border, uint8_t value = 0);
+
+		/**
+		 * \brief Queues frame for processing.
+		 *
+		 * Waits while all slots are busy. Frame and mask are only referred
+		 * to, so they must stay valid (and frame unchanged) until PopFrame()
+		 * returns the frame.
+		 *
+		 * \param image Frame, of size and layout given to constructor.
+		 * \param mask Destination mask.
+		 * \return False if frame does not match configuration, views are
+		 * invalid or configuration itself is invalid, frame is not queued
+		 * then.
+		 */
+		bool PushFrame(const CannyImageView &image, const CannyMaskView &mask);
+
+		/**
+		 * \brief Waits for the oldest frame not returned yet.
+		 *
+		 * Frames are returned in order they were pushed, numbered from 0.
+		 *
+		 * \param frame Number of finished frame.
+		 * \return False if all pushed frames were already returned.
+		 */
+		bool PopFrame(unsigned long &frame);
+
+		/**
+		 * \brief Waits for the oldest frame not returned yet, telling if
+		 * detector processed it.
+		 *
+		 * \param frame Number of finished frame.
+		 * \param processed False if detector refused the frame, its mask is
+		 * not written then.
+		 * \return False if all pushed frames were already returned.
+		 */
+		bool PopFrame(unsigned long &frame, bool &processed);
+
+		/**
+		 * \brief Returns latency of frames finished so far.
+		 */
+		CannyLatency GetLatency() const;
+
+	private:
+		/**
+		 * \brief Frame in flight together with detector processing it.
+		 */
+		struct Slot
+		{
+			CannyEdgeDetector detector;
+			CannyImageView image;
+			CannyMaskView mask;
+			unsigned long frame;
+			bool processed;
+			std::chrono::steady_clock::time_point pushed;
+		};
+
+		CannyVideoProcessor(const CannyVideoProcessor &);
+		CannyVideoProcessor &operator=(const CannyVideoProcessor &);
+
+		/**
+		 * \brief Main loop of thread running steps up to suppression.
+		 */
+		void SuppressLoop();
+
+		/**
+		 * \brief Main loop of thread running propagation and hysteresis.
+		 */
+		void TraceLoop();
+
+		/**
+		 * \brief Reserves buffers of all detectors for current settings.
+		 */
+		void ReserveSlots();
+
+		/**
+		 * \var Configuration of frames.
+		 */
+		unsigned int width, height;
+		CannyPixelFormat format;
+		float sigma;
+		uint8_t low_threshold, high_threshold;
+
+		/**
+		 * \var Whether sigma and size of frames can be processed.
+		 */
+		bool valid;
+
+		/**
+		 * \var Slots, `depth` of them.
+		 */
+		Slot *slots;
+		unsigned int depth;
+
+		/**
+		 * \var Slots not holding any frame.
+		 */
+		CannyQueue<Slot *> free_slots;
+
+		/**
+		 * \var Slots waiting for first and second stage.
+		 */
+		CannyQueue<Slot *> suppress_queue, trace_queue;
+
+		/**
+		 * \var Numbers of frames finished and not popped yet, oldest first,
+		 * each with result of detector.
+		 */
+		std::deque<std::pair<unsigned long, bool> > finished;
+
+		/**
+		 * \var Number of frames pushed and popped so far.
+		 */
+		unsigned long pushed_frames, popped_frames;
+
+		/**
+		 * \var Latencies of last frames (ring), in seconds.
+		 */
+		std::vector<double> latencies;
+
+		/**
+		 * \var Number of frames finished so far.
+		 */
+		unsigned long finished_frames;
+
+		/**
+		 * \var Guards `finished`, frame counters and latencies.
+		 */
+		mutable std::mutex mutex;
+
+		/**
+		 * \var Wakes PopFrame() when frame is finished.
+		 */
+		std::condition_variable frame_finished;
+
+		/**
+		 * \var Stage threads.
+		 */
+		std::thread suppress_thread, trace_thread;
+};
+
+#endif // #ifndef _CANNYVIDEOPROCESSOR_H_
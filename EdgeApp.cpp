@@ -30,6 +30,13 @@ EdgeImageFrame::EdgeImageFrame(wxFrame *parent, const wxBitmap& bitmap, wxString
 	SetClientSize(bitmap.GetWidth(), bitmap.GetHeight());
 }
 
+void EdgeImageFrame::SetBitmap(const wxBitmap& bitmap)
+{
+	m_bitmap = bitmap;
+	SetClientSize(bitmap.GetWidth(), bitmap.GetHeight());
+	Refresh(false);
+}
+
 void EdgeImageFrame::OnEraseBackground(wxEraseEvent& WXUNUSED(event))
 {
 }
@@ -70,7 +77,9 @@ enum
 	ID_QUIT  = wxID_EXIT,
 	ID_ABOUT = wxID_ABOUT,
 	ID_NEW   = 100,
-	ID_WXBUTTON_CANNY = 1001
+	ID_WXBUTTON_CANNY = 1001,
+	ID_WXSLIDER_LOW = 1002,
+	ID_WXSLIDER_HIGH = 1003
 };
 
 IMPLEMENT_DYNAMIC_CLASS(EdgeAppFrame, wxFrame)
@@ -80,6 +89,8 @@ BEGIN_EVENT_TABLE(EdgeAppFrame, wxFrame)
 	EVT_MENU   (ID_QUIT, EdgeAppFrame::OnQuit)
 	EVT_MENU   (ID_NEW, EdgeAppFrame::OnOpenFile)
 	EVT_BUTTON (ID_WXBUTTON_CANNY, EdgeAppFrame::WxButtonCannyClick)
+	EVT_COMMAND_SCROLL (ID_WXSLIDER_LOW, EdgeAppFrame::WxSliderScroll)
+	EVT_COMMAND_SCROLL (ID_WXSLIDER_HIGH, EdgeAppFrame::WxSliderScroll)
 END_EVENT_TABLE()
 
 EdgeAppFrame::EdgeAppFrame()
@@ -101,6 +112,16 @@ EdgeAppFrame::EdgeAppFrame()
 
 	WxButtonCanny = new wxButton(this, ID_WXBUTTON_CANNY, wxT("Canny"), wxPoint(5, 5), wxSize(75, 25), 0, wxDefaultValidator, wxT("WxButtonCanny"));
 
+	// Hysteresis thresholds, result is updated while sliders are dragged.
+	new wxStaticText(this, wxID_ANY, wxT("Low"), wxPoint(5, 40));
+	WxSliderLow = new wxSlider(this, ID_WXSLIDER_LOW, 15, 0, 255, wxPoint(5, 55), wxSize(75, 40), wxSL_HORIZONTAL | wxSL_LABELS, wxDefaultValidator, wxT("WxSliderLow"));
+	new wxStaticText(this, wxID_ANY, wxT("High"), wxPoint(5, 100));
+	WxSliderHigh = new wxSlider(this, ID_WXSLIDER_HIGH, 21, 0, 255, wxPoint(5, 115), wxSize(75, 40), wxSL_HORIZONTAL | wxSL_LABELS, wxDefaultValidator, wxT("WxSliderHigh"));
+
+	edges_width = edges_height = 0;
+	// Sliders threshold last image again.
+	canny.SetKeepSuppressed(true);
+
 	SetIcon(wxNullIcon);
 	Center();
 
@@ -139,18 +160,38 @@ void EdgeAppFrame::OnQuit(wxCommandEvent &WXUNUSED(event))
 void EdgeAppFrame::WxButtonCannyClick(wxCommandEvent& WXUNUSED(event))
 {
 	if (image.IsOk()) {
-		CannyEdgeDetector *canny = new CannyEdgeDetector();
-
-		(new EdgeImageFrame(this,
-		                    wxBitmap(wxImage(image.GetWidth(),
-		                                     image.GetHeight(),
-		                                     canny->ProcessImage(image.GetData(),
-		                                                         image.GetWidth(),
-		                                                         image.GetHeight(),
-		                                                         1.0f, 15, 21),
-		                                     true)),
-		                    _T("Canny"))
-		)->Show();
+		edges_width = image.GetWidth();
+		edges_height = image.GetHeight();
+		edges.resize((size_t) edges_width * edges_height * 3);
+
+		// Loaded image stays intact, edges go to separate RGB buffer.
+		CannyImageView view = {image.GetData(), edges_width, edges_height,
+		                       (size_t) edges_width * 3, CANNY_PIXEL_RGB24};
+		CannyMaskView mask = {edges.data(), (size_t) edges_width * 3, CANNY_MASK_BGR24};
+
+		canny.ProcessImage(view, mask, 1.0f, WxSliderLow->GetValue(),
+		                   WxSliderHigh->GetValue());
+		this->ShowEdges();
+	}
+}
+
+void EdgeAppFrame::WxSliderScroll(wxScrollEvent& WXUNUSED(event))
+{
+	// Only hysteresis is repeated, on image processed last.
+	if (canny.Rethreshold(WxSliderLow->GetValue(), WxSliderHigh->GetValue())) {
+		this->ShowEdges();
+	}
+}
+
+void EdgeAppFrame::ShowEdges()
+{
+	wxBitmap bitmap(wxImage(edges_width, edges_height, edges.data(), true));
+
+	if (result_frame) {
+		result_frame->SetBitmap(bitmap);
+	} else {
+		result_frame = new EdgeImageFrame(this, bitmap, _T("Canny"));
+		result_frame->Show();
 	}
 }
 
@@ -11,10 +11,17 @@
 #ifndef _EDGEAPP_H_
 #define _EDGEAPP_H_
 
+#include <vector>
+
+#include <wx/weakref.h>
+
+#include "CannyEdgeDetector.h"
+
 class EdgeImageFrame : public wxFrame
 {
 	public:
 		EdgeImageFrame(wxFrame *parent, const wxBitmap& bitmap, wxString title);
+		void SetBitmap(const wxBitmap& bitmap);
 		void OnEraseBackground(wxEraseEvent& WXUNUSED(event));
 		void OnPaint(wxPaintEvent& WXUNUSED(event));
 
@@ -50,7 +57,28 @@ class EdgeAppFrame: public wxFrame
 	private:
 		wxImage image;
 		wxButton *WxButtonCanny;
+		wxSlider *WxSliderLow;
+		wxSlider *WxSliderHigh;
 		void WxButtonCannyClick(wxCommandEvent& event);
+		void WxSliderScroll(wxScrollEvent& event);
+		void ShowEdges();
+
+		/**
+		 * \var Detector kept between clicks, so thresholds can be changed
+		 * without processing image again.
+		 */
+		CannyEdgeDetector canny;
+
+		/**
+		 * \var Edges of last processed image, RGB pixels.
+		 */
+		std::vector<uint8_t> edges;
+		unsigned int edges_width, edges_height;
+
+		/**
+		 * \var Window showing edges, NULL once user closes it.
+		 */
+		wxWeakRef<EdgeImageFrame> result_frame;
 
 	private:
 		DECLARE_DYNAMIC_CLASS(EdgeAppFrame)
@@ -0,0 +1,657 @@
+/**
+ * \file      EdgeBench.cpp
+ * \brief     Benchmark of Canny algorithm steps.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ * Each step of the algorithm is timed on its own, and whole ProcessImage()
+ * too, for every combination of image size, sigma and content. Content is
+ * either synthetic or read from PGM/PPM files. Results are written as JSON,
+ * so they can be compared between versions.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+#include "CannyImageIO.h"
+
+/**
+ * \brief Maximum number of timed steps of one run.
+ */
+#define BENCH_MAX_STAGES 10
+
+/**
+ * \brief Settings given on command line.
+ */
+struct Options
+{
+	std::string output;
+	std::vector<std::string> sizes;
+	std::vector<float> sigmas;
+	std::vector<std::string> contents;
+	unsigned int repeat;
+	unsigned int threads;
+	unsigned int low_threshold;
+	unsigned int high_threshold;
+	CannyKernelSet kernel_set;
+	CannyGradient gradient;
+	bool fixed_point;
+	bool streaming;
+	bool tasks;
+	float recursive_sigma;
+};
+
+/**
+ * \brief Best times of one image, sigma pair.
+ */
+struct Result
+{
+	std::string content;
+	unsigned int width, height;
+	size_t bytes;
+	float sigma;
+	unsigned int stage_count;
+	const char *stage_names[BENCH_MAX_STAGES];
+	double stage_seconds[BENCH_MAX_STAGES];
+	double total_seconds;
+	unsigned long edge_pixels;
+};
+
+/**
+ * \brief Named image size.
+ */
+struct NamedSize
+{
+	const char *name;
+	unsigned int width, height;
+};
+
+static const NamedSize named_sizes[] = {
+	{"vga",  640,  480},
+	{"hd",   1280, 720},
+	{"fhd",  1920, 1080},
+	{"4k",   3840, 2160},
+	{"12mp", 4000, 3000},
+	{"50mp", 8192, 6144}
+};
+
+static const char *gradient_names[] = {"exact", "squared", "l1"};
+
+static double Seconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * \brief Runs steps of CannyEdgeDetector::ProcessImage() one by one.
+ *
+ * Declared friend of detector, so it reaches private steps. Order of steps
+ * must follow ProcessImage().
+ */
+class CannyBenchmark
+{
+	public:
+		/**
+		 * \brief Processes image, timing each step.
+		 *
+		 * \param detector Detector, with mode already set.
+		 * \param image Source image.
+		 * \param mask Destination mask.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param low Lower threshold of hysteresis.
+		 * \param high Upper threshold of hysteresis.
+		 * \param names Names of steps run.
+		 * \param seconds Time of each step.
+		 * \return Number of steps run, 0 if image is invalid.
+		 */
+		static unsigned int RunStages(CannyEdgeDetector &detector,
+		                              const CannyImageView &image,
+		                              const CannyMaskView &mask, float sigma,
+		                              uint8_t low, uint8_t high,
+		                              const char **names, double *seconds)
+		{
+			unsigned int count = 0;
+			std::chrono::steady_clock::time_point start;
+
+			if (!detector.BeginImage(image, mask, sigma)) {
+				return 0;
+			}
+
+#define BENCH_STAGE(name, call) \
+			start = std::chrono::steady_clock::now(); \
+			call; \
+			seconds[count] = Seconds(start); \
+			names[count++] = name;
+
+			if (detector.streaming) {
+				BENCH_STAGE("StreamImage", detector.StreamImage());
+			} else if (detector.task_scheduling && !detector.UsesRecursiveBlur()) {
+				BENCH_STAGE("TaskImage", detector.TaskImage());
+			} else {
+				if (image.format != CANNY_PIXEL_GRAY8) {
+					BENCH_STAGE("Luminance", detector.Luminance());
+				}
+				BENCH_STAGE("PreProcessImage", detector.PreProcessImage());
+				BENCH_STAGE("GaussianBlur", detector.BlurImage());
+				BENCH_STAGE("EdgeDetection", detector.EdgeDetection());
+				BENCH_STAGE("NonMaxSuppression", detector.NonMaxSuppression());
+			}
+			BENCH_STAGE("PropagateEdges", detector.PropagateEdges());
+			BENCH_STAGE("Hysteresis", detector.Hysteresis(low, high));
+			BENCH_STAGE("PostProcessImage", detector.PostProcessImage());
+
+#undef BENCH_STAGE
+
+			return count;
+		}
+};
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr,
+	        "Usage: %s [options] [IMAGE...]\n"
+	        "Times steps of Canny algorithm and writes results as JSON. Synthetic\n"
+	        "images are used, and PGM/PPM files given, at their own size.\n"
+	        "\n"
+	        "  -o, --output FILE    file JSON is written to (default: standard output)\n"
+	        "  -z, --sizes LIST     synthetic image sizes, names (vga, hd, fhd, 4k,\n"
+	        "                       12mp, 50mp) or WxH (default: all names)\n"
+	        "  -s, --sigmas LIST    sigma values (default: 0.8,1.4,2.5,4)\n"
+	        "  -c, --contents LIST  synthetic content, noise, checkerboard, flat,\n"
+	        "                       texture or none (default: all but none)\n"
+	        "  -r, --repeat N       runs of each case, best is taken (default 3)\n"
+	        "  -t, --threads N      threads per image, 0 for one per core (default 1)\n"
+	        "  -l, --low N          low hysteresis threshold, 0-255 (default 30)\n"
+	        "  -H, --high N         high hysteresis threshold, 0-255 (default 80)\n"
+	        "  -k, --kernels SET    auto, scalar, sse41 or avx2 (default auto)\n"
+	        "  -g, --gradient MODE  exact, squared or l1 (default exact)\n"
+	        "  -f, --fixed          fixed-point luminance and blur\n"
+	        "      --streaming      fused row-by-row processing\n"
+	        "      --tasks          steps of strips as work-stealing tasks\n"
+	        "      --recursive S    recursive blur from sigma S on, 0 for never\n"
+	        "                       (default 8)\n"
+	        "  -h, --help           show this message\n",
+	        name);
+}
+
+/**
+ * \brief Splits comma separated list.
+ */
+static std::vector<std::string> SplitList(const char *list)
+{
+	std::vector<std::string> items;
+	std::string item;
+
+	for (const char *c = list; ; c++) {
+		if (*c == ',' || *c == '\0') {
+			if (!item.empty()) {
+				items.push_back(item);
+			}
+			item.clear();
+			if (*c == '\0') {
+				break;
+			}
+		} else {
+			item += *c;
+		}
+	}
+
+	return items;
+}
+
+/**
+ * \brief Converts size name or WxH into width and height.
+ */
+static bool ParseSize(const std::string &size, unsigned int &width, unsigned int &height)
+{
+	for (size_t i = 0; i < sizeof(named_sizes) / sizeof(named_sizes[0]); i++) {
+		if (size == named_sizes[i].name) {
+			width = named_sizes[i].width;
+			height = named_sizes[i].height;
+			return true;
+		}
+	}
+
+	return sscanf(size.c_str(), "%ux%u", &width, &height) == 2 && width > 0 && height > 0;
+}
+
+static bool IsContent(const std::string &content)
+{
+	return content == "noise" || content == "checkerboard" || content == "flat" ||
+	       content == "texture" || content == "none";
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options, int &first_input)
+{
+	static const struct option long_options[] = {
+		{"output",    required_argument, NULL, 'o'},
+		{"sizes",     required_argument, NULL, 'z'},
+		{"sigmas",    required_argument, NULL, 's'},
+		{"contents",  required_argument, NULL, 'c'},
+		{"repeat",    required_argument, NULL, 'r'},
+		{"threads",   required_argument, NULL, 't'},
+		{"low",       required_argument, NULL, 'l'},
+		{"high",      required_argument, NULL, 'H'},
+		{"kernels",   required_argument, NULL, 'k'},
+		{"gradient",  required_argument, NULL, 'g'},
+		{"fixed",     no_argument,       NULL, 'f'},
+		{"streaming", no_argument,       NULL, 'S'},
+		{"tasks",     no_argument,       NULL, 'K'},
+		{"recursive", required_argument, NULL, 'R'},
+		{"help",      no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	std::vector<std::string> items;
+	std::string value;
+	int option;
+
+	options.sizes = SplitList("vga,hd,fhd,4k,12mp,50mp");
+	options.sigmas.clear();
+	options.sigmas.push_back(0.8f);
+	options.sigmas.push_back(1.4f);
+	options.sigmas.push_back(2.5f);
+	options.sigmas.push_back(4.0f);
+	options.contents = SplitList("noise,checkerboard,flat,texture");
+	options.repeat = 3;
+	options.threads = 1;
+	options.low_threshold = 30;
+	options.high_threshold = 80;
+	options.kernel_set = CANNY_KERNELS_AUTO;
+	options.gradient = CANNY_GRADIENT_EXACT;
+	options.fixed_point = false;
+	options.streaming = false;
+	options.tasks = false;
+	options.recursive_sigma = 8.0f;
+
+	while ((option = getopt_long(argc, argv, "o:z:s:c:r:t:l:H:k:g:fh", long_options, NULL)) != -1) {
+		switch (option) {
+			case 'o':
+				options.output = optarg;
+				break;
+			case 'z':
+				options.sizes = SplitList(optarg);
+				break;
+			case 's':
+				items = SplitList(optarg);
+				options.sigmas.clear();
+				for (size_t i = 0; i < items.size(); i++) {
+					options.sigmas.push_back(atof(items[i].c_str()));
+				}
+				break;
+			case 'c':
+				options.contents = SplitList(optarg);
+				break;
+			case 'r':
+				options.repeat = atoi(optarg);
+				break;
+			case 't':
+				options.threads = atoi(optarg);
+				break;
+			case 'l':
+				options.low_threshold = atoi(optarg);
+				break;
+			case 'H':
+				options.high_threshold = atoi(optarg);
+				break;
+			case 'k':
+				value = optarg;
+				if (value == "auto") {
+					options.kernel_set = CANNY_KERNELS_AUTO;
+				} else if (value == "scalar") {
+					options.kernel_set = CANNY_KERNELS_SCALAR;
+				} else if (value == "sse41") {
+					options.kernel_set = CANNY_KERNELS_SSE41;
+				} else if (value == "avx2") {
+					options.kernel_set = CANNY_KERNELS_AVX2;
+				} else {
+					return false;
+				}
+				break;
+			case 'g':
+				value = optarg;
+				if (value == "exact") {
+					options.gradient = CANNY_GRADIENT_EXACT;
+				} else if (value == "squared") {
+					options.gradient = CANNY_GRADIENT_SQUARED;
+				} else if (value == "l1") {
+					options.gradient = CANNY_GRADIENT_L1;
+				} else {
+					return false;
+				}
+				break;
+			case 'f':
+				options.fixed_point = true;
+				break;
+			case 'S':
+				options.streaming = true;
+				break;
+			case 'K':
+				options.tasks = true;
+				break;
+			case 'R':
+				options.recursive_sigma = atof(optarg);
+				break;
+			default:
+				return false;
+		}
+	}
+
+	unsigned int width, height;
+	for (size_t i = 0; i < options.sizes.size(); i++) {
+		if (!ParseSize(options.sizes[i], width, height)) {
+			fprintf(stderr, "Invalid size: %s\n", options.sizes[i].c_str());
+			return false;
+		}
+	}
+	for (size_t i = 0; i < options.contents.size(); i++) {
+		if (!IsContent(options.contents[i])) {
+			fprintf(stderr, "Invalid content: %s\n", options.contents[i].c_str());
+			return false;
+		}
+	}
+	for (size_t i = 0; i < options.sigmas.size(); i++) {
+		if (options.sigmas[i] <= 0.0f) {
+			fprintf(stderr, "Invalid sigma\n");
+			return false;
+		}
+	}
+	if (options.sigmas.empty() || options.repeat < 1 ||
+	    options.low_threshold > 255 || options.high_threshold > 255) {
+		fprintf(stderr, "Invalid option value\n");
+		return false;
+	}
+
+	first_input = optind;
+	return true;
+}
+
+/**
+ * \brief Generates synthetic BGR image.
+ *
+ * - noise: independent uniform random channels, edges everywhere,
+ * - checkerboard: 16 pixel squares, long straight edges,
+ * - flat: single color, no edges at all,
+ * - texture: three sine gratings of different period and orientation,
+ *   dense curved edges.
+ *
+ * Same content is generated every time.
+ */
+static void GenerateImage(const std::string &content, unsigned int width,
+                          unsigned int height, CannyImage &image)
+{
+	image.width = width;
+	image.height = height;
+	image.format = CANNY_PIXEL_BGR24;
+	image.pixels.resize((size_t) width * height * 3);
+
+	uint8_t *pixel = image.pixels.data();
+	if (content == "noise") {
+		uint32_t state = 2463534242u;
+		for (size_t i = 0; i < image.pixels.size(); i++) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			pixel[i] = (uint8_t) (state >> 24);
+		}
+	} else if (content == "checkerboard") {
+		for (unsigned int x = 0; x < height; x++) {
+			for (unsigned int y = 0; y < width; y++, pixel += 3) {
+				uint8_t value = ((x / 16 + y / 16) % 2) ? 224 : 32;
+				pixel[0] = value;
+				pixel[1] = value;
+				pixel[2] = value;
+			}
+		}
+	} else if (content == "flat") {
+		for (size_t i = 0; i < image.pixels.size(); i += 3) {
+			pixel[i] = 96;
+			pixel[i + 1] = 128;
+			pixel[i + 2] = 160;
+		}
+	} else {
+		// sin(a x + b y) = sin(a x) cos(b y) + cos(a x) sin(b y), so only
+		// tables of rows and columns are needed.
+		static const float frequencies[3][2] = {
+			{0.70f, 0.25f}, {-0.31f, 0.93f}, {1.47f, -1.12f}
+		};
+		std::vector<float> row_sin(3 * height), row_cos(3 * height);
+		std::vector<float> column_sin(3 * width), column_cos(3 * width);
+		for (unsigned int g = 0; g < 3; g++) {
+			for (unsigned int x = 0; x < height; x++) {
+				row_sin[g * height + x] = sinf(frequencies[g][0] * x);
+				row_cos[g * height + x] = cosf(frequencies[g][0] * x);
+			}
+			for (unsigned int y = 0; y < width; y++) {
+				column_sin[g * width + y] = sinf(frequencies[g][1] * y);
+				column_cos[g * width + y] = cosf(frequencies[g][1] * y);
+			}
+		}
+		for (unsigned int x = 0; x < height; x++) {
+			for (unsigned int y = 0; y < width; y++, pixel += 3) {
+				float value[3];
+				for (unsigned int g = 0; g < 3; g++) {
+					value[g] = row_sin[g * height + x] * column_cos[g * width + y] +
+					           row_cos[g * height + x] * column_sin[g * width + y];
+				}
+				pixel[0] = (uint8_t) (128.0f + 40.0f * (value[0] + value[1] + value[2]));
+				pixel[1] = (uint8_t) (128.0f + 60.0f * (value[0] + value[1]));
+				pixel[2] = (uint8_t) (128.0f + 60.0f * (value[1] + value[2]));
+			}
+		}
+	}
+}
+
+/**
+ * \brief Times one image at one sigma, keeps best of repeated runs.
+ */
+static bool RunCase(const Options &options, CannyEdgeDetector &detector,
+                    const std::string &content, const CannyImage &image,
+                    float sigma, std::vector<uint8_t> &mask_pixels, Result &result)
+{
+	CannyImageView view = image.View();
+	CannyMaskView mask = {NULL, image.width, CANNY_MASK_GRAY8};
+	double seconds[BENCH_MAX_STAGES];
+
+	mask_pixels.resize((size_t) image.width * image.height);
+	mask.data = mask_pixels.data();
+
+	result.content = content;
+	result.width = image.width;
+	result.height = image.height;
+	result.bytes = image.pixels.size();
+	result.sigma = sigma;
+	result.stage_count = 0;
+	result.total_seconds = 0.0;
+
+	// First run grows arena and builds Gauss mask, it is not timed.
+	if (!detector.ProcessImage(view, mask, sigma, options.low_threshold,
+	                           options.high_threshold)) {
+		return false;
+	}
+
+	for (unsigned int run = 0; run < options.repeat; run++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		detector.ProcessImage(view, mask, sigma, options.low_threshold,
+		                      options.high_threshold);
+		double total = Seconds(start);
+		if (run == 0 || total < result.total_seconds) {
+			result.total_seconds = total;
+		}
+
+		result.stage_count = CannyBenchmark::RunStages(detector, view, mask, sigma,
+		                                               options.low_threshold,
+		                                               options.high_threshold,
+		                                               result.stage_names, seconds);
+		for (unsigned int i = 0; i < result.stage_count; i++) {
+			if (run == 0 || seconds[i] < result.stage_seconds[i]) {
+				result.stage_seconds[i] = seconds[i];
+			}
+		}
+	}
+
+	result.edge_pixels = 0;
+	for (size_t i = 0; i < mask_pixels.size(); i++) {
+		result.edge_pixels += mask_pixels[i] != 0;
+	}
+
+	return true;
+}
+
+/**
+ * \brief Writes string as JSON string literal.
+ */
+static void WriteString(FILE *file, const std::string &value)
+{
+	fputc('"', file);
+	for (size_t i = 0; i < value.size(); i++) {
+		unsigned char c = value[i];
+		if (c == '"' || c == '\\') {
+			fprintf(file, "\\%c", c);
+		} else if (c < 0x20) {
+			fprintf(file, "\\u%04x", c);
+		} else {
+			fputc(c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+/**
+ * \brief Writes time of one step as JSON object.
+ */
+static void WriteTiming(FILE *file, const char *name, double seconds,
+                        const Result &result, bool last)
+{
+	double pixels = (double) result.width * result.height;
+	seconds = seconds > 0.0 ? seconds : 1e-9;
+
+	fprintf(file, "        \"%s\": {\"seconds\": %.9f, \"ns_per_pixel\": %.4f, \"gb_per_s\": %.4f}%s\n",
+	        name, seconds, seconds * 1e9 / pixels, result.bytes / seconds / 1e9,
+	        last ? "" : ",");
+}
+
+static void WriteResults(FILE *file, const Options &options, const CannyEdgeDetector &detector,
+                         const std::vector<Result> &results)
+{
+	fprintf(file, "{\n");
+	fprintf(file, "  \"kernels\": \"%s\",\n", CannySelectKernels(detector.GetKernelSet())->name);
+	fprintf(file, "  \"threads\": %u,\n", detector.GetThreadCount());
+	fprintf(file, "  \"streaming\": %s,\n", options.streaming ? "true" : "false");
+	fprintf(file, "  \"tasks\": %s,\n", options.tasks ? "true" : "false");
+	fprintf(file, "  \"fixed_point\": %s,\n", options.fixed_point ? "true" : "false");
+	fprintf(file, "  \"recursive_sigma\": %g,\n", options.recursive_sigma);
+	fprintf(file, "  \"gradient\": \"%s\",\n", gradient_names[options.gradient]);
+	fprintf(file, "  \"low_threshold\": %u,\n", options.low_threshold);
+	fprintf(file, "  \"high_threshold\": %u,\n", options.high_threshold);
+	fprintf(file, "  \"repeat\": %u,\n", options.repeat);
+	fprintf(file, "  \"results\": [");
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const Result &result = results[i];
+
+		fprintf(file, "%s\n    {\n", i > 0 ? "," : "");
+		fprintf(file, "      \"content\": ");
+		WriteString(file, result.content);
+		fprintf(file, ",\n");
+		fprintf(file, "      \"width\": %u,\n", result.width);
+		fprintf(file, "      \"height\": %u,\n", result.height);
+		fprintf(file, "      \"bytes\": %lu,\n", (unsigned long) result.bytes);
+		fprintf(file, "      \"sigma\": %g,\n", result.sigma);
+		fprintf(file, "      \"edge_pixels\": %lu,\n", result.edge_pixels);
+		fprintf(file, "      \"stages\": {\n");
+		for (unsigned int j = 0; j < result.stage_count; j++) {
+			WriteTiming(file, result.stage_names[j], result.stage_seconds[j], result, false);
+		}
+		WriteTiming(file, "ProcessImage", result.total_seconds, result, true);
+		fprintf(file, "      }\n    }");
+	}
+
+	fprintf(file, "\n  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	CannyEdgeDetector detector;
+	std::vector<Result> results;
+	std::vector<uint8_t> mask;
+	CannyImage image;
+	Result result;
+	int first_input;
+
+	if (!ParseOptions(argc, argv, options, first_input)) {
+		PrintUsage(argv[0]);
+		return 2;
+	}
+	if (!detector.SetKernelSet(options.kernel_set)) {
+		fprintf(stderr, "Instruction set not supported by processor\n");
+		return 1;
+	}
+	detector.SetThreadCount(options.threads);
+	detector.SetStreaming(options.streaming);
+	detector.SetTaskScheduling(options.tasks);
+	detector.SetFixedPoint(options.fixed_point);
+	detector.SetGradient(options.gradient);
+	detector.SetRecursiveSigma(options.recursive_sigma);
+
+	for (size_t i = 0; i < options.sizes.size(); i++) {
+		unsigned int width = 0, height = 0;
+		ParseSize(options.sizes[i], width, height);
+
+		for (size_t j = 0; j < options.contents.size(); j++) {
+			if (options.contents[j] == "none") {
+				continue;
+			}
+			GenerateImage(options.contents[j], width, height, image);
+			for (size_t k = 0; k < options.sigmas.size(); k++) {
+				fprintf(stderr, "%s %ux%u sigma %g\n", options.contents[j].c_str(),
+				        width, height, options.sigmas[k]);
+				if (RunCase(options, detector, options.contents[j], image,
+				            options.sigmas[k], mask, result)) {
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	// Real-world images, at their own size.
+	for (int i = first_input; i < argc; i++) {
+		if (!CannyReadPNM(argv[i], image)) {
+			fprintf(stderr, "%s: cannot read\n", argv[i]);
+			return 1;
+		}
+		for (size_t k = 0; k < options.sigmas.size(); k++) {
+			fprintf(stderr, "%s sigma %g\n", argv[i], options.sigmas[k]);
+			if (RunCase(options, detector, argv[i], image, options.sigmas[k], mask, result)) {
+				results.push_back(result);
+			}
+		}
+	}
+
+	FILE *file = stdout;
+	if (!options.output.empty()) {
+		file = fopen(options.output.c_str(), "w");
+		if (file == NULL) {
+			fprintf(stderr, "%s: cannot write\n", options.output.c_str());
+			return 1;
+		}
+	}
+	WriteResults(file, options, detector, results);
+	if (file != stdout && fclose(file) != 0) {
+		fprintf(stderr, "%s: cannot write\n", options.output.c_str());
+		return 1;
+	}
+
+	return 0;
+}
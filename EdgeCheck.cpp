@@ -0,0 +1,509 @@
+/**
+ * \file      EdgeCheck.cpp
+ * \brief     Consistency checks of detector, run by `make check`.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ * Fixed-point luminance and blur of every kernel set supported by processor
+ * are compared with floating-point ones on random, checkerboard and gradient
+ * images, for sigma from 0.3 to 8. Gray image may differ by one level and
+ * blurred one by two.
+ *
+ * Recursive blur is compared with exact mask for sigma from 2 to 12 and all
+ * border modes. Blurred pixels may differ by four gray levels on average
+ * and by sixteen at most; high-contrast checkerboard, whose period is close
+ * to width of mask, comes nearest to both bounds.
+ *
+ * Masks of CannyTiledProcessor are compared with those of ProcessImage() for
+ * sizes just below multiples of tile size, where last tile would lie in
+ * margin only.
+ *
+ * Masks of task scheduling on two to eight threads are compared with
+ * single-threaded ones on images of random size.
+ *
+ * Masks of parallel edge propagation and hysteresis are compared with serial
+ * ones for random thresholds, and so are counters of statistics when built
+ * with `make INSTRUMENTATION=1`.
+ *
+ * Exit status is non-zero when any check fails, so `make check` fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+#include "CannyTiledProcessor.h"
+
+/**
+ * \brief Largest difference of gray image allowed.
+ */
+#define CHECK_GRAY_BOUND 1
+
+/**
+ * \brief Largest difference of blurred image allowed.
+ */
+#define CHECK_BLUR_BOUND 2
+
+/**
+ * \brief Largest mean difference of recursive blur from exact mask allowed.
+ */
+#define CHECK_RECURSIVE_MEAN_BOUND 4.0
+
+/**
+ * \brief Largest difference of recursive blur from exact mask allowed.
+ */
+#define CHECK_RECURSIVE_MAX_BOUND 16
+
+/**
+ * \brief Runs steps of CannyEdgeDetector::ProcessImage() up to blur.
+ *
+ * Declared friend of detector, so it reaches private steps.
+ */
+class CannyCheck
+{
+	public:
+		/**
+		 * \brief Converts and blurs image, copying out both results.
+		 *
+		 * \param detector Detector, with mode already set.
+		 * \param image Source image.
+		 * \param sigma Gaussian function standard deviation.
+		 * \param gray Gray image.
+		 * \param blurred Blurred image, of the same size.
+		 */
+		static void RunBlur(CannyEdgeDetector &detector, const CannyImageView &image,
+		                    float sigma, std::vector<uint8_t> &gray,
+		                    std::vector<uint8_t> &blurred)
+		{
+			static uint8_t unused_mask;
+			CannyMaskView mask = {&unused_mask, image.width, CANNY_MASK_GRAY8};
+
+			detector.BeginImage(image, mask, sigma);
+			detector.Luminance();
+			gray.assign(detector.gray_bitmap,
+			            detector.gray_bitmap + (size_t) image.width * image.height);
+
+			detector.PreProcessImage();
+			detector.BlurImage();
+
+			// Only pixels of image, margins are not blurred.
+			unsigned int halfsize = detector.mask_halfsize;
+			blurred.resize((size_t) image.width * image.height);
+			for (unsigned int x = 0; x < image.height; x++) {
+				const uint8_t *row = detector.workspace_bitmap +
+				                     (size_t) (x + halfsize) * detector.width + halfsize;
+				std::copy(row, row + image.width, blurred.begin() + (size_t) x * image.width);
+			}
+
+			detector.width = image.width;
+			detector.height = image.height;
+		}
+
+		/**
+		 * \brief Returns width of margin detector adds for sigma.
+		 */
+		static unsigned int HalfSize(float sigma)
+		{
+			return CannyEdgeDetector::MaskSize(sigma) / 2;
+		}
+};
+
+/**
+ * \brief Kinds of test images.
+ */
+enum CheckContent
+{
+	CHECK_RANDOM,
+	CHECK_CHECKERBOARD,
+	CHECK_GRADIENT,
+	CHECK_CONTENTS
+};
+
+static const char *content_names[] = {"random", "checkerboard", "gradient"};
+
+static const char *kernel_names[] = {"auto", "scalar", "sse41", "avx2"};
+
+/**
+ * \brief Fills BGR image of given content.
+ */
+static void MakeImage(CheckContent content, unsigned int width, unsigned int height,
+                      std::vector<uint8_t> &pixels)
+{
+	pixels.resize((size_t) width * height * 3);
+	for (unsigned int x = 0; x < height; x++) {
+		for (unsigned int y = 0; y < width; y++) {
+			uint8_t *pixel = &pixels[((size_t) x * width + y) * 3];
+			for (int c = 0; c < 3; c++) {
+				if (content == CHECK_RANDOM) {
+					pixel[c] = rand() & 255;
+				} else if (content == CHECK_CHECKERBOARD) {
+					pixel[c] = ((x / 5 + y / 7) & 1) ? 255 - 40 * c : 40 * c;
+				} else {
+					pixel[c] = (y * 255 / width + x * 60 / height * c) & 255;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * \brief Returns largest difference between two images.
+ */
+static int MaxDifference(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+	int worst = 0;
+	for (size_t i = 0; i < a.size(); i++) {
+		int difference = abs((int) a[i] - (int) b[i]);
+		worst = difference > worst ? difference : worst;
+	}
+	return worst;
+}
+
+/**
+ * \brief Returns bytes per row of mask of given format.
+ */
+static size_t MaskStride(CannyMaskFormat format, unsigned int width)
+{
+	return format == CANNY_MASK_BIT1 ? (width + 7) / 8 : format == CANNY_MASK_BGR24 ? (size_t) width * 3 : width;
+}
+
+/**
+ * \brief Compares fixed-point gray and blurred images with floating-point ones.
+ */
+static void CheckFixedPoint(unsigned long &cases, unsigned long &failures)
+{
+	static const float sigmas[] = {0.3f, 0.5f, 0.8f, 1.0f, 1.4f, 2.0f, 2.5f, 3.0f, 4.0f, 5.0f, 6.0f, 8.0f};
+	static const unsigned int sizes[][2] = {{1, 1}, {7, 3}, {61, 47}, {256, 97}};
+
+	for (int set = CANNY_KERNELS_SCALAR; set <= CANNY_KERNELS_AVX2; set++) {
+		CannyEdgeDetector exact, fixed;
+		if (!exact.SetKernelSet((CannyKernelSet) set) || !fixed.SetKernelSet((CannyKernelSet) set)) {
+			printf("%-7s not supported, skipped\n", kernel_names[set]);
+			continue;
+		}
+		// Fixed point applies to exact mask only.
+		exact.SetRecursiveSigma(0.0f);
+		fixed.SetRecursiveSigma(0.0f);
+		fixed.SetFixedPoint(true);
+
+		int worst_gray = 0, worst_blur = 0;
+		for (int content = 0; content < CHECK_CONTENTS; content++) {
+			for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+				unsigned int width = sizes[k][0], height = sizes[k][1];
+				std::vector<uint8_t> pixels;
+				MakeImage((CheckContent) content, width, height, pixels);
+				CannyImageView image = {pixels.data(), width, height, (size_t) width * 3,
+				                        CANNY_PIXEL_BGR24};
+
+				for (size_t s = 0; s < sizeof(sigmas) / sizeof(sigmas[0]); s++) {
+					std::vector<uint8_t> gray, blurred, gray_fixed, blurred_fixed;
+					CannyCheck::RunBlur(exact, image, sigmas[s], gray, blurred);
+					CannyCheck::RunBlur(fixed, image, sigmas[s], gray_fixed, blurred_fixed);
+
+					int gray_difference = MaxDifference(gray, gray_fixed);
+					int blur_difference = MaxDifference(blurred, blurred_fixed);
+					worst_gray = gray_difference > worst_gray ? gray_difference : worst_gray;
+					worst_blur = blur_difference > worst_blur ? blur_difference : worst_blur;
+
+					cases++;
+					if (gray_difference > CHECK_GRAY_BOUND || blur_difference > CHECK_BLUR_BOUND) {
+						failures++;
+						printf("FAIL %s %s %ux%u sigma %g: gray %d, blur %d\n",
+						       kernel_names[set], content_names[content], width, height,
+						       sigmas[s], gray_difference, blur_difference);
+					}
+				}
+			}
+		}
+		printf("%-7s gray within %d, blur within %d\n", kernel_names[set], worst_gray, worst_blur);
+	}
+}
+
+/**
+ * \brief Compares recursive blur with exact mask.
+ *
+ * Recursive filter extends image with replicated pixels whatever border is
+ * chosen, so with other borders only pixels farther than half of mask from
+ * border of image are compared.
+ */
+static void CheckRecursiveBlur(unsigned long &cases, unsigned long &failures)
+{
+	static const float sigmas[] = {2.0f, 3.0f, 4.0f, 6.0f, 8.0f, 12.0f};
+	static const unsigned int sizes[][2] = {{7, 3}, {61, 47}, {256, 97}};
+	static const CannyBorder borders[] = {CANNY_BORDER_REPLICATE, CANNY_BORDER_REFLECT,
+	                                      CANNY_BORDER_CONSTANT};
+	static const char *border_names[] = {"replicate", "reflect", "constant"};
+
+	for (int set = CANNY_KERNELS_SCALAR; set <= CANNY_KERNELS_AVX2; set++) {
+		CannyEdgeDetector exact, recursive;
+		if (!exact.SetKernelSet((CannyKernelSet) set) || !recursive.SetKernelSet((CannyKernelSet) set)) {
+			continue;
+		}
+		exact.SetRecursiveSigma(0.0f);
+		recursive.SetRecursiveSigma(sigmas[0]);
+
+		double worst_mean = 0.0;
+		int worst_max = 0;
+		for (size_t b = 0; b < sizeof(borders) / sizeof(borders[0]); b++) {
+			exact.SetBorder(borders[b], 128);
+			recursive.SetBorder(borders[b], 128);
+			for (int content = 0; content < CHECK_CONTENTS; content++) {
+				for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+					unsigned int width = sizes[k][0], height = sizes[k][1];
+					std::vector<uint8_t> pixels;
+					MakeImage((CheckContent) content, width, height, pixels);
+					CannyImageView image = {pixels.data(), width, height, (size_t) width * 3,
+					                        CANNY_PIXEL_BGR24};
+
+					for (size_t s = 0; s < sizeof(sigmas) / sizeof(sigmas[0]); s++) {
+						std::vector<uint8_t> gray, blurred, gray_recursive, blurred_recursive;
+						CannyCheck::RunBlur(exact, image, sigmas[s], gray, blurred);
+						CannyCheck::RunBlur(recursive, image, sigmas[s], gray_recursive,
+						                    blurred_recursive);
+
+						unsigned int skip = borders[b] == CANNY_BORDER_REPLICATE ? 0 :
+						                    CannyCheck::HalfSize(sigmas[s]);
+						unsigned long count = 0, sum = 0;
+						int max = 0;
+						for (unsigned int x = skip; x + skip < height; x++) {
+							for (unsigned int y = skip; y + skip < width; y++) {
+								size_t i = (size_t) x * width + y;
+								int difference = abs((int) blurred[i] - (int) blurred_recursive[i]);
+								sum += difference;
+								count++;
+								max = difference > max ? difference : max;
+							}
+						}
+						double mean = count > 0 ? (double) sum / count : 0.0;
+						worst_mean = mean > worst_mean ? mean : worst_mean;
+						worst_max = max > worst_max ? max : worst_max;
+
+						cases++;
+						if (mean > CHECK_RECURSIVE_MEAN_BOUND || max > CHECK_RECURSIVE_MAX_BOUND) {
+							failures++;
+							printf("FAIL recursive %s %s %s %ux%u sigma %g: mean %.2f, max %d\n",
+							       kernel_names[set], border_names[b], content_names[content],
+							       width, height, sigmas[s], mean, max);
+						}
+					}
+				}
+			}
+		}
+		printf("%-7s recursive blur within %.2f on average, %d at most\n", kernel_names[set],
+		       worst_mean, worst_max);
+	}
+}
+
+/**
+ * \brief Compares masks of tiled processor with whole-image ones.
+ *
+ * Widths and heights lie between k * tile - halfsize and k * tile, so
+ * borders of tiles fall into far margin of enlarged image.
+ */
+static void CheckTiles(unsigned long &cases, unsigned long &failures)
+{
+	static const float sigmas[] = {1.0f, 2.0f, 4.5f};
+	static const unsigned int tile_sizes[] = {16, 32};
+	static const char *format_names[] = {"gray8", "bit1", "bgr24"};
+	unsigned long tile_cases = 0, tile_failures = 0;
+
+	for (size_t s = 0; s < sizeof(sigmas) / sizeof(sigmas[0]); s++) {
+		unsigned int halfsize = CannyCheck::HalfSize(sigmas[s]);
+		for (size_t t = 0; t < sizeof(tile_sizes) / sizeof(tile_sizes[0]); t++) {
+			unsigned int tile = tile_sizes[t];
+			std::vector<unsigned int> lengths;
+			for (unsigned int k = 1; k <= 2; k++) {
+				for (unsigned int d = 1; d < halfsize && d < k * tile; d++) {
+					lengths.push_back(k * tile - d);
+				}
+			}
+
+			// Each length as width and as height, other side small.
+			for (size_t l = 0; l < 2 * lengths.size(); l++) {
+				unsigned int width = l % 2 ? 24 : lengths[l / 2];
+				unsigned int height = l % 2 ? lengths[l / 2] : 24;
+				std::vector<uint8_t> pixels;
+				MakeImage(CHECK_RANDOM, width, height, pixels);
+				CannyImageView image = {pixels.data(), width, height, (size_t) width * 3,
+				                        CANNY_PIXEL_BGR24};
+
+				for (int format = CANNY_MASK_GRAY8; format <= CANNY_MASK_BGR24; format++) {
+					size_t stride = MaskStride((CannyMaskFormat) format, width);
+					std::vector<uint8_t> expected(stride * height, 7), tiled(stride * height, 9);
+					CannyMaskView expected_mask = {expected.data(), stride, (CannyMaskFormat) format};
+					CannyMaskView tiled_mask = {tiled.data(), stride, (CannyMaskFormat) format};
+
+					CannyEdgeDetector detector;
+					detector.SetRecursiveSigma(0.0f);
+					detector.ProcessImage(image, expected_mask, sigmas[s], 20, 60);
+					CannyTiledProcessor processor;
+					processor.SetTileSize(tile);
+					bool done = processor.ProcessImage(image, tiled_mask, sigmas[s], 20, 60);
+
+					tile_cases++;
+					if (!done || expected != tiled) {
+						tile_failures++;
+						printf("FAIL tiles %u %ux%u sigma %g %s\n", tile, width, height,
+						       sigmas[s], format_names[format]);
+					}
+				}
+			}
+		}
+	}
+
+	printf("tiles   %lu masks, %lu differ\n", tile_cases, tile_failures);
+	cases += tile_cases;
+	failures += tile_failures;
+}
+
+/**
+ * \brief Compares masks of task scheduling with single-threaded ones.
+ *
+ * Sizes, thread counts, sigma and pixel format are random, so strips of
+ * task graph end at many places relative to Gauss mask.
+ */
+static void CheckTaskGraph(unsigned long &cases, unsigned long &failures)
+{
+	static const float sigmas[] = {0.6f, 1.4f, 2.5f, 4.0f, 7.0f};
+	unsigned long task_cases = 0, task_failures = 0;
+
+	for (int i = 0; i < 200; i++) {
+		unsigned int width = 1 + rand() % 320, height = 1 + rand() % 320;
+		unsigned int threads = 2 + rand() % 7;
+		float sigma = sigmas[rand() % (sizeof(sigmas) / sizeof(sigmas[0]))];
+		bool fixed_point = rand() % 2 == 0;
+		bool gray = rand() % 2 == 0;
+
+		std::vector<uint8_t> pixels;
+		MakeImage(rand() % 3 == 0 ? CHECK_GRADIENT : CHECK_RANDOM, width, height, pixels);
+		CannyImageView image = {pixels.data(), width, height, (size_t) width * 3,
+		                        CANNY_PIXEL_BGR24};
+		std::vector<uint8_t> green;
+		if (gray) {
+			// Green channel as gray image.
+			green.resize((size_t) width * height);
+			for (size_t p = 0; p < green.size(); p++) {
+				green[p] = pixels[p * 3 + 1];
+			}
+			image.data = green.data();
+			image.stride = width;
+			image.format = CANNY_PIXEL_GRAY8;
+		}
+
+		std::vector<uint8_t> expected((size_t) width * height, 7), tasks((size_t) width * height, 9);
+		CannyMaskView expected_mask = {expected.data(), width, CANNY_MASK_GRAY8};
+		CannyMaskView tasks_mask = {tasks.data(), width, CANNY_MASK_GRAY8};
+
+		CannyEdgeDetector single, graph;
+		single.SetRecursiveSigma(0.0f);
+		single.SetFixedPoint(fixed_point);
+		graph.SetRecursiveSigma(0.0f);
+		graph.SetFixedPoint(fixed_point);
+		graph.SetThreadCount(threads);
+		graph.SetTaskScheduling(true);
+		bool done = single.ProcessImage(image, expected_mask, sigma, 20, 60) &&
+		            graph.ProcessImage(image, tasks_mask, sigma, 20, 60);
+
+		task_cases++;
+		if (!done || expected != tasks) {
+			task_failures++;
+			printf("FAIL tasks %ux%u %u threads sigma %g%s%s\n", width, height, threads, sigma,
+			       fixed_point ? " fixed" : "", gray ? " gray" : "");
+		}
+	}
+
+	printf("tasks   %lu masks, %lu differ\n", task_cases, task_failures);
+	cases += task_cases;
+	failures += task_failures;
+}
+
+/**
+ * \brief Compares masks of parallel edge propagation with serial ones.
+ *
+ * Thresholds are random, low one sometimes above high one or at ends of
+ * range. In instrumented build (see CannyStats.h) counters of propagation
+ * and hysteresis must match too; maximum depth of worklist is left out, as
+ * parallel labeling has no worklist.
+ */
+static void CheckPropagation(unsigned long &cases, unsigned long &failures)
+{
+	static const float sigmas[] = {0.6f, 1.0f, 1.4f, 2.5f, 4.0f};
+	unsigned long propagation_cases = 0, propagation_failures = 0;
+	bool with_stats = false;
+
+	for (int i = 0; i < 200; i++) {
+		unsigned int width = 1 + rand() % 320, height = 1 + rand() % 320;
+		unsigned int threads = 2 + rand() % 7;
+		float sigma = sigmas[rand() % (sizeof(sigmas) / sizeof(sigmas[0]))];
+		int low = rand() % 8 == 0 ? 0 : rand() % 256;
+		int high = rand() % 8 == 0 ? 255 : rand() % 256;
+		if (rand() % 4 != 0 && low > high) {
+			std::swap(low, high);
+		}
+
+		std::vector<uint8_t> pixels;
+		MakeImage((CheckContent) (rand() % CHECK_CONTENTS), width, height, pixels);
+		CannyImageView image = {pixels.data(), width, height, (size_t) width * 3,
+		                        CANNY_PIXEL_BGR24};
+		std::vector<uint8_t> expected((size_t) width * height, 7), parallel((size_t) width * height, 9);
+		CannyMaskView expected_mask = {expected.data(), width, CANNY_MASK_GRAY8};
+		CannyMaskView parallel_mask = {parallel.data(), width, CANNY_MASK_GRAY8};
+
+		CannyEdgeDetector serial, threaded;
+		serial.SetRecursiveSigma(0.0f);
+		threaded.SetRecursiveSigma(0.0f);
+		threaded.SetThreadCount(threads);
+		CannyStats serial_stats, threaded_stats;
+		with_stats = serial.SetStats(&serial_stats) && threaded.SetStats(&threaded_stats);
+		bool done = serial.ProcessImage(image, expected_mask, sigma, low, high) &&
+		            threaded.ProcessImage(image, parallel_mask, sigma, low, high);
+
+		bool same = done && expected == parallel;
+		if (same && with_stats) {
+			same = serial_stats.propagation_seeds == threaded_stats.propagation_seeds &&
+			       serial_stats.propagated_pixels == threaded_stats.propagated_pixels &&
+			       serial_stats.hysteresis_promoted == threaded_stats.hysteresis_promoted &&
+			       serial_stats.edge_pixels == threaded_stats.edge_pixels;
+		}
+
+		propagation_cases++;
+		if (!same) {
+			propagation_failures++;
+			printf("FAIL propagation %ux%u %u threads sigma %g thresholds %d %d\n", width,
+			       height, threads, sigma, low, high);
+			if (with_stats) {
+				printf("     seeds %lu %lu, propagated %lu %lu, promoted %lu %lu, edges %lu %lu\n",
+				       serial_stats.propagation_seeds, threaded_stats.propagation_seeds,
+				       serial_stats.propagated_pixels, threaded_stats.propagated_pixels,
+				       serial_stats.hysteresis_promoted, threaded_stats.hysteresis_promoted,
+				       serial_stats.edge_pixels, threaded_stats.edge_pixels);
+			}
+		}
+	}
+
+	printf("edges   %lu masks%s, %lu differ\n", propagation_cases,
+	       with_stats ? " and counters" : "", propagation_failures);
+	cases += propagation_cases;
+	failures += propagation_failures;
+}
+
+int main()
+{
+	unsigned long cases = 0, failures = 0;
+
+	srand(1);
+	CheckFixedPoint(cases, failures);
+	CheckRecursiveBlur(cases, failures);
+	CheckTiles(cases, failures);
+	CheckTaskGraph(cases, failures);
+	CheckPropagation(cases, failures);
+
+	printf("%lu cases, %lu failed\n", cases, failures);
+	return failures > 0 ? 1 : 0;
+}
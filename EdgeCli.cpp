@@ -0,0 +1,552 @@
+/**
+ * \file      EdgeCli.cpp
+ * \brief     Command line application detecting edges in batches of images.
+ * \details   This file is part of student project. Some parts of code may be
+ *            influenced by various examples found on internet.
+ * \author    resset <silentdemon@gmail.com>
+ * \date      2006-2012
+ * \copyright GNU General Public License, http://www.gnu.org/licenses/old-licenses/gpl-2.0.txt
+ *
+ * Images are processed in three overlapping stages: decoding (main thread),
+ * edge detection (worker threads, each with its own detector) and encoding
+ * (writer thread). Stages are connected with bounded queues. Jobs, with
+ * their image and mask buffers, circulate between the stages and are
+ * reused, so number of images in memory is limited.
+ */
+
+#include <ctype.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CannyEdgeDetector.h"
+#include "CannyImageIO.h"
+#include "CannyQueue.h"
+#include "CannyTiledProcessor.h"
+
+/**
+ * \brief Settings given on command line.
+ */
+struct Options
+{
+	std::string output;
+	float sigma;
+	unsigned int low_threshold;
+	unsigned int high_threshold;
+	unsigned int workers;
+	unsigned int threads;
+	bool bit_mask;
+	bool fixed_point;
+	bool streaming;
+	bool tasks;
+	float recursive_sigma;
+	CannyBorder border;
+	unsigned int border_value;
+	bool stats;
+	std::string trace;
+	unsigned int tile;
+	std::vector<CannyRegion> regions;
+};
+
+/**
+ * \brief One image travelling through the pipeline.
+ */
+struct Job
+{
+	std::string input;
+	std::string output;
+	CannyImage image;
+	std::vector<uint8_t> mask;
+	CannyStats stats;
+	bool ok;
+};
+
+static void PrintUsage(const char *name)
+{
+	fprintf(stderr,
+	        "Usage: %s [options] -o DIR INPUT...\n"
+	        "Detects edges in PGM/PPM files. INPUT is a file or a directory.\n"
+	        "\n"
+	        "  -o, --output DIR   directory masks are written to\n"
+	        "  -s, --sigma S      Gaussian blur sigma (default 1.0)\n"
+	        "  -l, --low N        low hysteresis threshold, 0-255 (default 30)\n"
+	        "  -H, --high N       high hysteresis threshold, 0-255 (default 80)\n"
+	        "  -j, --workers N    images processed at once (default: one per core)\n"
+	        "  -t, --threads N    threads per image (default 1)\n"
+	        "  -b, --bitmask      write 1 bpp PBM instead of 8-bit PGM\n"
+	        "  -f, --fixed        fixed-point luminance and blur\n"
+	        "      --streaming    fused row-by-row processing\n"
+	        "      --tasks        steps of strips as work-stealing tasks\n"
+	        "      --recursive S  recursive blur from sigma S on, 0 for never\n"
+	        "                     (default 8)\n"
+	        "      --border MODE  image extended by replicate (default), reflect,\n"
+	        "                     constant or constant:V with gray level V (0-255)\n"
+	        "      --stats        print time of each stage, summed over images\n"
+	        "      --trace FILE   write Chrome trace of stages into FILE\n"
+	        "      --tile N       process images bigger than memory in N x N tiles,\n"
+	        "                     one image at a time, on -t threads, always with\n"
+	        "                     exact Gauss mask\n"
+	        "      --roi X,Y,W,H  detect edges only inside W x H rectangle at column\n"
+	        "                     X and row Y, may be repeated; rest of mask is 0\n"
+	        "  -h, --help         show this message\n",
+	        name);
+}
+
+/**
+ * \brief Tells if file name has PGM or PPM extension.
+ */
+static bool IsImageName(const std::string &name)
+{
+	size_t dot = name.rfind('.');
+	if (dot == std::string::npos) {
+		return false;
+	}
+
+	std::string extension = name.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extension == "pgm" || extension == "ppm";
+}
+
+/**
+ * \brief Expands arguments into list of image files.
+ *
+ * Directories are scanned (not recursively) for PGM/PPM files, in name
+ * order. Other arguments are taken as they are.
+ */
+static bool CollectInputs(char **arguments, int count, std::vector<std::string> &inputs)
+{
+	for (int i = 0; i < count; i++) {
+		std::string path = arguments[i];
+		struct stat status;
+
+		if (stat(path.c_str(), &status) != 0) {
+			fprintf(stderr, "%s: cannot access\n", path.c_str());
+			return false;
+		}
+		if (!S_ISDIR(status.st_mode)) {
+			inputs.push_back(path);
+			continue;
+		}
+
+		DIR *directory = opendir(path.c_str());
+		if (directory == NULL) {
+			fprintf(stderr, "%s: cannot open directory\n", path.c_str());
+			return false;
+		}
+		std::vector<std::string> names;
+		struct dirent *entry;
+		while ((entry = readdir(directory)) != NULL) {
+			if (IsImageName(entry->d_name)) {
+				names.push_back(path + "/" + entry->d_name);
+			}
+		}
+		closedir(directory);
+		std::sort(names.begin(), names.end());
+		inputs.insert(inputs.end(), names.begin(), names.end());
+	}
+
+	return true;
+}
+
+/**
+ * \brief Returns name of output file for given input file.
+ */
+static std::string OutputName(const Options &options, const std::string &input)
+{
+	size_t slash = input.rfind('/');
+	std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+	size_t dot = name.rfind('.');
+
+	if (dot != std::string::npos) {
+		name.erase(dot);
+	}
+	return options.output + "/" + name + (options.bit_mask ? ".pbm" : ".pgm");
+}
+
+static bool ParseOptions(int argc, char **argv, Options &options, int &first_input)
+{
+	static const struct option long_options[] = {
+		{"output",    required_argument, NULL, 'o'},
+		{"sigma",     required_argument, NULL, 's'},
+		{"low",       required_argument, NULL, 'l'},
+		{"high",      required_argument, NULL, 'H'},
+		{"workers",   required_argument, NULL, 'j'},
+		{"threads",   required_argument, NULL, 't'},
+		{"bitmask",   no_argument,       NULL, 'b'},
+		{"fixed",     no_argument,       NULL, 'f'},
+		{"streaming", no_argument,       NULL, 'S'},
+		{"tasks",     no_argument,       NULL, 'K'},
+		{"recursive", required_argument, NULL, 'R'},
+		{"border",    required_argument, NULL, 'B'},
+		{"stats",     no_argument,       NULL, 'A'},
+		{"trace",     required_argument, NULL, 'T'},
+		{"tile",      required_argument, NULL, 'X'},
+		{"roi",       required_argument, NULL, 'r'},
+		{"help",      no_argument,       NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	int option;
+	bool recursive = false;
+
+	options.sigma = 1.0f;
+	options.low_threshold = 30;
+	options.high_threshold = 80;
+	options.workers = std::thread::hardware_concurrency();
+	options.workers = options.workers > 0 ? options.workers : 1;
+	options.threads = 1;
+	options.bit_mask = false;
+	options.fixed_point = false;
+	options.streaming = false;
+	options.tasks = false;
+	options.recursive_sigma = 8.0f;
+	options.border = CANNY_BORDER_REPLICATE;
+	options.border_value = 0;
+	options.stats = false;
+	options.tile = 0;
+
+	while ((option = getopt_long(argc, argv, "o:s:l:H:j:t:bfh", long_options, NULL)) != -1) {
+		switch (option) {
+			case 'o':
+				options.output = optarg;
+				break;
+			case 's':
+				options.sigma = atof(optarg);
+				break;
+			case 'l':
+				options.low_threshold = atoi(optarg);
+				break;
+			case 'H':
+				options.high_threshold = atoi(optarg);
+				break;
+			case 'j':
+				options.workers = atoi(optarg);
+				break;
+			case 't':
+				options.threads = atoi(optarg);
+				break;
+			case 'b':
+				options.bit_mask = true;
+				break;
+			case 'f':
+				options.fixed_point = true;
+				break;
+			case 'S':
+				options.streaming = true;
+				break;
+			case 'K':
+				options.tasks = true;
+				break;
+			case 'R':
+				options.recursive_sigma = atof(optarg);
+				recursive = true;
+				break;
+			case 'B':
+				if (strcmp(optarg, "replicate") == 0) {
+					options.border = CANNY_BORDER_REPLICATE;
+				} else if (strcmp(optarg, "reflect") == 0) {
+					options.border = CANNY_BORDER_REFLECT;
+				} else if (strcmp(optarg, "constant") == 0 ||
+				           sscanf(optarg, "constant:%u", &options.border_value) == 1) {
+					options.border = CANNY_BORDER_CONSTANT;
+				} else {
+					fprintf(stderr, "Invalid border %s\n", optarg);
+					return false;
+				}
+				break;
+			case 'A':
+				options.stats = true;
+				break;
+			case 'T':
+				options.trace = optarg;
+				break;
+			case 'X':
+				options.tile = atoi(optarg);
+				break;
+			case 'r': {
+				CannyRegion region;
+				memset(&region, 0, sizeof(region));
+				if (sscanf(optarg, "%u,%u,%u,%u", &region.left, &region.top,
+				           &region.width, &region.height) != 4) {
+					fprintf(stderr, "Invalid region %s\n", optarg);
+					return false;
+				}
+				options.regions.push_back(region);
+				break;
+			}
+			default:
+				return false;
+		}
+	}
+
+	if (options.output.empty() || optind >= argc) {
+		return false;
+	}
+	if (options.sigma <= 0.0f || options.recursive_sigma < 0.0f || options.low_threshold > 255 ||
+	    options.high_threshold > 255 || options.border_value > 255 || options.workers < 1 || options.threads < 1) {
+		fprintf(stderr, "Invalid option value\n");
+		return false;
+	}
+	if (options.tile > 0 && (options.stats || !options.trace.empty())) {
+		fprintf(stderr, "Statistics are not gathered in tiled mode\n");
+		return false;
+	}
+	if (options.tile > 0 && !options.regions.empty()) {
+		fprintf(stderr, "Regions are not supported in tiled mode\n");
+		return false;
+	}
+	if (options.tile > 0 && (options.streaming || options.tasks)) {
+		fprintf(stderr, "Streaming and task scheduling are not supported in tiled mode\n");
+		return false;
+	}
+	if (options.tile > 0 && recursive && options.recursive_sigma > 0.0f) {
+		fprintf(stderr, "Recursive blur is not supported in tiled mode, tiles use exact mask\n");
+		return false;
+	}
+
+	first_input = optind;
+	return true;
+}
+
+/**
+ * \brief Prints statistics summed over all images.
+ */
+static void PrintStats(const CannyStats &total)
+{
+	for (int i = 0; i < CANNY_STAGES; i++) {
+		if (total.stage_seconds[i] > 0.0) {
+			printf("%-18s %10.3f s\n", CannyStageName((CannyStage) i), total.stage_seconds[i]);
+		}
+	}
+	printf("%-18s %10lu\n", "bytes allocated", total.bytes_allocated);
+	printf("%-18s %10lu\n", "propagation seeds", total.propagation_seeds);
+	printf("%-18s %10lu\n", "propagated pixels", total.propagated_pixels);
+	printf("%-18s %10lu\n", "hysteresis pixels", total.hysteresis_promoted);
+	printf("%-18s %10lu\n", "max worklist", total.max_worklist_depth);
+	printf("%-18s %10lu\n", "edge pixels", total.edge_pixels);
+}
+
+/**
+ * \brief Processes images one by one, file to file, in tiles.
+ *
+ * \return Number of images that failed.
+ */
+static unsigned long DetectEdgesTiled(const Options &options,
+                                      const std::vector<std::string> &inputs,
+                                      unsigned long &images, double &pixels)
+{
+	CannyTiledProcessor processor;
+	CannyMaskFormat format = options.bit_mask ? CANNY_MASK_BIT1 : CANNY_MASK_GRAY8;
+	unsigned long failures = 0;
+
+	processor.SetTileSize(options.tile);
+	processor.SetThreadCount(options.threads);
+	processor.SetFixedPoint(options.fixed_point);
+	processor.SetBorder(options.border, options.border_value);
+
+	for (size_t i = 0; i < inputs.size(); i++) {
+		unsigned int width, height;
+		CannyPixelFormat pixel_format;
+		size_t offset;
+
+		if (!CannyReadPNMHeader(inputs[i], width, height, pixel_format, offset) ||
+		    !processor.ProcessFile(inputs[i], OutputName(options, inputs[i]), format,
+		                           options.sigma, options.low_threshold,
+		                           options.high_threshold)) {
+			fprintf(stderr, "%s: cannot process\n", inputs[i].c_str());
+			failures++;
+			continue;
+		}
+		images++;
+		pixels += (double) width * height;
+	}
+
+	return failures;
+}
+
+/**
+ * \brief Edge detection stage, run by each worker thread.
+ */
+static void DetectEdges(const Options &options, CannyTrace *trace,
+                        CannyQueue<Job *> &decoded, CannyQueue<Job *> &detected)
+{
+	CannyEdgeDetector detector;
+	CannyMaskFormat format = options.bit_mask ? CANNY_MASK_BIT1 : CANNY_MASK_GRAY8;
+	Job *job;
+
+	detector.SetThreadCount(options.threads);
+	detector.SetFixedPoint(options.fixed_point);
+	detector.SetStreaming(options.streaming);
+	detector.SetTaskScheduling(options.tasks);
+	detector.SetRecursiveSigma(options.recursive_sigma);
+	detector.SetBorder(options.border, options.border_value);
+	detector.SetTrace(trace);
+
+	while (decoded.Pop(job)) {
+		if (job->ok) {
+			detector.SetStats(options.stats ? &job->stats : NULL);
+			size_t stride = options.bit_mask ? (job->image.width + 7) / 8 : job->image.width;
+			job->mask.resize(stride * job->image.height);
+
+			CannyMaskView mask = {job->mask.data(), stride, format};
+			if (options.regions.empty()) {
+				job->ok = detector.ProcessImage(job->image.View(), mask, options.sigma,
+				                                options.low_threshold, options.high_threshold);
+			} else {
+				// Pixels outside of regions are not written.
+				std::fill(job->mask.begin(), job->mask.end(), 0);
+				job->ok = detector.ProcessRegions(job->image.View(), mask, options.regions.data(),
+				                                  options.regions.size(), options.sigma,
+				                                  options.low_threshold, options.high_threshold);
+			}
+		}
+		detected.Push(job);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	Options options;
+	std::vector<std::string> inputs;
+	int first_input;
+
+	if (!ParseOptions(argc, argv, options, first_input)) {
+		PrintUsage(argv[0]);
+		return 2;
+	}
+	if (!CollectInputs(argv + first_input, argc - first_input, inputs)) {
+		return 1;
+	}
+
+	// Huge images skip the pipeline, whole images are never held in memory.
+	if (options.tile > 0) {
+		unsigned long images = 0;
+		double pixels = 0.0;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		unsigned long failures = DetectEdgesTiled(options, inputs, images, pixels);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		seconds = seconds > 0.0 ? seconds : 1e-9;
+		printf("%lu images, %.1f MP in %.3f s: %.1f images/s, %.1f MP/s\n",
+		       images, pixels / 1e6, seconds, images / seconds, pixels / 1e6 / seconds);
+		if (failures > 0) {
+			fprintf(stderr, "%lu images failed\n", failures);
+			return 1;
+		}
+		return 0;
+	}
+
+	CannyTrace trace;
+	CannyTrace *used_trace = options.trace.empty() ? NULL : &trace;
+	CannyStats total;
+	memset(&total, 0, sizeof(total));
+	if ((options.stats || used_trace != NULL) && !CannyEdgeDetector().SetStats(&total)) {
+		fprintf(stderr, "Statistics need detector built with INSTRUMENTATION=1\n");
+		return 2;
+	}
+
+	// Two jobs per worker keep it busy while the other stages work on
+	// theirs.
+	size_t job_count = 2 * options.workers + 2;
+	std::vector<Job> jobs(job_count);
+	CannyQueue<Job *> free_jobs(job_count);
+	CannyQueue<Job *> decoded(options.workers);
+	CannyQueue<Job *> detected(job_count);
+	for (size_t i = 0; i < job_count; i++) {
+		free_jobs.Push(&jobs[i]);
+	}
+
+	unsigned long images = 0;
+	unsigned long failures = 0;
+	double pixels = 0.0;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < options.workers; i++) {
+		workers.push_back(std::thread(DetectEdges, std::cref(options), used_trace,
+		                              std::ref(decoded), std::ref(detected)));
+	}
+
+	// Encoding stage, returns jobs to the pool once masks are written.
+	std::thread writer([&] {
+		Job *job;
+		while (detected.Pop(job)) {
+			if (job->ok) {
+				CannyMaskFormat format = options.bit_mask ? CANNY_MASK_BIT1 : CANNY_MASK_GRAY8;
+				job->ok = CannyWritePNM(job->output, job->mask.data(), job->image.width,
+				                        job->image.height, format);
+				if (!job->ok) {
+					fprintf(stderr, "%s: cannot write\n", job->output.c_str());
+				}
+			} else {
+				fprintf(stderr, "%s: cannot read or process\n", job->input.c_str());
+			}
+			if (job->ok) {
+				images++;
+				pixels += (double) job->image.width * job->image.height;
+				if (options.stats) {
+					for (int i = 0; i < CANNY_STAGES; i++) {
+						total.stage_seconds[i] += job->stats.stage_seconds[i];
+					}
+					total.bytes_allocated += job->stats.bytes_allocated;
+					total.propagation_seeds += job->stats.propagation_seeds;
+					total.propagated_pixels += job->stats.propagated_pixels;
+					total.hysteresis_promoted += job->stats.hysteresis_promoted;
+					if (job->stats.max_worklist_depth > total.max_worklist_depth) {
+						total.max_worklist_depth = job->stats.max_worklist_depth;
+					}
+					total.edge_pixels += job->stats.edge_pixels;
+				}
+			} else {
+				failures++;
+			}
+			free_jobs.Push(job);
+		}
+	});
+
+	// Decoding stage. Waits for free job, so it never runs more than pool
+	// size ahead of the writer.
+	for (size_t i = 0; i < inputs.size(); i++) {
+		Job *job = NULL;
+		if (!free_jobs.Pop(job)) {
+			break;
+		}
+		job->input = inputs[i];
+		job->output = OutputName(options, inputs[i]);
+		job->ok = CannyReadPNM(job->input, job->image);
+		decoded.Push(job);
+	}
+
+	decoded.Close();
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+	detected.Close();
+	writer.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	seconds = seconds > 0.0 ? seconds : 1e-9;
+	printf("%lu images, %.1f MP in %.3f s: %.1f images/s, %.1f MP/s\n",
+	       images, pixels / 1e6, seconds, images / seconds, pixels / 1e6 / seconds);
+	if (options.stats) {
+		PrintStats(total);
+	}
+	if (used_trace != NULL && !trace.Write(options.trace)) {
+		fprintf(stderr, "%s: cannot write\n", options.trace.c_str());
+		return 1;
+	}
+	if (failures > 0) {
+		fprintf(stderr, "%lu images failed\n", failures);
+		return 1;
+	}
+
+	return 0;
+}